@@ -4,6 +4,7 @@
 #include <limits>
 #include <map>
 #include <queue>
+#include <set>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -139,6 +140,33 @@ a.getInitialState()*(b.getNumberOfStates()+1) + b.getInitialState(),
     
   }
 
+  bool DFA::equivalent(const DFA &a, const DFA &b) {
+    // Walks the product of a and b. A missing edge goes to a dead state
+    // numbered after the last state.
+    auto step = [](const DFA &d, state s, symbol c) {
+      auto it = d.delta.find({s, c});
+      return it == std::end(d.delta) ? static_cast<state>(d.numberOfStates) : it->second;
+    };
+
+    std::set<std::pair<state, state> > seen;
+    std::queue<std::pair<state, state> > Q;
+    seen.insert({a.q0, b.q0});
+    Q.push({a.q0, b.q0});
+    while (!Q.empty()) {
+      auto curr = Q.front(); Q.pop();
+      if (a.getAcceptTypeForState(curr.first, REJECT) != b.getAcceptTypeForState(curr.second, REJECT)) {
+	return false;
+      }
+      for (int c = 0; c < 256; ++c) {
+	std::pair<state, state> next(step(a, curr.first, symbol(c)), step(b, curr.second, symbol(c)));
+	if (seen.insert(next).second) {
+	  Q.push(next);
+	}
+      }
+    }
+    return true;
+  }
+
   void DFA::addCrashState() {
     std::unordered_set<symbol> alphabet = lexer::getAlphabet(*this);
 
@@ -405,6 +433,32 @@ a.getInitialState()*(b.getNumberOfStates()+1) + b.getInitialState(),
     return res;
   }
 
+  std::vector<bool> DFA::getLiveStates() const {
+    std::vector<std::vector<state> > reverse(numberOfStates);
+    for (auto x : delta) {
+      reverse[x.second].push_back(x.first.first);
+    }
+
+    std::vector<bool> live(numberOfStates, false);
+    std::queue<state> Q;
+    for (auto x : A) {
+      if (x.second != lexer::REJECT) {
+	live[x.first] = true;
+	Q.push(x.first);
+      }
+    }
+    while (!Q.empty()) {
+      state curr = Q.front(); Q.pop();
+      for (auto s : reverse[curr]) {
+	if (!live[s]) {
+	  live[s] = true;
+	  Q.push(s);
+	}
+      }
+    }
+    return live;
+  }
+
   size_t DFA::getNumberOfStates() const {
     return this->numberOfStates;
   }
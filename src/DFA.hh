@@ -33,6 +33,9 @@ public:
 
   static DFA minus(const DFA &a, const DFA &b);
 
+  // True if a and b accept the same strings with the same types.
+  static bool equivalent(const DFA &a, const DFA &b);
+
   void minimize();
 
   const std::unordered_map<state, acceptType>& getAcceptStates() const;
@@ -46,6 +49,9 @@ public:
 
   std::unordered_set<symbol> getAlphabet() const;
 
+  // live[s] is true if an accepting state can be reached from s.
+  std::vector<bool> getLiveStates() const;
+
   std::string toDot() const;
 
 private:
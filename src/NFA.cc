@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <bitset>
 #include <iostream>
 #include <limits>
 #include <map>
@@ -8,6 +9,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "bit_nfa.hh"
 #include "lexer_common.hh"
 #include "NFA.hh"
 
@@ -17,16 +19,20 @@ namespace {
 
   using lexer::acceptType;
 
-  void addLambdaFromAcceptToInitial(std::multimap<std::pair<state, symbol>, state> &newDelta,
+  using lexer::symbol_set; using lexer::nfa_edge;
+
+  const symbol_set lambdaOnly{lexer::LAMBDA};
+
+  void addLambdaFromAcceptToInitial(lexer::NFA::delta_type &newDelta,
 				    std::unordered_map<state, acceptType> &newAccepts,
 				    state newInitial) {    
     for (auto x : newAccepts) {
-      newDelta.insert(std::make_pair(std::make_pair(x.first, lexer::LAMBDA), newInitial));
+      newDelta.insert({x.first, nfa_edge{lambdaOnly, newInitial}});
     }
 
   }
 
-  acceptType getAcceptType(std::set<state> &s, std::unordered_map<state, acceptType> A) {
+  acceptType getAcceptType(const std::set<state> &s, const std::unordered_map<state, acceptType> &A) {
     acceptType a = 0;
     for (auto x : s) {
       auto val = A.find(x);
@@ -42,80 +48,35 @@ namespace {
     return colors[a%colors.size()];
   }
 
-  std::unordered_set<state> getLambdaClosureForState(state s, const std::multimap<std::pair<state, symbol>, state> &delta, size_t numberOfStates) {
-    // fixed point computation
-    std::vector<int8_t> visited(numberOfStates, 0);
-    std::queue<state> Q;
-    Q.push(s);
-    visited[s] = true;
-    
-    while (!Q.empty()) {
-      state next = Q.front();
-      Q.pop();
-
-      auto iters = delta.equal_range(std::make_pair(next, lexer::LAMBDA));
-
-      for (auto it = iters.first; it != iters.second; ++it) {
-	state target = it->second;
-	if (!visited[target]) {
-	  Q.push(target);
-	  visited[target] = true;
-	}
-      }
-    }
-
-    std::unordered_set<state> ret;
-    for (state i = 0; i < numberOfStates; ++i) {
-      if (visited[i]) ret.insert(i);
-    }
-    return ret;
-  }
-
 } // end noname namespace
 
 namespace lexer {
 
   NFA::NFA(size_t numberOfStates, std::unordered_map<state, acceptType> A,
-           state q0, std::multimap<std::pair<state, symbol>, state> delta) : 
-    numberOfStates(numberOfStates), A(std::move(A)), q0(q0), delta(std::move(delta)) { }
-
-
-  acceptType NFA::accept(const std::string &x) const {
-
-    std::vector<std::unordered_set<state> > lambdaClosures(numberOfStates);
-    for (state i = 0; i < numberOfStates; ++i) {
-      lambdaClosures[i] = std::move(::getLambdaClosureForState(i, delta, numberOfStates));
+           state q0, const std::multimap<std::pair<state, symbol>, state> &delta) : 
+    numberOfStates(numberOfStates), A(std::move(A)), q0(q0) {
+    std::map<std::pair<state, state>, symbol_set> edges;
+    for (auto &x : delta) {
+      edges[{x.first.first, x.second}].insert(x.first.second);
     }
-    
-    std::unordered_set<state> currStateSpace = lambdaClosures[q0];
-   
-    for (auto c : x) {
-      std::unordered_set<state> nextStateSpace;
-      for (auto y : currStateSpace) {
-        auto its = delta.equal_range(std::make_pair(y, symbol(c)));
-        while (its.first != its.second) {
-	  // insert lambda closure for target state.
-	  state target = (its.first)->second;
-	  nextStateSpace.insert(std::begin(lambdaClosures[target]),
-				std::end(lambdaClosures[target]));
-          ++(its.first);
-        }
-      }
-      std::swap(nextStateSpace, currStateSpace);
-    }
-    
-    acceptType res = lexer::REJECT;
-    for (auto x : currStateSpace) {
-      auto y = A.find(x);
-      if (y != std::end(A) && y->second > res) {
-        res = y->second;
-      }
+    for (auto &x : edges) {
+      this->delta.insert({x.first.first, nfa_edge{x.second, x.first.second}});
     }
+  }
 
+  NFA NFA::fromEdges(size_t numberOfStates, std::unordered_map<state, acceptType> A,
+		     state q0, delta_type delta) {
+    NFA res(numberOfStates, std::move(A), q0, {});
+    res.delta = std::move(delta);
     return res;
   }
 
 
+  acceptType NFA::accept(const std::string &x) const {
+    return BitParallelNFA(*this).accept(x);
+  }
+
+
 
   NFA NFA::concat(const NFA &a, const NFA &b) {
 
@@ -125,7 +86,7 @@ namespace lexer {
     auto aDelta = a.getDelta();
     auto bDelta = b.getDelta();
 
-    std::multimap<std::pair<state, symbol>, state> newDelta;
+    delta_type newDelta;
     std::unordered_map<state, acceptType> newAccepts;
 
     size_t newSize = aSize + bSize;
@@ -133,27 +94,25 @@ namespace lexer {
     newDelta.insert(std::begin(aDelta), std::end(aDelta));
     
     for (auto x : bDelta) {
-      newDelta.insert(std::make_pair(std::make_pair(x.first.first+aSize, x.first.second),
-				     x.second + aSize));
+      newDelta.insert({x.first+aSize, nfa_edge{x.second.symbols, static_cast<state>(x.second.target + aSize)}});
     }
 
     state bNewInitial = b.getInitialState() + aSize;
     
     for (auto x : a.getAcceptStates()) {
-      newDelta.insert(std::make_pair(std::make_pair(x.first, lexer::LAMBDA), 
-				     bNewInitial));
+      newDelta.insert({x.first, nfa_edge{lambdaOnly, bNewInitial}});
     }
 
     for (auto x : b.getAcceptStates()) {
       newAccepts.insert({x.first+aSize, x.second});
     }
 
-    return NFA(newSize, newAccepts, a.getInitialState(), newDelta);
+    return fromEdges(newSize, newAccepts, a.getInitialState(), newDelta);
 
   }
 
   NFA NFA::addStar(const NFA &a, acceptType at) {
-    std::multimap<std::pair<state, symbol>, state> newDelta(a.getDelta());
+    delta_type newDelta(a.getDelta());
     std::unordered_map<state, acceptType> newAccepts;
     size_t newSize = a.getNumberOfStates()+1;
     state newInitial = newSize-1;
@@ -162,39 +121,39 @@ namespace lexer {
     
     newAccepts[newInitial] = at;
 
-    newDelta.insert({{newInitial, lexer::LAMBDA}, a.getInitialState()});
+    newDelta.insert({newInitial, nfa_edge{lambdaOnly, a.getInitialState()}});
 
-    return NFA(newSize, newAccepts, newInitial, newDelta);
+    return fromEdges(newSize, newAccepts, newInitial, newDelta);
   }
 
   NFA NFA::addPlus(const NFA &a) {
-    std::multimap<std::pair<state, symbol>, state> newDelta(a.getDelta());
+    delta_type newDelta(a.getDelta());
     std::unordered_map<state, acceptType> newAccepts(a.getAcceptStates());
     size_t newSize = a.getNumberOfStates() + 1;
     state newInitial = newSize - 1;
 
     addLambdaFromAcceptToInitial(newDelta, newAccepts, newInitial);
 
-    newDelta.insert({{newInitial, lexer::LAMBDA}, a.getInitialState()});
+    newDelta.insert({newInitial, nfa_edge{lambdaOnly, a.getInitialState()}});
 
-    return NFA(newSize, newAccepts, newInitial, newDelta);
+    return fromEdges(newSize, newAccepts, newInitial, newDelta);
   }
 
   NFA NFA::opt(const NFA &a) {
-    std::multimap<std::pair<state, symbol>, state> newDelta(a.getDelta());
+    delta_type newDelta(a.getDelta());
     std::unordered_map<state, acceptType> newAccepts(a.getAcceptStates());
     size_t newSize = a.getNumberOfStates() + 1;
     state newInitial = newSize - 1;
     
-    newDelta.insert({{newInitial, lexer::LAMBDA}, a.getInitialState()});
+    newDelta.insert({newInitial, nfa_edge{lambdaOnly, a.getInitialState()}});
     newAccepts.insert({newInitial, a.getAcceptStates().begin()->second});
-    return NFA(newSize, newAccepts, newInitial, newDelta);
+    return fromEdges(newSize, newAccepts, newInitial, newDelta);
   }
 
   NFA NFA::join(const NFA &a, const NFA &b) {
 
     
-    std::multimap<std::pair<state, symbol>, state> newDelta;
+    delta_type newDelta;
     std::unordered_map<state, acceptType> newAccepts;
 
     size_t newSize = a.getNumberOfStates() + b.getNumberOfStates() + 1;
@@ -205,19 +164,15 @@ namespace lexer {
     state bInitial = b.getInitialState();
 
     for (auto x : a.getDelta()) {
-      newDelta.insert(std::make_pair(std::make_pair(x.first.first+1, x.first.second), 
-				     x.second+1));
+      newDelta.insert({x.first+1, nfa_edge{x.second.symbols, x.second.target+1}});
     }
 
     for (auto x : b.getDelta()) {
-      newDelta.insert(std::make_pair(std::make_pair(x.first.first+1+aSize, x.first.second), 
-				     x.second+1+aSize));
+      newDelta.insert({x.first+1+aSize, nfa_edge{x.second.symbols, static_cast<state>(x.second.target+1+aSize)}});
     }
 
-    newDelta.insert(std::make_pair(std::make_pair(newInitial, lexer::LAMBDA), 
-				   aInitial+1));
-    newDelta.insert(std::make_pair(std::make_pair(newInitial, lexer::LAMBDA), 
-				   bInitial+1+aSize));
+    newDelta.insert({newInitial, nfa_edge{lambdaOnly, aInitial+1}});
+    newDelta.insert({newInitial, nfa_edge{lambdaOnly, static_cast<state>(bInitial+1+aSize)}});
 
     for (auto x : a.getAcceptStates()) {
       newAccepts.insert({x.first+1, x.second});
@@ -227,23 +182,68 @@ namespace lexer {
       newAccepts.insert({x.first+1+aSize, x.second});
     }
 
-    return NFA(newSize, newAccepts, newInitial, newDelta);
+    return fromEdges(newSize, newAccepts, newInitial, newDelta);
+  }
+
+  NFA NFA::joinInitials(const NFA &a, const NFA &b) {
+
+    delta_type newDelta;
+    std::unordered_map<state, acceptType> newAccepts;
+
+    size_t aSize = a.getNumberOfStates();
+    size_t newSize = aSize + b.getNumberOfStates() - 1;
+    state aInitial = a.getInitialState();
+    state bInitial = b.getInitialState();
+
+    // The shared initial state is 0, the other states keep their order.
+    auto aState = [&](state s) { return s == aInitial ? 0 : (s < aInitial ? s+1 : s); };
+    auto bState = [&](state s) -> state { return s == bInitial ? 0 : (s < bInitial ? s+aSize : s+aSize-1); };
+
+    for (auto x : a.getDelta()) {
+      newDelta.insert({aState(x.first), nfa_edge{x.second.symbols, aState(x.second.target)}});
+    }
+    for (auto x : b.getDelta()) {
+      newDelta.insert({bState(x.first), nfa_edge{x.second.symbols, bState(x.second.target)}});
+    }
+
+    for (auto x : a.getAcceptStates()) {
+      newAccepts[aState(x.first)] = x.second;
+    }
+    for (auto x : b.getAcceptStates()) {
+      acceptType &at = newAccepts[bState(x.first)];
+      at = std::max(at, x.second);
+    }
+
+    return fromEdges(newSize, newAccepts, 0, newDelta);
   }
 
-  NFA NFA::simpleAccept(std::unordered_set<symbol> accSymbols, acceptType at) {
-    std::multimap<std::pair<state, symbol>, state> newDelta;
+  NFA NFA::simpleAccept(const symbol_set &accSymbols, acceptType at) {
+    delta_type newDelta;
     std::unordered_map<state, acceptType> newAccepts;
 
     size_t newSize = 2;
     state newInitial = 0;
 
-    for (auto x : accSymbols) {
-      newDelta.insert({{0, x}, 1});
+    if (!accSymbols.empty()) {
+      newDelta.insert({0, nfa_edge{accSymbols, 1}});
     }
 
     newAccepts[1] = at;
 
-    return NFA(newSize, newAccepts, newInitial, newDelta);
+    return fromEdges(newSize, newAccepts, newInitial, newDelta);
+  }
+
+  NFA NFA::unanchored(const NFA &a) {
+    delta_type newDelta(a.getDelta());
+    std::unordered_map<state, acceptType> newAccepts(a.getAcceptStates());
+    size_t newSize = a.getNumberOfStates() + 1;
+    state newInitial = newSize - 1;
+
+    // loop on every symbol before entering a
+    newDelta.insert({newInitial, nfa_edge{symbol_set::allBytes(), newInitial}});
+    newDelta.insert({newInitial, nfa_edge{lambdaOnly, a.getInitialState()}});
+
+    return fromEdges(newSize, newAccepts, newInitial, newDelta);
   }
 
   const size_t NFA::getNumberOfStates() const {
@@ -261,177 +261,210 @@ namespace lexer {
 
   void NFA::lambdaElimination() {
     // for each state find out where we can go using only lambdas
-    std::vector<std::unordered_set<state> > lambdaClosures(numberOfStates);
-
-    for (state s = 0; s < numberOfStates; ++s) {
-    
-      lambdaClosures[s] = ::getLambdaClosureForState(s, delta, numberOfStates);
-      
+    LambdaClosures closures(*this);
+    size_t words = closures.getWords();
+
+    // Only the initial state and the targets of edges that are not lambda
+    // can be reached once the lambda edges are gone, so only they get
+    // edges, and they accept if their closure does.
+    std::vector<bool> reachable(numberOfStates, false);
+    reachable[q0] = true;
+    for (auto &x : delta) {
+      if (!x.second.symbols.withoutLambda().empty()) reachable[x.second.target] = true;
     }
 
-    std::multimap<std::pair<state, symbol>, state> deltaNew;
-    
+    // States with the same closure get the same edges, so they are
+    // computed once per component.
+    std::vector<std::map<state, symbol_set> > edges(closures.getNumberOfComponents());
+    std::vector<acceptType> accepts(closures.getNumberOfComponents(), 0);
+    std::vector<bool> done(closures.getNumberOfComponents(), false);
+
+    delta_type deltaNew;
     for (state s = 0; s < numberOfStates; ++s) {
-      for (auto x : lambdaClosures[s]) {
-	// get all edges out of x -- note s is included in lambdaClosures[s]
-	auto it = delta.lower_bound(std::make_pair(x, symbol::min()));
-	auto itEnd = delta.upper_bound(std::make_pair(x, symbol::max()));
-	
-	while (it != itEnd) {
-	  
-	  if (it->first.second != lexer::LAMBDA) {
-	    state start = s;
-	    state end = it->second;
-	    symbol symb = it->first.second;
-	    // take one step that is *not* lambda, and add edge to that state
-	    deltaNew.insert(std::make_pair(std::make_pair(start, symb), end));
-	    for (auto y : lambdaClosures[end]) { // followed by arbitrary lambda steps too
-	      deltaNew.insert(std::make_pair(std::make_pair(start, symb), y));
+      if (!reachable[s]) continue;
+      state c = closures.getComponent(s);
+      if (!done[c]) {
+	done[c] = true;
+	const uint64_t *closure = closures.of(s);
+	for (size_t w = 0; w < words; ++w) {
+	  for (uint64_t bits = closure[w]; bits; bits &= bits - 1) {
+	    state x = w * 64 + __builtin_ctzll(bits);
+	    auto y = A.find(x);
+	    if (y != std::end(A)) {
+	      accepts[c] = std::max(accepts[c], y->second);
+	    }
+	    // get all edges out of x -- note s is included in its closure
+	    auto its = delta.equal_range(x);
+	    for (auto it = its.first; it != its.second; ++it) {
+	      // take one step that is *not* lambda, and add edge to that state
+	      symbol_set symbols = it->second.symbols.withoutLambda();
+	      if (!symbols.empty()) {
+		edges[c][it->second.target] |= symbols;
+	      }
 	    }
 	  }
-	  ++it;
 	}
       }
-    }
-
-    // delete duplicates in deltaNew
-
-    std::vector<std::pair<std::pair<state, symbol>, state> > 
-      tmp(std::begin(deltaNew), std::end(deltaNew));
-    
-    std::sort(std::begin(tmp), std::end(tmp));
-
-    deltaNew.clear();
-
-    auto prev = std::begin(tmp);
-    auto curr = std::begin(tmp);
-    if (tmp.size() > 0) {
-      std::advance(curr, 1);
-    }
-    
-    while (curr != std::end(tmp)) {
-      if (prev->first.first == curr->first.first &&
-    	  prev->first.second == curr->first.second &&
-    	  prev->second == curr->second) {
-	++curr;
-      } else {
-	deltaNew.insert(*prev);
-	prev = curr;
-	++curr;
+      for (auto &x : edges[c]) {
+	deltaNew.insert({s, nfa_edge{x.second, x.first}});
+      }
+      if (accepts[c] != 0) {
+	A[s] = accepts[c];
       }
-    }
-    if (tmp.size() > 0) {
-      deltaNew.insert(*prev);
     }
 
     delta = std::move(deltaNew);
 
-    // compute new accept states. I.e. everywhere a state can reach an accept state
-    // using only lambda transitions.
-
-    acceptType a = 0;
-    for (auto x : lambdaClosures[q0]) {
-      auto y = A.find(x);
-      if (y != std::end(A)) {
-	a = std::max(a, y->second);      
-      }
-    }
-    if (a != 0) {
-      A[q0] = a;
-    }
-
   }
-    
-  DFA NFA::determinize() {
 
-    // First find all reachable accepting states from starting state
-    // by lambda transitions.
+  LambdaClosures::LambdaClosures(const NFA &n) :
+    words((n.getNumberOfStates() + 63) / 64), numberOfComponents(0),
+    component(n.getNumberOfStates()) {
 
-    std::unordered_set<state> q0LambdaClosure = ::getLambdaClosureForState(q0, this->delta, numberOfStates);
-    acceptType a = 0;
-    for (auto x : q0LambdaClosure) {
-      auto y = A.find(x);
-      if (y != std::end(A)) {
-	a = std::max(a, y->second);
-      }
+    size_t numberOfStates = n.getNumberOfStates();
+    std::vector<std::vector<state> > successors(numberOfStates);
+    for (auto &x : n.getDelta()) {
+      if (x.second.symbols.hasLambda()) successors[x.first].push_back(x.second.target);
     }
 
-    this->lambdaElimination();
-
-    // fixed point computation for new transition function: (we do it by bfs)
-    //   add q0 as a state, and for each symbol add the set it can reach using that symbol
-    //   as a state.
-    //   Do passes through transition function adding new sets until the function
-    //   is a fixed point.
-
-    std::unordered_set<symbol> alphabet = lexer::getAlphabet(*this);
-
-    std::map<std::pair<std::set<state>, symbol>, std::set<state> > tempNewDelta;
-
-    {
-      std::queue<std::set<state> > Q;
-      Q.push(std::set<state>());
-      Q.front().insert(q0);
-    
-      while (!Q.empty()) {
-	std::set<state> e = Q.front();
-	for (auto c : alphabet) {
-	  std::set<state> targetSet;
-	  for (auto x : e) {
-	    auto iterPair = delta.equal_range(std::make_pair(x, c));
-	    for (; iterPair.first != iterPair.second; ++iterPair.first) {
-	      targetSet.insert(iterPair.first->second);
-	    }
+    // Tarjan's algorithm without recursion. It finishes a component after
+    // all components reachable from it, so their closures are known.
+    const state unvisited = std::numeric_limits<state>::max();
+    std::vector<state> index(numberOfStates, unvisited), low(numberOfStates);
+    std::vector<bool> onStack(numberOfStates, false);
+    std::vector<state> stack;
+    std::vector<std::pair<state, size_t> > calls;
+    state counter = 0;
+
+    for (state root = 0; root < numberOfStates; ++root) {
+      if (index[root] != unvisited) continue;
+      calls.push_back({root, 0});
+      while (!calls.empty()) {
+	state v = calls.back().first;
+	size_t &next = calls.back().second;
+	if (next == 0) {
+	  index[v] = low[v] = counter++;
+	  stack.push_back(v);
+	  onStack[v] = true;
+	}
+	if (next < successors[v].size()) {
+	  state w = successors[v][next++];
+	  if (index[w] == unvisited) {
+	    calls.push_back({w, 0});
+	  } else if (onStack[w]) {
+	    low[v] = std::min(low[v], index[w]);
 	  }
-	  if (targetSet.size()) {
-	    auto val = tempNewDelta.insert(std::make_pair(std::make_pair(e, c),
-							  targetSet));
-	    if (val.second) {
-	      Q.push(targetSet);
+	  continue;
+	}
+	calls.pop_back();
+	if (!calls.empty()) {
+	  state parent = calls.back().first;
+	  low[parent] = std::min(low[parent], low[v]);
+	}
+	if (low[v] != index[v]) continue;
+
+	state c = numberOfComponents++;
+	sets.resize(numberOfComponents * words, 0);
+	uint64_t *set = &sets[c * words];
+	std::vector<state> members;
+	state x;
+	do {
+	  x = stack.back();
+	  stack.pop_back();
+	  onStack[x] = false;
+	  component[x] = c;
+	  set[x / 64] |= uint64_t(1) << (x % 64);
+	  members.push_back(x);
+	} while (x != v);
+	for (auto m : members) {
+	  for (auto w : successors[m]) {
+	    if (component[w] == c) continue;
+	    const uint64_t *other = &sets[component[w] * words];
+	    for (size_t i = 0; i < words; ++i) {
+	      set[i] |= other[i];
 	    }
 	  }
 	}
-	Q.pop();
       }
     }
+  }
+
+  DFA NFA::determinize() {
+
+    // NFAs without λ edges, e.g. Glushkov automata, go straight to the
+    // subset construction.
+    bool hasLambdaEdges = std::any_of(std::begin(delta), std::end(delta),
+				      [](const std::pair<const state, nfa_edge> &x) {
+					return x.second.symbols.hasLambda();
+				      });
+    if (hasLambdaEdges) {
+      this->lambdaElimination();
+    }
+
+    // Bytes that are on the same edges lead to the same sets, so the
+    // subset construction takes one byte of each class.
+    std::unordered_set<std::bitset<256> > sets;
+    for (auto &x : delta) {
+      sets.insert(x.second.symbols.bytes());
+    }
+    std::vector<size_t> classOf(256, 0);
+    size_t numberOfClasses = 1;
+    for (auto &bytes : sets) {
+      std::map<std::pair<size_t, bool>, size_t> split;
+      for (int c = 0; c < 256; ++c) {
+	classOf[c] = split.insert({{classOf[c], bytes.test(c)}, split.size()}).first->second;
+      }
+      numberOfClasses = split.size();
+    }
+    std::vector<std::vector<symbol> > members(numberOfClasses);
+    for (int c = 0; c < 256; ++c) {
+      members[classOf[c]].push_back(symbol(c));
+    }
 
-    // Rename all 'new' states to 0,1,...size-1 and build proper delta.
+    // Breadth first from {q0}, the sets are numbered as they are found.
     std::map<std::pair<state, symbol>, state> properDelta;
     std::unordered_map<state, acceptType> properAcceptTypes;
 
-    size_t bfsTime = 0;
-    std::map<std::set<state>, size_t > visitedTime;
-    visitedTime.insert(std::make_pair(std::set<state>({q0}), 0));
-    std::queue<std::pair<std::set<state>, size_t> > Q;
-    Q.push(std::make_pair(std::set<state>({q0}), bfsTime));
+    std::map<std::set<state>, state> visited;
+    std::vector<std::set<state> > Q;
+    visited.insert({{q0}, 0});
+    Q.push_back({q0});
 
-    while (!Q.empty()) {
-      std::pair<std::set<state>, size_t> &e = Q.front();
-      acceptType a = ::getAcceptType(e.first, A);
+    for (state i = 0; i < Q.size(); ++i) {
+      std::set<state> e = Q[i];
+      acceptType a = ::getAcceptType(e, A);
       if (a != 0) {
-	properAcceptTypes[visitedTime[e.first]] = a;
+	properAcceptTypes[i] = a;
       }
-      size_t prevTime = e.second;
-      for (auto c : alphabet) {
-	auto x = tempNewDelta.find(std::make_pair(e.first, c));
-	
-	if (x != std::end(tempNewDelta)) {
-	  if (visitedTime.find(x->second) == std::end(visitedTime)) {
-	    visitedTime[x->second] = ++bfsTime;
-	    Q.push(std::make_pair(x->second, bfsTime));
+
+      std::vector<std::set<state> > targets(numberOfClasses);
+      for (auto x : e) {
+	auto its = delta.equal_range(x);
+	for (auto it = its.first; it != its.second; ++it) {
+	  const auto &bytes = it->second.symbols.bytes();
+	  for (size_t k = 0; k < numberOfClasses; ++k) {
+	    if (bytes.test(members[k][0].val)) targets[k].insert(it->second.target);
 	  }
-	  properDelta[std::make_pair(visitedTime[e.first], c)] = visitedTime[x->second];
 	}
       }
-      Q.pop();
+
+      for (size_t k = 0; k < numberOfClasses; ++k) {
+	if (targets[k].empty()) continue;
+	auto x = visited.insert({targets[k], static_cast<state>(Q.size())});
+	if (x.second) {
+	  Q.push_back(targets[k]);
+	}
+	for (auto c : members[k]) {
+	  properDelta[{i, c}] = x.first->second;
+	}
+      }
     }
 
-    return DFA(visitedTime.size(), properAcceptTypes, 0, properDelta);
+    return DFA(Q.size(), properAcceptTypes, 0, properDelta);
   }
 
 
-  const std::multimap<std::pair<state, symbol>, state>&
-  NFA::getDelta() const {
+  const NFA::delta_type &NFA::getDelta() const {
     return delta;
   }
 
@@ -446,23 +479,10 @@ namespace lexer {
       }
     }
     
-    state rejectState;
-    for (state s = 0; s < numberOfStates; ++s) {
-      auto iter = delta.find({s, symbol::min() });
-      if (A.count(s)) continue;
-      while (iter->first.first == s) {
-	if (iter->second != s) break;
-	++iter;
-      }
-      if (iter->first.first == s) continue;
-      rejectState = s;
-      break;
-    }
-
-    std::map<std::pair<state, state>, std::set<symbol> > edges;
+    std::map<std::pair<state, state>, symbol_set> edges;
 
     for (auto edge : delta) {
-      edges[{edge.first.first, edge.second}].insert(edge.first.second);
+      edges[{edge.first, edge.second.target}] |= edge.second.symbols;
     }
 
     for (auto x : edges) {
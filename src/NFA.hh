@@ -8,38 +8,60 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace lexer {
 
+  // An edge on a set of symbols. It is a λ edge if λ is in the set.
+  struct nfa_edge {
+    symbol_set symbols;
+    state target;
+  };
+
   class NFA {
+  public:
+    // The edges out of each state, one per target and character class
+    // instead of one per byte.
+    typedef std::multimap<state, nfa_edge> delta_type;
+
   private:
-    std::multimap<std::pair<state, symbol>, state> delta;
+    delta_type delta;
     std::unordered_map<state, acceptType> A;
     size_t numberOfStates;
     state q0;
     void lambdaElimination();
 
   public:
-    
+
+    // One edge per symbol in delta.
     NFA(size_t numberOfStates, std::unordered_map<state, acceptType> A,
-	state q0, std::multimap<std::pair<state, symbol>, state> delta);
-	
-  
+	state q0, const std::multimap<std::pair<state, symbol>, state> &delta);
+
+    static NFA fromEdges(size_t numberOfStates, std::unordered_map<state, acceptType> A,
+			 state q0, delta_type delta);
+
     static NFA concat(const NFA &a, const NFA &b);
     static NFA addStar(const NFA &a, acceptType at);
     static NFA addPlus(const NFA &a);
     static NFA join(const NFA &a, const NFA &b);
+    // Like join, but a and b share one initial state instead of getting a
+    // new one with λ edges. Their initial states must not have incoming
+    // edges, like those of RegularExpression::getGlushkovNFA.
+    static NFA joinInitials(const NFA &a, const NFA &b);
     static NFA opt(const NFA &a);
-    static NFA simpleAccept(std::unordered_set<symbol> accSymbols, acceptType at);
+    static NFA simpleAccept(const symbol_set &accSymbols, acceptType at);
+    // Accepts every string with a suffix accepted by a, i.e. Σ*a.
+    static NFA unanchored(const NFA &a);
 
-    const std::multimap<std::pair<state, symbol>, state>&
-    getDelta() const;
+    const delta_type &getDelta() const;
 
     const size_t getNumberOfStates() const;
     const state getInitialState() const;
     const std::unordered_map<state, acceptType> &
     getAcceptStates() const;
 
+    // Builds a BitParallelNFA on every call; to check many strings build
+    // one and use it instead.
     acceptType accept(const std::string &s) const;
     
     DFA determinize();
@@ -49,6 +71,32 @@ namespace lexer {
 
 
   };
+
+  // The λ-closures of all states of an NFA, as bitsets of getWords()
+  // words. They are computed once per strongly connected component of
+  // the λ edges, sinks first, and the states of a component share one.
+  class LambdaClosures {
+
+  public:
+
+    explicit LambdaClosures(const NFA &n);
+
+    const uint64_t *of(state s) const { return &sets[component[s] * words]; }
+
+    // States in the same component have the same closure.
+    state getComponent(state s) const { return component[s]; }
+    size_t getNumberOfComponents() const { return numberOfComponents; }
+
+    size_t getWords() const { return words; }
+
+  private:
+
+    size_t words;
+    size_t numberOfComponents;
+    std::vector<state> component;
+    std::vector<uint64_t> sets;
+
+  };
   
 } // end lexer namespace
 
@@ -1,16 +1,32 @@
 #ifndef REGULAR_EXPRESSION_HH_GUARD
 #define REGULAR_EXPRESSION_HH_GUARD
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <limits>
 #include <unordered_set>
+#include <vector>
 
 #include "lexer_common.hh"
 #include "NFA.hh"
 
 namespace lexer {
 
+// Positions of the Glushkov construction, one per RegExpChars leaf: the
+// symbols each reads and the positions that may follow it.
+struct glushkov_positions {
+  std::vector<const symbol_set*> chars;
+  std::vector<std::vector<state> > follow;
+};
+
+// First and last positions of a subexpression, and whether it matches
+// the empty string.
+struct glushkov_sets {
+  std::vector<state> first, last;
+  bool nullable;
+};
+
 class RegularExpression {
 
 public:
@@ -22,7 +38,43 @@ public:
   virtual lexer::NFA getNFA(acceptType at) const {
     return lexer::NFA(1, {{0,1}}, 0, {});    
   }
-  
+
+  // Numbers the positions of the leaves and adds their follow sets.
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    return glushkov_sets{{}, {}, true};
+  }
+
+  // The position automaton: state 0 is initial and position i is state
+  // i+1, entered on the symbols of its leaf. It has no λ edges, and the
+  // initial state has no incoming edges, see NFA::joinInitials.
+  lexer::NFA getGlushkovNFA(acceptType at) const {
+    glushkov_positions p;
+    glushkov_sets s = getPositions(p);
+
+    NFA::delta_type delta;
+    auto addEdges = [&](state from, std::vector<state> to) {
+      std::sort(std::begin(to), std::end(to));
+      to.erase(std::unique(std::begin(to), std::end(to)), std::end(to));
+      for (auto q : to) {
+	symbol_set symbols = p.chars[q]->withoutLambda();
+	if (!symbols.empty()) delta.insert({from, nfa_edge{symbols, q+1}});
+      }
+    };
+    addEdges(0, s.first);
+    for (state q = 0; q < p.chars.size(); ++q) {
+      addEdges(q+1, p.follow[q]);
+    }
+
+    std::unordered_map<state, acceptType> accepts;
+    for (auto q : s.last) {
+      accepts[q+1] = at;
+    }
+    if (s.nullable) {
+      accepts[0] = at;
+    }
+    return lexer::NFA::fromEdges(p.chars.size()+1, accepts, 0, delta);
+  }
+
 };
 
 struct RegExpConcat : public RegularExpression {
@@ -50,6 +102,21 @@ struct RegExpConcat : public RegularExpression {
     return NFA::concat(l, r);
   }
 
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    glushkov_sets l = left->getPositions(p);
+    glushkov_sets r = right->getPositions(p);
+    for (auto x : l.last) {
+      p.follow[x].insert(std::end(p.follow[x]), std::begin(r.first), std::end(r.first));
+    }
+    if (l.nullable) {
+      l.first.insert(std::end(l.first), std::begin(r.first), std::end(r.first));
+    }
+    if (r.nullable) {
+      r.last.insert(std::end(r.last), std::begin(l.last), std::end(l.last));
+    }
+    return glushkov_sets{l.first, r.last, l.nullable && r.nullable};
+  }
+
 };
 
 struct RegExpPlus : public RegularExpression {
@@ -70,6 +137,14 @@ struct RegExpPlus : public RegularExpression {
     return NFA::addPlus(in);
   }
 
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    glushkov_sets in = inner->getPositions(p);
+    for (auto x : in.last) {
+      p.follow[x].insert(std::end(p.follow[x]), std::begin(in.first), std::end(in.first));
+    }
+    return in;
+  }
+
 };
 
 struct RegExpStar : public RegularExpression {
@@ -90,6 +165,15 @@ struct RegExpStar : public RegularExpression {
     return NFA::addStar(in, at);
   }
 
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    glushkov_sets in = inner->getPositions(p);
+    for (auto x : in.last) {
+      p.follow[x].insert(std::end(p.follow[x]), std::begin(in.first), std::end(in.first));
+    }
+    in.nullable = true;
+    return in;
+  }
+
 };
 
 struct RegExpOr : public RegularExpression {
@@ -116,6 +200,15 @@ struct RegExpOr : public RegularExpression {
     return NFA::join(l, r);
   }
 
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    glushkov_sets l = left->getPositions(p);
+    glushkov_sets r = right->getPositions(p);
+    l.first.insert(std::end(l.first), std::begin(r.first), std::end(r.first));
+    l.last.insert(std::end(l.last), std::begin(r.last), std::end(r.last));
+    l.nullable = l.nullable || r.nullable;
+    return l;
+  }
+
 };
 
 struct RegExpOpt : public RegularExpression {
@@ -136,24 +229,19 @@ struct RegExpOpt : public RegularExpression {
     return NFA::opt(l);
   }
 
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    glushkov_sets l = left->getPositions(p);
+    l.nullable = true;
+    return l;
+  }
+
 };
 
 struct RegExpChars : public RegularExpression {
-  std::unordered_set<symbol> chars;
+  symbol_set chars;
 
-  RegExpChars(std::unordered_set<symbol> chars, bool invert) {
-    if (invert) {
-      for (symbol x = symbol::min();
-	   x != symbol::max(); ++x) {
-	if (!chars.count(x)) this->chars.insert(x);
-      }
-      if (!chars.count(symbol::max())) {
-	this->chars.insert(symbol::max());
-      }
-    } else {
-      this->chars = std::move(chars);
-    }
-  }
+  // A negated set holds the bytes not in chars.
+  RegExpChars(symbol_set chars, bool invert) : chars(invert ? chars.complement() : chars) {}
 
   // Make a two state machine that accepts exactly one occurrence of a character in chars.
 
@@ -172,6 +260,13 @@ struct RegExpChars : public RegularExpression {
     return NFA::simpleAccept(chars, at);
   }
 
+  virtual glushkov_sets getPositions(glushkov_positions &p) const {
+    state x = p.chars.size();
+    p.chars.push_back(&chars);
+    p.follow.emplace_back();
+    return glushkov_sets{{x}, {x}, chars.hasLambda()};
+  }
+
 };
 
 } // end namespace lexer
@@ -0,0 +1,93 @@
+#include <map>
+
+#include "bit_nfa.hh"
+
+namespace lexer {
+
+  BitParallelNFA::BitParallelNFA(const NFA &n) :
+    numberOfStates(n.getNumberOfStates()), words((n.getNumberOfStates() + 63) / 64) {
+
+    LambdaClosures closures(n);
+
+    // Bytes whose edges are equal get the same class.
+    std::vector<std::vector<std::pair<state, state> > > edgesOn(256);
+    for (auto &x : n.getDelta()) {
+      const auto &bytes = x.second.symbols.bytes();
+      for (int c = 0; c < 256; ++c) {
+	if (bytes.test(c)) edgesOn[c].push_back({x.first, x.second.target});
+      }
+    }
+    std::map<std::vector<std::pair<state, state> >, uint8_t> columns;
+    for (int c = 0; c < 256; ++c) {
+      std::sort(std::begin(edgesOn[c]), std::end(edgesOn[c]));
+      auto x = columns.insert({edgesOn[c], static_cast<uint8_t>(columns.size())});
+      classOf[c] = x.first->second;
+    }
+    numberOfClasses = columns.size();
+
+    successors.assign(numberOfStates * numberOfClasses * words, 0);
+    for (auto &x : columns) {
+      for (auto &e : x.first) {
+	uint64_t *to = &successors[(e.first * numberOfClasses + x.second) * words];
+	const uint64_t *closure = closures.of(e.second);
+	for (size_t i = 0; i < words; ++i) {
+	  to[i] |= closure[i];
+	}
+      }
+    }
+
+    initial.assign(closures.of(n.getInitialState()), closures.of(n.getInitialState()) + words);
+
+    acceptOf.assign(numberOfStates, REJECT);
+    for (auto &x : n.getAcceptStates()) {
+      acceptOf[x.first] = x.second;
+    }
+  }
+
+  acceptType BitParallelNFA::accept(const std::string &s) const {
+    if (numberOfStates == 0) return REJECT;
+
+    std::vector<uint64_t> curr(initial), next(words);
+    if (words == 1) {
+      uint64_t set = curr[0];
+      for (auto c : s) {
+	size_t k = classOf[static_cast<uint8_t>(c)];
+	uint64_t n = 0;
+	for (uint64_t bits = set; bits; bits &= bits - 1) {
+	  n |= *row(__builtin_ctzll(bits), k);
+	}
+	set = n;
+	if (!set) return REJECT;
+      }
+      curr[0] = set;
+    } else {
+      for (auto c : s) {
+	size_t k = classOf[static_cast<uint8_t>(c)];
+	std::fill(std::begin(next), std::end(next), 0);
+	for (size_t w = 0; w < words; ++w) {
+	  for (uint64_t bits = curr[w]; bits; bits &= bits - 1) {
+	    const uint64_t *r = row(w * 64 + __builtin_ctzll(bits), k);
+	    for (size_t i = 0; i < words; ++i) {
+	      next[i] |= r[i];
+	    }
+	  }
+	}
+	uint64_t any = 0;
+	for (auto x : next) {
+	  any |= x;
+	}
+	if (!any) return REJECT;
+	std::swap(curr, next);
+      }
+    }
+
+    acceptType res = REJECT;
+    for (size_t w = 0; w < words; ++w) {
+      for (uint64_t bits = curr[w]; bits; bits &= bits - 1) {
+	res = std::max(res, acceptOf[w * 64 + __builtin_ctzll(bits)]);
+      }
+    }
+    return res;
+  }
+
+} // end namespace lexer
@@ -0,0 +1,54 @@
+#ifndef BIT_NFA_HH_GUARD
+#define BIT_NFA_HH_GUARD
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lexer_common.hh"
+#include "NFA.hh"
+
+namespace lexer {
+
+  // Simulates an NFA on bitsets of its states, to check rules and DFAs
+  // against their NFAs on many strings. The λ-closures are computed once
+  // and folded into the successor sets, so a step ORs one row of words
+  // per active state. Bytes with the same edges everywhere share a row.
+  // The rows take states * classes * ceil(states / 64) words, so memory
+  // grows with the square of the states.
+  class BitParallelNFA {
+
+  public:
+
+    explicit BitParallelNFA(const NFA &n);
+
+    // Largest accept type of the states reached on s, or REJECT, like
+    // NFA::accept.
+    acceptType accept(const std::string &s) const;
+
+    size_t getNumberOfStates() const { return numberOfStates; }
+
+  private:
+
+    // Rows of words bitsets, states * numberOfClasses of them.
+    const uint64_t *row(state s, size_t c) const {
+      return &successors[(s * numberOfClasses + c) * words];
+    }
+
+    size_t numberOfStates;
+    size_t words;
+
+    uint8_t classOf[256];
+    size_t numberOfClasses;
+
+    // λ-closure of the initial state.
+    std::vector<uint64_t> initial;
+    // λ-closures of the targets of the edges of a state on a class.
+    std::vector<uint64_t> successors;
+    std::vector<acceptType> acceptOf;
+
+  };
+
+} // end namespace lexer
+
+#endif // BIT_NFA_HH_GUARD
@@ -0,0 +1,531 @@
+#ifndef CONSTEXPR_LEXER_HH_GUARD
+#define CONSTEXPR_LEXER_HH_GUARD
+
+#include <stddef.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <string_view>
+
+namespace lexer {
+
+  // A lexer built by the compiler from rules in the format of parseFile,
+  // without running generate_lexer. Needs C++17.
+  //
+  //   constexpr lexer::ct::static_lexer<> lang(
+  //     "NUMBER := [0-9]+\n"
+  //     "_WHITESPACE := [ ]+\n");
+  //   auto t = lang.tokenize(str);
+  //   for (auto tkn = t.getNextToken(); tkn.tkn != lang.getEndOfFileType(); ...)
+  //
+  // The rules go through Thompson's construction, the subset construction
+  // and Moore's minimization in constant evaluation, and the tokens are
+  // the ones the emitted Tokenizer returns for the same rules. Token types
+  // are rule indices followed by getEndOfFileType() and getInvalidType(),
+  // like for Matcher. The template arguments bound the number of rules and
+  // of NFA and DFA states; exceeding them is a compile error.
+  namespace ct {
+
+    struct Token {
+      const char *start, *curr;
+      uint32_t tkn;
+    };
+
+    struct byte_set {
+      uint64_t w[4] = {0, 0, 0, 0};
+
+      constexpr void set(unsigned c) { w[c >> 6] |= uint64_t(1) << (c & 63); }
+      constexpr void clear(unsigned c) { w[c >> 6] &= ~(uint64_t(1) << (c & 63)); }
+      constexpr bool test(unsigned c) const { return (w[c >> 6] >> (c & 63)) & 1; }
+      constexpr void invert() {
+	for (auto &x : w) x = ~x;
+      }
+    };
+
+    template<size_t N>
+    struct state_set {
+      uint64_t w[(N + 63) / 64] = {};
+
+      constexpr void set(size_t s) { w[s >> 6] |= uint64_t(1) << (s & 63); }
+      constexpr bool test(size_t s) const { return (w[s >> 6] >> (s & 63)) & 1; }
+      constexpr bool empty() const {
+	for (auto x : w) {
+	  if (x) return false;
+	}
+	return true;
+      }
+      constexpr bool operator==(const state_set &o) const {
+	for (size_t i = 0; i < (N + 63) / 64; ++i) {
+	  if (w[i] != o.w[i]) return false;
+	}
+	return true;
+      }
+    };
+
+    // Thompson NFA: a state has at most two λ edges and at most one edge
+    // on a set of bytes.
+    template<size_t N>
+    struct thompson_nfa {
+      size_t size = 0;
+      uint16_t lambda[N][2] = {};
+      uint8_t lambdaCount[N] = {};
+      byte_set on[N] = {};
+      uint16_t onTarget[N] = {};
+      bool hasOn[N] = {};
+      // Rule index + 1 of the rule the state accepts, 0 if none.
+      uint32_t accept[N] = {};
+
+      constexpr uint16_t add() {
+	if (size == N) throw std::length_error("lexer::ct: too many NFA states");
+	return static_cast<uint16_t>(size++);
+      }
+      constexpr void addLambda(uint16_t from, uint16_t to) {
+	lambda[from][lambdaCount[from]++] = to;
+      }
+    };
+
+    struct fragment {
+      uint16_t start, end;
+    };
+
+    // Recursive descent over one regular expression with the grammar and
+    // quirks of Parser in parser.cc, building the NFA as it goes.
+    template<size_t N>
+    struct regexp_parser {
+      thompson_nfa<N> &nfa;
+      std::string_view re;
+      size_t pos;
+
+      constexpr char at(size_t i) const { return i < re.size() ? re[i] : '\0'; }
+
+      constexpr fragment chars(byte_set set) {
+	// The emitted lexers never take an edge on the terminating 0.
+	set.clear(0);
+	uint16_t s = nfa.add();
+	uint16_t t = nfa.add();
+	nfa.on[s] = set;
+	nfa.onTarget[s] = t;
+	nfa.hasOn[s] = true;
+	return fragment{s, t};
+      }
+
+      constexpr fragment single(char c) {
+	byte_set set;
+	set.set(static_cast<uint8_t>(c));
+	return chars(set);
+      }
+
+      constexpr fragment parseOr() {
+	fragment left = parseConcat();
+	if (at(pos) == '|') {
+	  ++pos;
+	  fragment right = parseOr();
+	  uint16_t s = nfa.add();
+	  uint16_t t = nfa.add();
+	  nfa.addLambda(s, left.start);
+	  nfa.addLambda(s, right.start);
+	  nfa.addLambda(left.end, t);
+	  nfa.addLambda(right.end, t);
+	  return fragment{s, t};
+	}
+	return left;
+      }
+
+      constexpr fragment parseConcat() {
+	fragment left = parseOpt();
+	if (pos < re.size() && at(pos) != '|' && at(pos) != ')') {
+	  fragment right = parseConcat();
+	  nfa.addLambda(left.end, right.start);
+	  return fragment{left.start, right.end};
+	}
+	return left;
+      }
+
+      constexpr fragment parseOpt() {
+	fragment left = parseStarPlus();
+	if (at(pos) == '?') {
+	  ++pos;
+	  uint16_t s = nfa.add();
+	  uint16_t t = nfa.add();
+	  nfa.addLambda(s, left.start);
+	  nfa.addLambda(s, t);
+	  nfa.addLambda(left.end, t);
+	  return fragment{s, t};
+	}
+	return left;
+      }
+
+      constexpr fragment parseStarPlus() {
+	fragment left = parseInner();
+	if (at(pos) == '*') {
+	  ++pos;
+	  uint16_t s = nfa.add();
+	  uint16_t t = nfa.add();
+	  nfa.addLambda(s, left.start);
+	  nfa.addLambda(s, t);
+	  nfa.addLambda(left.end, left.start);
+	  nfa.addLambda(left.end, t);
+	  return fragment{s, t};
+	} else if (at(pos) == '+') {
+	  ++pos;
+	  uint16_t t = nfa.add();
+	  nfa.addLambda(left.end, left.start);
+	  nfa.addLambda(left.end, t);
+	  return fragment{left.start, t};
+	}
+	return left;
+      }
+
+      constexpr fragment parseInner() {
+	if (at(pos) == '\\' && pos+1 < re.size()) {
+	  ++pos;
+	  return single(at(pos++));
+	}
+	if (at(pos) == '.') {
+	  ++pos;
+	  byte_set all;
+	  all.invert();
+	  return chars(all);
+	}
+	if (at(pos) == '[') {
+	  ++pos;
+	  bool negate = false;
+	  if (pos < re.size() && at(pos) == '^') {
+	    negate = true;
+	    ++pos;
+	  }
+	  byte_set set;
+	  while (at(pos) != ']') {
+	    switch (at(pos)) {
+	    case '\\':
+	      ++pos;
+	      switch (at(pos)) {
+	      case '\0':
+		throw std::runtime_error("Parser error: unexpected null termination");
+	      case 'n':
+		set.set('\n');
+		break;
+	      case 'r':
+		set.set('\r');
+		break;
+	      case 't':
+		set.set('\t');
+		break;
+	      default:
+		set.set(static_cast<uint8_t>(at(pos)));
+	      }
+	      ++pos;
+	      break;
+	    case '-': {
+	      // Like parser.cc: the range is from the byte in front of '-'.
+	      char l = pos ? at(pos-1) : '\0';
+	      char r = at(pos+1);
+	      if (r == '\\') r = at(pos+2);
+	      if (l > r) {
+		throw std::runtime_error("Parser error: Range-error left greater than right");
+	      }
+	      set.set(static_cast<uint8_t>(r));
+	      while (l != r) {
+		set.set(static_cast<uint8_t>(l++));
+	      }
+	      ++pos;
+	      break;
+	    }
+	    case '\0':
+	      throw std::runtime_error("Parser error: unexpected null termination");
+	    default:
+	      set.set(static_cast<uint8_t>(at(pos++)));
+	      break;
+	    }
+	  }
+	  ++pos;
+	  if (negate) set.invert();
+	  return chars(set);
+	}
+	if (at(pos) == '(') {
+	  ++pos;
+	  fragment center = parseOr();
+	  if (at(pos) != ')') {
+	    throw std::runtime_error("Parser error: expected right parenthesis");
+	  }
+	  ++pos;
+	  return center;
+	}
+	char c = at(pos);
+	if (c == '+' || c == '*' || c == ')' || c == ']' || c == '\\') {
+	  throw std::runtime_error("Parser error: unexpected symbol");
+	}
+	++pos;
+	return single(c);
+      }
+    };
+
+    template<size_t MaxRules = 32, size_t MaxNFAStates = 512, size_t MaxDFAStates = 128>
+    class static_lexer {
+
+    public:
+
+      // Keeps the position in one 0 terminated input.
+      class Tokenizer {
+      public:
+	constexpr Tokenizer(const static_lexer &l, const char *str) : l(&l), str(str) {}
+	constexpr Token getNextToken() { return l->getNextToken(str); }
+      private:
+	const static_lexer *l;
+	const char *str;
+      };
+
+      // rules is one rule per line, e.g. a string literal; the rule names
+      // point into it.
+      constexpr explicit static_lexer(std::string_view rules) {
+	thompson_nfa<MaxNFAStates> nfa;
+	uint16_t ruleStart[MaxRules] = {};
+
+	size_t lineBegin = 0;
+	while (lineBegin < rules.size()) {
+	  size_t lineEnd = lineBegin;
+	  while (lineEnd < rules.size() && rules[lineEnd] != '\n') ++lineEnd;
+	  if (lineEnd > lineBegin) {
+	    if (numberOfRules == MaxRules) throw std::length_error("lexer::ct: too many rules");
+	    uint16_t start = addRule(nfa, rules.substr(lineBegin, lineEnd - lineBegin));
+	    ruleStart[numberOfRules - 1] = start;
+	  }
+	  lineBegin = lineEnd + 1;
+	}
+
+	// Bytes that are in exactly the same edge sets share a class, and
+	// the subset construction only looks at one byte per class.
+	uint8_t classOf[256] = {};
+	size_t numberOfClasses = 1;
+	for (size_t s = 0; s < nfa.size; ++s) {
+	  if (!nfa.hasOn[s]) continue;
+	  bool in[256] = {}, out[256] = {};
+	  for (unsigned c = 0; c < 256; ++c) {
+	    (nfa.on[s].test(c) ? in : out)[classOf[c]] = true;
+	  }
+	  int split[256] = {};
+	  for (size_t k = 0; k < numberOfClasses; ++k) {
+	    split[k] = (in[k] && out[k]) ? static_cast<int>(numberOfClasses++) : -1;
+	  }
+	  for (unsigned c = 0; c < 256; ++c) {
+	    if (nfa.on[s].test(c) && split[classOf[c]] >= 0) {
+	      classOf[c] = static_cast<uint8_t>(split[classOf[c]]);
+	    }
+	  }
+	}
+	uint8_t representative[256] = {};
+	for (unsigned c = 256; c-- > 0; ) {
+	  representative[classOf[c]] = static_cast<uint8_t>(c);
+	}
+
+	// Subset construction. The empty set is the dead state, kept as the
+	// last row once the number of sets is known.
+	state_set<MaxNFAStates> sets[MaxDFAStates] = {};
+	uint16_t next[MaxDFAStates][256] = {};
+	uint32_t setAccept[MaxDFAStates] = {};
+	const uint16_t deadMark = 0xffff;
+	size_t numberOfSets = 1;
+	for (size_t r = 0; r < numberOfRules; ++r) {
+	  sets[0].set(ruleStart[r]);
+	}
+	closure(nfa, sets[0]);
+	for (size_t i = 0; i < numberOfSets; ++i) {
+	  for (size_t s = 0; s < nfa.size; ++s) {
+	    if (sets[i].test(s) && nfa.accept[s] > setAccept[i]) setAccept[i] = nfa.accept[s];
+	  }
+	  for (size_t k = 0; k < numberOfClasses; ++k) {
+	    state_set<MaxNFAStates> target;
+	    for (size_t s = 0; s < nfa.size; ++s) {
+	      if (sets[i].test(s) && nfa.hasOn[s] && nfa.on[s].test(representative[k])) {
+		target.set(nfa.onTarget[s]);
+	      }
+	    }
+	    if (target.empty()) {
+	      next[i][k] = deadMark;
+	      continue;
+	    }
+	    closure(nfa, target);
+	    size_t j = 0;
+	    while (j < numberOfSets && !(sets[j] == target)) ++j;
+	    if (j == numberOfSets) {
+	      if (numberOfSets + 1 == MaxDFAStates) throw std::length_error("lexer::ct: too many DFA states");
+	      sets[numberOfSets++] = target;
+	    }
+	    next[i][k] = static_cast<uint16_t>(j);
+	  }
+	}
+	size_t deadSet = numberOfSets;
+	size_t total = numberOfSets + 1;
+	for (size_t i = 0; i < numberOfSets; ++i) {
+	  for (size_t k = 0; k < numberOfClasses; ++k) {
+	    if (next[i][k] == deadMark) next[i][k] = static_cast<uint16_t>(deadSet);
+	  }
+	}
+	for (size_t k = 0; k < numberOfClasses; ++k) {
+	  next[deadSet][k] = static_cast<uint16_t>(deadSet);
+	}
+
+	// Moore's algorithm: start from the accept types and split blocks
+	// whose states go to different blocks on some class.
+	uint16_t block[MaxDFAStates] = {};
+	size_t numberOfBlocks = 0;
+	{
+	  uint32_t blockAccept[MaxDFAStates] = {};
+	  for (size_t i = 0; i < total; ++i) {
+	    size_t b = 0;
+	    while (b < numberOfBlocks && blockAccept[b] != setAccept[i]) ++b;
+	    if (b == numberOfBlocks) blockAccept[numberOfBlocks++] = setAccept[i];
+	    block[i] = static_cast<uint16_t>(b);
+	  }
+	}
+	uint16_t first[MaxDFAStates] = {};
+	for (;;) {
+	  uint16_t refined[MaxDFAStates] = {};
+	  size_t refinedBlocks = 0;
+	  for (size_t i = 0; i < total; ++i) {
+	    size_t b = 0;
+	    for (; b < refinedBlocks; ++b) {
+	      size_t r = first[b];
+	      if (block[r] != block[i]) continue;
+	      bool same = true;
+	      for (size_t k = 0; k < numberOfClasses && same; ++k) {
+		same = block[next[r][k]] == block[next[i][k]];
+	      }
+	      if (same) break;
+	    }
+	    if (b == refinedBlocks) first[refinedBlocks++] = static_cast<uint16_t>(i);
+	    refined[i] = static_cast<uint16_t>(b);
+	  }
+	  for (size_t i = 0; i < total; ++i) {
+	    block[i] = refined[i];
+	  }
+	  if (refinedBlocks == numberOfBlocks) break;
+	  numberOfBlocks = refinedBlocks;
+	}
+
+	numberOfStates = numberOfBlocks;
+	initialState = block[0];
+	dead = block[deadSet];
+	for (size_t b = 0; b < numberOfBlocks; ++b) {
+	  accept[b] = setAccept[first[b]];
+	  for (unsigned c = 0; c < 256; ++c) {
+	    delta[b][c] = block[next[first[b]][classOf[c]]];
+	  }
+	}
+      }
+
+      // Returns the token at str, which must be 0 terminated, and moves str
+      // past it.
+      constexpr Token getNextToken(const char *&str) const {
+	for (;;) {
+	  const char *start = str;
+	  const char *curr = str;
+	  if (*curr == 0) {
+	    return Token{curr, curr, getEndOfFileType()};
+	  }
+	  uint16_t s = initialState;
+	  for (;;) {
+	    uint16_t n = delta[s][static_cast<uint8_t>(*curr)];
+	    if (n == dead) break;
+	    s = n;
+	    ++curr;
+	  }
+	  str = curr;
+	  // Stops in the initial state are handled as in Matcher.
+	  if (s == initialState && *curr == 0) {
+	    return Token{start, curr, getEndOfFileType()};
+	  }
+	  if (accept[s] == 0) {
+	    if (s == initialState) str = ++curr;
+	    return Token{start, curr, getInvalidType()};
+	  }
+	  if (!ignored[accept[s] - 1]) {
+	    return Token{start, curr, accept[s] - 1};
+	  }
+	}
+      }
+
+      constexpr Tokenizer tokenize(const char *str) const { return Tokenizer(*this, str); }
+
+      constexpr uint32_t getEndOfFileType() const { return static_cast<uint32_t>(numberOfRules); }
+      constexpr uint32_t getInvalidType() const { return static_cast<uint32_t>(numberOfRules + 1); }
+
+      // Token type of the rule called name, or getInvalidType().
+      constexpr uint32_t getType(std::string_view name) const {
+	for (size_t i = 0; i < numberOfRules; ++i) {
+	  if (names[i] == name) return static_cast<uint32_t>(i);
+	}
+	return getInvalidType();
+      }
+
+      // Rule name of a token type, or END_OF_FILE or INVALID.
+      constexpr std::string_view getName(uint32_t type) const {
+	if (type < numberOfRules) return names[type];
+	if (type == getEndOfFileType()) return "END_OF_FILE";
+	return "INVALID";
+      }
+
+      constexpr size_t getNumberOfStates() const { return numberOfStates; }
+
+    private:
+
+      // Parses "NAME := regexp" into the NFA and returns its start state.
+      constexpr uint16_t addRule(thompson_nfa<MaxNFAStates> &nfa, std::string_view line) {
+	size_t assign = line.find(":=");
+	if (assign == std::string_view::npos) {
+	  throw std::runtime_error("Parser error: expected ':='");
+	}
+	std::string_view name = line.substr(0, assign);
+	while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+	while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+	if (name.empty() || name.find_first_of(" {") != std::string_view::npos) {
+	  throw std::runtime_error("Parser error: bad rule name, actions are not supported");
+	}
+	size_t pos = assign + 2;
+	while (pos < line.size() && line[pos] == ' ') ++pos;
+
+	regexp_parser<MaxNFAStates> p{nfa, line.substr(pos), 0};
+	fragment f = p.parseOr();
+	nfa.accept[f.end] = static_cast<uint32_t>(numberOfRules + 1);
+	names[numberOfRules] = name;
+	ignored[numberOfRules] = name[0] == '_';
+	++numberOfRules;
+	return f.start;
+      }
+
+      static constexpr void closure(const thompson_nfa<MaxNFAStates> &nfa, state_set<MaxNFAStates> &set) {
+	uint16_t stack[MaxNFAStates] = {};
+	size_t top = 0;
+	for (size_t s = 0; s < nfa.size; ++s) {
+	  if (set.test(s)) stack[top++] = static_cast<uint16_t>(s);
+	}
+	while (top) {
+	  uint16_t s = stack[--top];
+	  for (size_t e = 0; e < nfa.lambdaCount[s]; ++e) {
+	    uint16_t t = nfa.lambda[s][e];
+	    if (!set.test(t)) {
+	      set.set(t);
+	      stack[top++] = t;
+	    }
+	  }
+	}
+      }
+
+      std::string_view names[MaxRules] = {};
+      bool ignored[MaxRules] = {};
+      size_t numberOfRules = 0;
+
+      size_t numberOfStates = 0;
+      uint16_t initialState = 0;
+      uint16_t dead = 0;
+      // delta[s][c] is the next state or dead.
+      uint16_t delta[MaxDFAStates][256] = {};
+      // Rule index + 1 of the rule a state accepts, 0 if none.
+      uint32_t accept[MaxDFAStates] = {};
+
+    };
+
+  } // end namespace ct
+
+} // end namespace lexer
+
+#endif // CONSTEXPR_LEXER_HH_GUARD
@@ -0,0 +1,338 @@
+#include <bitset>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "derivatives.hh"
+#include "RegularExpression.hh"
+
+namespace {
+
+  using lexer::state; using lexer::symbol; using lexer::acceptType;
+
+  typedef uint32_t term;
+  typedef std::bitset<256> byte_set;
+
+  enum class term_kind : uint8_t { EMPTY, EPSILON, CHARS, CONCAT, STAR, OR };
+
+  struct term_node {
+    term_kind kind;
+    bool nullable;
+    term left, right;        // CHARS: set index; CONCAT: both; STAR: left
+    std::vector<term> alts;  // OR: sorted and distinct, at least two
+
+    bool operator==(const term_node &o) const {
+      return kind == o.kind && left == o.left && right == o.right && alts == o.alts;
+    }
+  };
+
+  struct term_node_hash {
+    size_t operator()(const term_node &n) const {
+      size_t h = static_cast<size_t>(n.kind);
+      h = h * 1000003 ^ n.left;
+      h = h * 1000003 ^ n.right;
+      for (auto x : n.alts) {
+	h = h * 1000003 ^ x;
+      }
+      return h;
+    }
+  };
+
+  // Hash-consed terms. The constructors normalize what they build, so
+  // terms that are equal up to associativity, commutativity and
+  // idempotence of |, and the identities of ∅, ε and *, are the same
+  // term, which is what makes the derivatives finitely many.
+  class term_table {
+
+  public:
+
+    term_table() {
+      empty = intern(term_node{term_kind::EMPTY, false, 0, 0, {}});
+      epsilon = intern(term_node{term_kind::EPSILON, true, 0, 0, {}});
+    }
+
+    term empty, epsilon;
+
+    bool nullable(term t) const { return nodes[t].nullable; }
+
+    const std::vector<byte_set> &getSets() const { return sets; }
+
+    term chars(const byte_set &s) {
+      if (s.none()) return empty;
+      auto x = setIndex.insert({s, static_cast<term>(sets.size())});
+      if (x.second) sets.push_back(s);
+      return intern(term_node{term_kind::CHARS, false, x.first->second, 0, {}});
+    }
+
+    term concat(term l, term r) {
+      if (l == empty || r == empty) return empty;
+      if (l == epsilon) return r;
+      if (r == epsilon) return l;
+      // (ab)c = a(bc)
+      if (nodes[l].kind == term_kind::CONCAT) {
+	term a = nodes[l].left, b = nodes[l].right;
+	return concat(a, concat(b, r));
+      }
+      return intern(term_node{term_kind::CONCAT, nodes[l].nullable && nodes[r].nullable, l, r, {}});
+    }
+
+    term star(term t) {
+      if (t == empty || t == epsilon) return epsilon;
+      if (nodes[t].kind == term_kind::STAR) return t;
+      // (ε|a)* = a*
+      if (nodes[t].kind == term_kind::OR && nodes[t].alts[0] == epsilon) {
+	std::vector<term> rest(std::begin(nodes[t].alts) + 1, std::end(nodes[t].alts));
+	return star(alt(rest));
+      }
+      return intern(term_node{term_kind::STAR, true, t, 0, {}});
+    }
+
+    term alt(const std::vector<term> &ts) {
+      std::vector<term> alts;
+      byte_set merged;
+      bool hasChars = false;
+      for (auto t : ts) {
+	const term_node &n = nodes[t];
+	if (n.kind == term_kind::OR) {
+	  for (auto x : n.alts) {
+	    if (nodes[x].kind == term_kind::CHARS) {
+	      merged |= sets[nodes[x].left];
+	      hasChars = true;
+	    } else {
+	      alts.push_back(x);
+	    }
+	  }
+	} else if (n.kind == term_kind::CHARS) {
+	  merged |= sets[n.left];
+	  hasChars = true;
+	} else if (t != empty) {
+	  alts.push_back(t);
+	}
+      }
+      if (hasChars) alts.push_back(chars(merged));
+      std::sort(std::begin(alts), std::end(alts));
+      alts.erase(std::unique(std::begin(alts), std::end(alts)), std::end(alts));
+      if (alts.empty()) return empty;
+      if (alts.size() == 1) return alts[0];
+      bool nullable = false;
+      for (auto x : alts) {
+	nullable = nullable || nodes[x].nullable;
+      }
+      return intern(term_node{term_kind::OR, nullable, 0, 0, std::move(alts)});
+    }
+
+    // The strings w such that cw is in t.
+    term derivative(term t, uint8_t c) {
+      auto cached = derivatives.find((uint64_t(t) << 8) | c);
+      if (cached != std::end(derivatives)) return cached->second;
+
+      term_node n = nodes[t];
+      term res = empty;
+      switch (n.kind) {
+      case term_kind::EMPTY:
+      case term_kind::EPSILON:
+	break;
+      case term_kind::CHARS:
+	res = sets[n.left].test(c) ? epsilon : empty;
+	break;
+      case term_kind::CONCAT:
+	res = concat(derivative(n.left, c), n.right);
+	if (nodes[n.left].nullable) {
+	  res = alt({res, derivative(n.right, c)});
+	}
+	break;
+      case term_kind::STAR:
+	res = concat(derivative(n.left, c), t);
+	break;
+      case term_kind::OR: {
+	std::vector<term> ds;
+	for (auto x : n.alts) {
+	  ds.push_back(derivative(x, c));
+	}
+	res = alt(ds);
+	break;
+      }
+      }
+      derivatives[(uint64_t(t) << 8) | c] = res;
+      return res;
+    }
+
+  private:
+
+    term intern(term_node n) {
+      auto x = index.insert({n, static_cast<term>(nodes.size())});
+      if (x.second) nodes.push_back(std::move(n));
+      return x.first->second;
+    }
+
+    std::vector<term_node> nodes;
+    std::unordered_map<term_node, term, term_node_hash> index;
+    std::vector<byte_set> sets;
+    std::unordered_map<byte_set, term> setIndex;
+    std::unordered_map<uint64_t, term> derivatives;
+
+  };
+
+  term fromRegExp(term_table &t, const lexer::RegularExpression *r) {
+    if (auto x = dynamic_cast<const lexer::RegExpChars*>(r)) {
+      term chars = t.chars(x->chars.bytes());
+      return x->chars.hasLambda() ? t.alt({t.epsilon, chars}) : chars;
+    }
+    if (auto x = dynamic_cast<const lexer::RegExpConcat*>(r)) {
+      term l = fromRegExp(t, x->left.get());
+      return t.concat(l, fromRegExp(t, x->right.get()));
+    }
+    if (auto x = dynamic_cast<const lexer::RegExpOr*>(r)) {
+      term l = fromRegExp(t, x->left.get());
+      return t.alt({l, fromRegExp(t, x->right.get())});
+    }
+    if (auto x = dynamic_cast<const lexer::RegExpStar*>(r)) {
+      return t.star(fromRegExp(t, x->inner.get()));
+    }
+    if (auto x = dynamic_cast<const lexer::RegExpPlus*>(r)) {
+      term in = fromRegExp(t, x->inner.get());
+      return t.concat(in, t.star(in));
+    }
+    if (auto x = dynamic_cast<const lexer::RegExpOpt*>(r)) {
+      return t.alt({t.epsilon, fromRegExp(t, x->left.get())});
+    }
+    throw std::runtime_error("Unknown regular expression node");
+  }
+
+} // end unnamed namespace
+
+namespace lexer {
+
+  DFA buildDerivativeDFA(const std::vector<tkn_rule> &tkn_rules) {
+    term_table t;
+    std::vector<term> initial;
+    for (auto &r : tkn_rules) {
+      initial.push_back(fromRegExp(t, r.regexp.get()));
+    }
+
+    // Bytes in the same sets have the same derivatives. Derivatives only
+    // make unions of the sets of the rules, so these classes stay valid.
+    std::vector<size_t> classOf(256, 0);
+    size_t numberOfClasses = 1;
+    for (auto &s : t.getSets()) {
+      std::map<std::pair<size_t, bool>, size_t> split;
+      for (int c = 0; c < 256; ++c) {
+	auto x = split.insert({{classOf[c], s.test(c)}, split.size()});
+	classOf[c] = x.first->second;
+      }
+      numberOfClasses = split.size();
+    }
+    std::vector<std::vector<uint8_t> > members(numberOfClasses);
+    for (int c = 0; c < 256; ++c) {
+      members[classOf[c]].push_back(c);
+    }
+
+    std::map<std::vector<term>, state> states;
+    std::vector<std::vector<term> > queue;
+    std::vector<acceptType> acceptOf;
+    // Successors on each class, or dead where all derivatives are ∅.
+    const state dead = std::numeric_limits<state>::max();
+    std::vector<state> next;
+
+    auto addState = [&](const std::vector<term> &terms) {
+      auto x = states.insert({terms, static_cast<state>(queue.size())});
+      if (x.second) {
+	acceptType a = REJECT;
+	for (size_t i = 0; i < terms.size(); ++i) {
+	  if (t.nullable(terms[i])) a = i+1;
+	}
+	acceptOf.push_back(a);
+	queue.push_back(terms);
+      }
+      return x.first->second;
+    };
+
+    addState(initial);
+    for (state s = 0; s < queue.size(); ++s) {
+      for (auto &cls : members) {
+	std::vector<term> terms;
+	bool isDead = true;
+	for (auto x : queue[s]) {
+	  terms.push_back(t.derivative(x, cls[0]));
+	  isDead = isDead && terms.back() == t.empty;
+	}
+	next.push_back(isDead ? dead : addState(terms));
+      }
+    }
+    size_t numberOfStates = queue.size();
+
+    // Terms other than ∅ match some string, so every state is live, but
+    // different terms can still be the same language. Moore's refinement
+    // over the classes merges those, with the dead state left out.
+    std::vector<size_t> block(numberOfStates);
+    size_t numberOfBlocks;
+    {
+      std::map<acceptType, size_t> types;
+      for (state s = 0; s < numberOfStates; ++s) {
+	block[s] = types.insert({acceptOf[s], types.size()}).first->second;
+      }
+      numberOfBlocks = types.size();
+    }
+    for (;;) {
+      std::map<std::vector<size_t>, size_t> signatures;
+      std::vector<size_t> refined(numberOfStates);
+      for (state s = 0; s < numberOfStates; ++s) {
+	std::vector<size_t> signature(1, block[s]);
+	for (size_t k = 0; k < numberOfClasses; ++k) {
+	  state x = next[s * numberOfClasses + k];
+	  signature.push_back(x == dead ? numberOfBlocks : block[x]);
+	}
+	refined[s] = signatures.insert({signature, signatures.size()}).first->second;
+      }
+      if (signatures.size() == numberOfBlocks) break;
+      numberOfBlocks = signatures.size();
+      block = std::move(refined);
+    }
+
+    // Lay it out like DFA::minimize does: the initial state is 0, and the
+    // bytes with any edge have one from every state, to a crash state if
+    // they lead nowhere.
+    std::vector<state> newState(numberOfBlocks, dead);
+    std::vector<state> representative;
+    for (state s = 0; s < numberOfStates; ++s) {
+      if (newState[block[s]] == dead) {
+	newState[block[s]] = representative.size();
+	representative.push_back(s);
+      }
+    }
+    std::vector<bool> used(numberOfClasses, false);
+    for (size_t i = 0; i < next.size(); ++i) {
+      if (next[i] != dead) used[i % numberOfClasses] = true;
+    }
+    state crash = representative.size();
+    bool crashReached = false;
+
+    std::unordered_map<state, acceptType> accepts;
+    DFA::delta_type delta;
+    for (state b = 0; b < representative.size(); ++b) {
+      state s = representative[b];
+      if (acceptOf[s] != REJECT) accepts[b] = acceptOf[s];
+      for (size_t k = 0; k < numberOfClasses; ++k) {
+	if (!used[k]) continue;
+	state x = next[s * numberOfClasses + k];
+	state target = x == dead ? crash : newState[block[x]];
+	crashReached = crashReached || x == dead;
+	for (auto c : members[k]) {
+	  delta[{b, symbol(c)}] = target;
+	}
+      }
+    }
+    if (crashReached) {
+      for (size_t k = 0; k < numberOfClasses; ++k) {
+	if (!used[k]) continue;
+	for (auto c : members[k]) {
+	  delta[{crash, symbol(c)}] = crash;
+	}
+      }
+    }
+
+    return DFA(representative.size() + crashReached, std::move(accepts), 0, std::move(delta));
+  }
+
+} // end namespace lexer
@@ -0,0 +1,23 @@
+#ifndef DERIVATIVES_HH_GUARD
+#define DERIVATIVES_HH_GUARD
+
+#include <vector>
+
+#include "DFA.hh"
+#include "parser.hh"
+
+namespace lexer {
+
+  // Builds the minimized DFA of the rules straight from their regular
+  // expressions with Brzozowski derivatives, without an NFA. A state is
+  // the tuple of the derivatives of all rules by the input read so far,
+  // and it accepts with the type of the last rule that matches the empty
+  // string, like the subset construction. The derivatives are normalized
+  // and hash-consed, so equal ones are the same state, and are taken once
+  // per class of bytes that no rule tells apart. Accept types are rule
+  // index + 1, and the DFA has the form DFA::minimize gives.
+  DFA buildDerivativeDFA(const std::vector<tkn_rule> &tkn_rules);
+
+} // end namespace lexer
+
+#endif // DERIVATIVES_HH_GUARD
@@ -2,6 +2,7 @@
 #include "DFA.hh"
 #include "parser.hh"
 
+#include <algorithm>
 #include <cctype>
 #include <fstream>
 #include <iostream>
@@ -14,38 +15,120 @@ using namespace lexer;
 
 const std::string indent = "    ";
 
-void lexer::cpp_emitter::emit_dfa(
-  const DFA & d, 
-  std::vector<tkn_rule> &tkn_rules,
-  const std::string &outputDirectory) {
+namespace {
 
-  std::string hhFilename = outputDirectory + "tokenizer.hh";
-  std::string ccFilename = outputDirectory + "tokenizer.cc";
+  // With a profile, the hottest states that together account for this
+  // share of all state visits are candidates for specialization...
+  const double hotVisitShare = 0.9;
 
-  std::ofstream hhFile(hhFilename);
-  std::ofstream ccFile(ccFilename);
+  // ...and get a fast path in front of their switch when one edge is
+  // taken on at least this share of their visits.
+  const double dominantEdgeShare = 0.5;
 
-  if (hhFile.fail()) {
-    throw std::runtime_error("Could not open: " + hhFilename);
+  // Writes a boolean expression over the byte *curr that is true exactly
+  // for the given symbols. Consecutive symbols become range checks.
+  void emitSymbolCondition(std::ostream &os, const std::set<symbol> &symbols) {
+    std::vector<int> vals;
+    for (auto x : symbols) {
+      vals.push_back(x.val);
+    }
+    bool first = true;
+    for (size_t i = 0; i < vals.size(); ++i) {
+      size_t j = i;
+      while (j+1 < vals.size() && vals[j]+1 == vals[j+1]) ++j;
+      if (!first) os << " || ";
+      first = false;
+      if (i == j) {
+	os << "*curr == " << vals[i];
+      } else {
+	os << "static_cast<unsigned>(*curr - " << vals[i] << ") <= " << vals[j] - vals[i];
+      }
+      i = j;
+    }
   }
-  if (ccFile.fail()) {
-    throw std::runtime_error("Could not open: " + ccFilename);
+
+  unsigned actionBit(token_action a) {
+    return a == token_action::NONE ? 0 : 1u << static_cast<int>(a);
   }
 
-  std::vector<std::string> names;
-  for (auto const & r: tkn_rules)
-    names.push_back(r.name);
-  
-  std::ofstream ff("monkey.dot");
-  ff << d.toDot();
+  // Local variable of getNextToken accumulating the value of an action.
+  const char *actionVariable(token_action a) {
+    switch (a) {
+    case token_action::DECIMAL:
+      return "decimalValue";
+    case token_action::HASH:
+    case token_action::INTERN:
+      return "hashValue";
+    case token_action::NEWLINES:
+      return "newlineCount";
+    case token_action::NONE:
+    default:
+      return "0";
+    }
+  }
+
+  // Writes the updates of the given actions for consuming the byte *curr,
+  // which is one of symbols. Bytes an action ignores cost nothing when the
+  // whole edge is made of them.
+  void emitActions(std::ostream &os, unsigned actions, const std::set<symbol> &symbols) {
+    if (actions & actionBit(token_action::DECIMAL)) {
+      size_t digits = 0;
+      for (auto c : symbols) {
+	digits += (c.val >= '0' && c.val <= '9');
+      }
+      if (digits == symbols.size()) {
+	os << indent << indent << "decimalValue = decimalValue * 10 + (*curr - '0');" << std::endl;
+      } else if (digits) {
+	os << indent << indent << "if (static_cast<unsigned>(*curr - '0') <= 9) decimalValue = decimalValue * 10 + (*curr - '0');" << std::endl;
+      }
+    }
+    if (actions & (actionBit(token_action::HASH) | actionBit(token_action::INTERN))) {
+      os << indent << indent << "hashValue = (hashValue ^ *curr) * 0x100000001b3ull;" << std::endl;
+    }
+    if (actions & actionBit(token_action::NEWLINES)) {
+      if (symbols.size() == 1 && symbols.count(symbol('\n'))) {
+	os << indent << indent << "++newlineCount;" << std::endl;
+      } else if (symbols.count(symbol('\n'))) {
+	os << indent << indent << "newlineCount += (*curr == '\\n');" << std::endl;
+      }
+    }
+  }
+
+} // end unnamed namespace
+
+void lexer::cpp_emitter::emit_header(
+  std::ostream &hhFile,
+  const std::vector<std::string> &names,
+  const emit_options &options,
+  bool tokenValues,
+  bool internTable,
+  const std::string &inlineDefinitions) {
 
-  std::stringstream oscc;
-  std::stringstream oshh;
   hhFile << "#ifndef TOKENIZER_HH_GUARD" << std::endl;
   hhFile << "#define TOKENIZER_HH_GUARD" << std::endl << std::endl;
 
+  if (options.filePipeline) {
+    hhFile << "#include <atomic>" << std::endl;
+    hhFile << "#include <condition_variable>" << std::endl;
+  }
+  if (options.incremental || options.checkpoints || options.lineIndex || options.filePipeline) {
+    hhFile << "#include <cstddef>" << std::endl;
+  }
   hhFile << "#include <iostream>" << std::endl;
-  hhFile << "#include <stdint.h>" << std::endl << std::endl;
+  if (options.filePipeline) {
+    hhFile << "#include <mutex>" << std::endl;
+  }
+  hhFile << "#include <stdint.h>" << std::endl;
+  if (internTable || options.filePipeline) {
+    hhFile << "#include <string>" << std::endl;
+  }
+  if (options.filePipeline) {
+    hhFile << "#include <thread>" << std::endl;
+  }
+  if (options.incremental || options.lineIndex || options.filePipeline || internTable) {
+    hhFile << "#include <vector>" << std::endl;
+  }
+  hhFile << std::endl;
 
   hhFile << "namespace lexer {" << std::endl << std::endl;
 
@@ -63,23 +146,277 @@ void lexer::cpp_emitter::emit_dfa(
   hhFile << "struct Token {" << std::endl;
   hhFile << indent << "const char *start, *curr;" << std::endl;
   hhFile << indent << "TokenType tkn;" << std::endl;
+  if (tokenValues) {
+    hhFile << indent << "// Computed during the scan by the action of the rule, 0 without one." << std::endl;
+    hhFile << indent << "uint64_t value;" << std::endl;
+  }
   hhFile << "};" << std::endl;
 
   hhFile << std::endl << std::endl;
 
+  // Counters behind LEXER_ENABLE_STATS. The macro changes the layout of
+  // Tokenizer, so it must be the same for tokenizer.cc and its users.
+  hhFile << "#ifdef LEXER_ENABLE_STATS" << std::endl << std::endl;
+  hhFile << "struct TokenizerStats {" << std::endl;
+  hhFile << indent << "static const int NUMBER_OF_TOKEN_TYPES = " << names.size() + 2 << ";" << std::endl;
+  hhFile << indent << "static const int LENGTH_BUCKETS = 16;" << std::endl << std::endl;
+  hhFile << indent << "// Returned tokens, indexed by TokenType. END_OF_FILE is not counted." << std::endl;
+  hhFile << indent << "uint64_t tokens[NUMBER_OF_TOKEN_TYPES] = {};" << std::endl;
+  hhFile << indent << "// Bytes of the tokens counted in tokens and of skipped ignored tokens." << std::endl;
+  hhFile << indent << "uint64_t bytesConsumed = 0;" << std::endl;
+  hhFile << indent << "// Bytes matched by ignored rules, i.e. rules starting with '_'." << std::endl;
+  hhFile << indent << "uint64_t bytesSkipped = 0;" << std::endl;
+  hhFile << indent << "uint64_t invalidTokens = 0;" << std::endl;
+  hhFile << indent << "// Bytes of INVALID tokens." << std::endl;
+  hhFile << indent << "uint64_t invalidBytes = 0;" << std::endl;
+  hhFile << indent << "// Bucket i counts tokens whose length has bit width i, i.e. lengths" << std::endl;
+  hhFile << indent << "// in [2^(i-1), 2^i). The last bucket also takes everything longer." << std::endl;
+  hhFile << indent << "uint64_t lengthHistogram[LENGTH_BUCKETS] = {};" << std::endl << std::endl;
+  hhFile << indent << "void record(TokenType t, uint64_t length) {" << std::endl;
+  hhFile << indent << indent << "++tokens[static_cast<int>(t)];" << std::endl;
+  hhFile << indent << indent << "bytesConsumed += length;" << std::endl;
+  hhFile << indent << indent << "if (t == TokenType::INVALID) {" << std::endl;
+  hhFile << indent << indent << indent << "++invalidTokens;" << std::endl;
+  hhFile << indent << indent << indent << "invalidBytes += length;" << std::endl;
+  hhFile << indent << indent << "}" << std::endl;
+  hhFile << indent << indent << "int bucket = 0;" << std::endl;
+  hhFile << indent << indent << "while (length && bucket < LENGTH_BUCKETS-1) {" << std::endl;
+  hhFile << indent << indent << indent << "length >>= 1;" << std::endl;
+  hhFile << indent << indent << indent << "++bucket;" << std::endl;
+  hhFile << indent << indent << "}" << std::endl;
+  hhFile << indent << indent << "++lengthHistogram[bucket];" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "void recordSkipped(uint64_t length) {" << std::endl;
+  hhFile << indent << indent << "bytesConsumed += length;" << std::endl;
+  hhFile << indent << indent << "bytesSkipped += length;" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "// Adds the counters of other, e.g. from a tokenizer on another thread." << std::endl;
+  hhFile << indent << "void merge(const TokenizerStats &other) {" << std::endl;
+  hhFile << indent << indent << "for (int i = 0; i < NUMBER_OF_TOKEN_TYPES; ++i) tokens[i] += other.tokens[i];" << std::endl;
+  hhFile << indent << indent << "bytesConsumed += other.bytesConsumed;" << std::endl;
+  hhFile << indent << indent << "bytesSkipped += other.bytesSkipped;" << std::endl;
+  hhFile << indent << indent << "invalidTokens += other.invalidTokens;" << std::endl;
+  hhFile << indent << indent << "invalidBytes += other.invalidBytes;" << std::endl;
+  hhFile << indent << indent << "for (int i = 0; i < LENGTH_BUCKETS; ++i) lengthHistogram[i] += other.lengthHistogram[i];" << std::endl;
+  hhFile << indent << "}" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+  hhFile << "#endif // LEXER_ENABLE_STATS" << std::endl << std::endl;
+
   hhFile << "struct Tokenizer {" << std::endl << std::endl;
   hhFile << indent << "const char *str;" << std::endl << std::endl;
+  hhFile << "#ifdef LEXER_ENABLE_STATS" << std::endl;
+  hhFile << indent << "TokenizerStats stats;" << std::endl;
+  hhFile << "#endif" << std::endl << std::endl;
   hhFile << indent << "Tokenizer(const char *str) : str(str) {}" << std::endl << std::endl;
   hhFile << indent << "Token getNextToken();" << std::endl << std::endl;
   hhFile << "};" << std::endl << std::endl;
   
+  if (options.instrument) {
+    hhFile << "// Writes the state visit and transition counts gathered so far" << std::endl;
+    hhFile << "// in the format generate_lexer --profile-use=<file> reads." << std::endl;
+    hhFile << "void writeProfile(std::ostream &os);" << std::endl << std::endl;
+  }
+
+  if (internTable) {
+    hhFile << "// Gives every distinct lexeme of tokens of {intern} rules a small id," << std::endl;
+    hhFile << "// counting from 0 in order of first appearance. The hash in Token::value" << std::endl;
+    hhFile << "// picks the slot, so a lookup usually compares bytes at most once." << std::endl;
+    hhFile << "class InternTable {" << std::endl;
+    hhFile << "public:" << std::endl;
+    hhFile << indent << "InternTable();" << std::endl << std::endl;
+    hhFile << indent << "// Returns the id of the lexeme of tkn, adding it when it is new." << std::endl;
+    hhFile << indent << "uint32_t intern(const Token &tkn);" << std::endl << std::endl;
+    hhFile << indent << "const std::string &lexeme(uint32_t id) const { return lexemes[id]; }" << std::endl;
+    hhFile << indent << "size_t size() const { return lexemes.size(); }" << std::endl << std::endl;
+    hhFile << "private:" << std::endl;
+    hhFile << indent << "struct Slot {" << std::endl;
+    hhFile << indent << indent << "uint64_t hash;" << std::endl;
+    hhFile << indent << indent << "uint32_t id;" << std::endl;
+    hhFile << indent << "};" << std::endl;
+    hhFile << indent << "static const uint32_t EMPTY = 0xffffffffu;" << std::endl << std::endl;
+    hhFile << indent << "void grow();" << std::endl << std::endl;
+    hhFile << indent << "// Open addressing with linear probing, at most half full." << std::endl;
+    hhFile << indent << "std::vector<Slot> slots;" << std::endl;
+    hhFile << indent << "std::vector<std::string> lexemes;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+  }
+
+  if (options.lineIndex) {
+    hhFile << "// Line and column of a byte, both counting from 1. Columns count bytes." << std::endl;
+    hhFile << "struct LineColumn {" << std::endl;
+    hhFile << indent << "size_t line, column;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+    hhFile << "// Finds lines and columns in the 0 terminated str, e.g. of Token::start" << std::endl;
+    hhFile << "// for a diagnostic. The newlines are indexed on the first lookup, so" << std::endl;
+    hhFile << "// tokenizing does not pay for it, and every lookup is a binary search." << std::endl;
+    hhFile << "class LineIndex {" << std::endl;
+    hhFile << "public:" << std::endl;
+    hhFile << indent << "explicit LineIndex(const char *str) : str(str) {}" << std::endl << std::endl;
+    hhFile << indent << "LineColumn lookup(size_t offset);" << std::endl;
+    hhFile << indent << "LineColumn lookup(const char *p) { return lookup(p - str); }" << std::endl << std::endl;
+    hhFile << "private:" << std::endl;
+    hhFile << indent << "void build();" << std::endl << std::endl;
+    hhFile << indent << "const char *str;" << std::endl;
+    hhFile << indent << "bool built = false;" << std::endl;
+    hhFile << indent << "// Offsets of the newlines in str." << std::endl;
+    hhFile << indent << "std::vector<size_t> offsets;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+  }
+
+  if (options.filePipeline) {
+    const std::string i2 = indent + indent;
+    hhFile << "// Tokenizes a file while a reader thread reads ahead into a ring of" << std::endl;
+    hhFile << "// aligned buffers, so reading and scanning overlap and memory does not" << std::endl;
+    hhFile << "// grow with the file. A token that reaches the end of a buffer is" << std::endl;
+    hhFile << "// scanned again from its start in front of the next buffer. Link with" << std::endl;
+    hhFile << "// -pthread." << std::endl;
+    hhFile << "class FileTokenizer {" << std::endl;
+    hhFile << "public:" << std::endl;
+    hhFile << indent << "// Reads filename in chunks of chunkSize bytes, at most slots chunks ahead." << std::endl;
+    hhFile << indent << "// A chunkSize of 0 is taken as 1, and fewer than 2 slots as 2." << std::endl;
+    hhFile << indent << "explicit FileTokenizer(const std::string &filename," << std::endl;
+    hhFile << "                           size_t chunkSize = 1 << 20, size_t slots = 4);" << std::endl;
+    hhFile << indent << "~FileTokenizer();" << std::endl << std::endl;
+    hhFile << indent << "FileTokenizer(const FileTokenizer&) = delete;" << std::endl;
+    hhFile << indent << "FileTokenizer &operator=(const FileTokenizer&) = delete;" << std::endl << std::endl;
+    hhFile << indent << "// Like Tokenizer::getNextToken. The token is valid until the next call." << std::endl;
+    hhFile << indent << "Token getNextToken();" << std::endl << std::endl;
+    hhFile << indent << "// True when the file could not be opened or read. The tokens up to the" << std::endl;
+    hhFile << indent << "// error are still returned." << std::endl;
+    hhFile << indent << "bool fail() const { return failed; }" << std::endl << std::endl;
+    hhFile << "private:" << std::endl;
+    hhFile << indent << "struct Slot {" << std::endl;
+    hhFile << i2 << "std::vector<char> storage;" << std::endl;
+    hhFile << i2 << "// Chunk data, aligned, with room for a carried token in front." << std::endl;
+    hhFile << i2 << "char *data;" << std::endl;
+    hhFile << i2 << "size_t length;" << std::endl;
+    hhFile << i2 << "bool last;" << std::endl;
+    hhFile << indent << "};" << std::endl << std::endl;
+    hhFile << indent << "void readAhead();" << std::endl;
+    hhFile << indent << "void acquire();" << std::endl;
+    hhFile << indent << "void release();" << std::endl << std::endl;
+    hhFile << indent << "int fd;" << std::endl;
+    hhFile << indent << "size_t chunkSize;" << std::endl;
+    hhFile << indent << "std::atomic<bool> failed;" << std::endl;
+    hhFile << indent << "std::vector<Slot> ring;" << std::endl << std::endl;
+    hhFile << indent << "std::mutex mutex;" << std::endl;
+    hhFile << indent << "std::condition_variable ready, space;" << std::endl;
+    hhFile << indent << "// Slots filled by the reader and released by the lexer so far." << std::endl;
+    hhFile << indent << "size_t filled, consumed;" << std::endl;
+    hhFile << indent << "bool stopping;" << std::endl;
+    hhFile << indent << "std::thread reader;" << std::endl << std::endl;
+    hhFile << indent << "// The bytes being scanned: a slot, or scratch for carries that do not" << std::endl;
+    hhFile << indent << "// fit in front of one." << std::endl;
+    hhFile << indent << "Tokenizer t;" << std::endl;
+    hhFile << indent << "const char *end;" << std::endl;
+    hhFile << indent << "// holding is true while the tokens are in a slot, not in scratch." << std::endl;
+    hhFile << indent << "bool active, holding, last, finished;" << std::endl;
+    hhFile << indent << "std::vector<char> carry, scratch;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+
+  }
+
+  if (options.incremental) {
+    hhFile << "// A token as offsets into its buffer, so it stays meaningful when the" << std::endl;
+    hhFile << "// buffer is edited or moved." << std::endl;
+    hhFile << "struct TokenSpan {" << std::endl;
+    hhFile << indent << "size_t start, end;" << std::endl;
+    hhFile << indent << "TokenType tkn;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+    hhFile << "// The tokens of the 0 terminated str, without END_OF_FILE." << std::endl;
+    hhFile << "std::vector<TokenSpan> tokenizeSpans(const char *str);" << std::endl << std::endl;
+    hhFile << "// relex replaced the old tokens [first, first+removed) with the new" << std::endl;
+    hhFile << "// tokens [first, first+inserted)." << std::endl;
+    hhFile << "struct RelexResult {" << std::endl;
+    hhFile << indent << "size_t first, removed, inserted;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+    hhFile << "// Updates tokens, the spans of a buffer, after the removed bytes at" << std::endl;
+    hhFile << "// offset were replaced by inserted bytes, giving the 0 terminated str." << std::endl;
+    hhFile << "// Lexing restarts behind the last token that ends before the edit and" << std::endl;
+    hhFile << "// stops at the first token that starts where an old token started" << std::endl;
+    hhFile << "// behind the edit. The tokens from there on are only shifted." << std::endl;
+    hhFile << "RelexResult relex(std::vector<TokenSpan> &tokens, const char *str," << std::endl;
+    hhFile << "                  size_t offset, size_t removed, size_t inserted);" << std::endl << std::endl;
+  }
+
+  if (options.checkpoints) {
+    hhFile << "// A checkpoint index holds positions where a Tokenizer can start in the" << std::endl;
+    hhFile << "// middle of a buffer and return the same tokens as one started at its" << std::endl;
+    hhFile << "// beginning. Entry i is the first such position at or after i*interval." << std::endl;
+    hhFile << "// The index is a CheckpointHeader followed by count uint64_t entries in" << std::endl;
+    hhFile << "// the byte order of the machine that wrote it, and can be used in place" << std::endl;
+    hhFile << "// from a mapped file. When the buffer only grows, entries before the old" << std::endl;
+    hhFile << "// size stay valid." << std::endl;
+    hhFile << "struct CheckpointHeader {" << std::endl;
+    hhFile << indent << "char magic[8];" << std::endl;
+    hhFile << indent << "uint32_t version;" << std::endl;
+    hhFile << indent << "uint32_t interval;" << std::endl;
+    hhFile << indent << "// Length of the lexed buffer." << std::endl;
+    hhFile << indent << "uint64_t size;" << std::endl;
+    hhFile << indent << "uint64_t count;" << std::endl;
+    hhFile << "};" << std::endl << std::endl;
+    hhFile << "// Lexes the 0 terminated str and writes its checkpoint index to os." << std::endl;
+    hhFile << "// An interval of 0 is taken as 1." << std::endl;
+    hhFile << "void writeCheckpoints(std::ostream &os, const char *str, uint32_t interval);" << std::endl << std::endl;
+    hhFile << "// Returns the last checkpoint at or before offset in the index of" << std::endl;
+    hhFile << "// indexSize bytes at index, or 0, which is always a valid start, when" << std::endl;
+    hhFile << "// the index is damaged." << std::endl;
+    hhFile << "uint64_t findCheckpoint(const void *index, size_t indexSize, uint64_t offset);" << std::endl << std::endl;
+  }
+
+  if (options.pushApi) {
+    if (options.bulkInvalid) {
+      hhFile << "namespace detail {" << std::endl;
+      hhFile << "const uint8_t *skipInvalidRun(const uint8_t *curr);" << std::endl;
+      hhFile << "} // end namespace detail" << std::endl << std::endl;
+    }
+    hhFile << "#ifndef LEXER_LIKELY" << std::endl;
+    hhFile << "#if defined(__GNUC__)" << std::endl;
+    hhFile << "#define LEXER_LIKELY(x) __builtin_expect(!!(x), 1)" << std::endl;
+    hhFile << "#else" << std::endl;
+    hhFile << "#define LEXER_LIKELY(x) (x)" << std::endl;
+    hhFile << "#endif" << std::endl;
+    hhFile << "#endif" << std::endl << std::endl;
+  }
+
+  hhFile << inlineDefinitions;
+
   hhFile << "} // end namespace lexer" << std::endl << std::endl;
 
   hhFile << "#endif // TOKENIZER_HH_GUARD" << std::endl;
-  
+}
+
+void lexer::cpp_emitter::emit_includes(
+  std::ostream &ccFile,
+  const emit_options &options) {
+
   ccFile << "#include \"tokenizer.hh\"" << std::endl << std::endl;
-  
-  ccFile << "namespace lexer {" << std::endl << std::endl;
+  if (options.incremental || options.checkpoints || options.lineIndex || options.filePipeline) {
+    ccFile << "#include <algorithm>" << std::endl;
+  }
+  if (options.checkpoints) {
+    ccFile << "#include <cstring>" << std::endl;
+    ccFile << "#include <vector>" << std::endl;
+  }
+  if (options.filePipeline) {
+    ccFile << "#include <cerrno>" << std::endl;
+    ccFile << "#include <fcntl.h>" << std::endl;
+    ccFile << "#include <unistd.h>" << std::endl;
+  }
+  if (options.lineIndex) {
+    ccFile << "#if defined(__SSE2__)" << std::endl;
+    ccFile << "#include <emmintrin.h>" << std::endl;
+    ccFile << "#endif" << std::endl;
+  }
+  if (options.incremental || options.checkpoints || options.lineIndex || options.filePipeline) {
+    ccFile << std::endl;
+  }
+}
+
+void lexer::cpp_emitter::emit_common(
+  std::ostream &ccFile,
+  const std::vector<std::string> &names,
+  const emit_options &options) {
 
   ccFile << "std::ostream& operator<<(std::ostream &os, const lexer::TokenType &t) {" << std::endl;
   ccFile << indent << "switch (t) {" << std::endl;
@@ -98,13 +435,326 @@ void lexer::cpp_emitter::emit_dfa(
   ccFile << indent << "return os;" << std::endl;
   ccFile << "}" << std::endl << std::endl;
 
-  ccFile << "Token Tokenizer::getNextToken() {" << std::endl << std::endl;
+  ccFile << "#ifdef LEXER_ENABLE_STATS" << std::endl;
+  ccFile << "#define LEXER_RECORD_TOKEN(type) stats.record(type, curr - start)" << std::endl;
+  ccFile << "#define LEXER_RECORD_SKIPPED() stats.recordSkipped(curr - start)" << std::endl;
+  ccFile << "#else" << std::endl;
+  ccFile << "#define LEXER_RECORD_TOKEN(type)" << std::endl;
+  ccFile << "#define LEXER_RECORD_SKIPPED()" << std::endl;
+  ccFile << "#endif" << std::endl << std::endl;
+
+  ccFile << "#if defined(__GNUC__)" << std::endl;
+  ccFile << "#define LEXER_LIKELY(x) __builtin_expect(!!(x), 1)" << std::endl;
+  ccFile << "#else" << std::endl;
+  ccFile << "#define LEXER_LIKELY(x) (x)" << std::endl;
+  ccFile << "#endif" << std::endl << std::endl;
+
+  if (options.incremental) {
+    emit_relex(ccFile);
+  }
+  if (options.checkpoints) {
+    emit_checkpoints(ccFile);
+  }
+  if (options.lineIndex) {
+    emit_line_index(ccFile);
+  }
+  if (options.filePipeline) {
+    emit_file_pipeline(ccFile);
+  }
+}
+
+void lexer::cpp_emitter::emit_file_pipeline(std::ostream &ccFile) {
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+  const std::string i4 = i3 + indent;
+
+  ccFile << "namespace {" << std::endl;
+  ccFile << "const size_t carryRoom = 4096;" << std::endl;
+  ccFile << "} // end unnamed namespace" << std::endl << std::endl;
+  ccFile << "FileTokenizer::FileTokenizer(const std::string &filename, size_t chunkSize, size_t slots)" << std::endl;
+  ccFile << indent << ": fd(open(filename.c_str(), O_RDONLY)), chunkSize(chunkSize ? chunkSize : 1), failed(fd < 0)," << std::endl;
+  ccFile << "      ring(slots < 2 ? 2 : slots), filled(0), consumed(0), stopping(false)," << std::endl;
+  ccFile << "      t(nullptr), end(nullptr), active(false), holding(false), last(false), finished(fd < 0) {" << std::endl;
+  ccFile << indent << "if (failed) return;" << std::endl;
+  ccFile << "#if defined(POSIX_FADV_SEQUENTIAL)" << std::endl;
+  ccFile << indent << "posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);" << std::endl;
+  ccFile << "#endif" << std::endl;
+  ccFile << indent << "for (auto &s : ring) {" << std::endl;
+  ccFile << i2 << "s.storage.resize(carryRoom + this->chunkSize + 64);" << std::endl;
+  ccFile << i2 << "uintptr_t p = reinterpret_cast<uintptr_t>(s.storage.data()) + carryRoom;" << std::endl;
+  ccFile << i2 << "s.data = reinterpret_cast<char*>((p + 63) & ~uintptr_t(63));" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "reader = std::thread(&FileTokenizer::readAhead, this);" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "FileTokenizer::~FileTokenizer() {" << std::endl;
+  ccFile << indent << "{" << std::endl;
+  ccFile << i2 << "std::lock_guard<std::mutex> lock(mutex);" << std::endl;
+  ccFile << i2 << "stopping = true;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "space.notify_one();" << std::endl;
+  ccFile << indent << "if (reader.joinable()) reader.join();" << std::endl;
+  ccFile << indent << "if (fd >= 0) close(fd);" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "void FileTokenizer::readAhead() {" << std::endl;
+  ccFile << indent << "off_t offset = 0;" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "std::unique_lock<std::mutex> lock(mutex);" << std::endl;
+  ccFile << i2 << "space.wait(lock, [this] { return stopping || filled - consumed < ring.size(); });" << std::endl;
+  ccFile << i2 << "if (stopping) return;" << std::endl;
+  ccFile << i2 << "Slot &s = ring[filled % ring.size()];" << std::endl;
+  ccFile << i2 << "lock.unlock();" << std::endl << std::endl;
+  ccFile << i2 << "size_t length = 0;" << std::endl;
+  ccFile << i2 << "bool error = false;" << std::endl;
+  ccFile << i2 << "while (length < chunkSize) {" << std::endl;
+  ccFile << i3 << "ssize_t n = pread(fd, s.data + length, chunkSize - length, offset + length);" << std::endl;
+  ccFile << i3 << "if (n < 0 && errno == EINTR) continue;" << std::endl;
+  ccFile << i3 << "if (n <= 0) {" << std::endl;
+  ccFile << i4 << "error = n < 0;" << std::endl;
+  ccFile << i4 << "break;" << std::endl;
+  ccFile << i3 << "}" << std::endl;
+  ccFile << i3 << "length += n;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "offset += length;" << std::endl;
+  ccFile << i2 << "s.data[length] = 0;" << std::endl;
+  ccFile << i2 << "s.length = length;" << std::endl;
+  ccFile << i2 << "s.last = length < chunkSize;" << std::endl << std::endl;
+  ccFile << i2 << "lock.lock();" << std::endl;
+  ccFile << i2 << "if (error) failed = true;" << std::endl;
+  ccFile << i2 << "++filled;" << std::endl;
+  ccFile << i2 << "ready.notify_one();" << std::endl;
+  ccFile << i2 << "if (s.last) return;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "void FileTokenizer::acquire() {" << std::endl;
+  ccFile << indent << "Slot *s;" << std::endl;
+  ccFile << indent << "{" << std::endl;
+  ccFile << i2 << "std::unique_lock<std::mutex> lock(mutex);" << std::endl;
+  ccFile << i2 << "ready.wait(lock, [this] { return filled > consumed; });" << std::endl;
+  ccFile << i2 << "s = &ring[consumed % ring.size()];" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "last = s->last;" << std::endl;
+  ccFile << indent << "if (carry.size() <= carryRoom) {" << std::endl;
+  ccFile << i2 << "char *begin = s->data - carry.size();" << std::endl;
+  ccFile << i2 << "std::copy(carry.begin(), carry.end(), begin);" << std::endl;
+  ccFile << i2 << "t = Tokenizer(begin);" << std::endl;
+  ccFile << i2 << "end = s->data + s->length;" << std::endl;
+  ccFile << i2 << "holding = true;" << std::endl;
+  ccFile << indent << "} else {" << std::endl;
+  ccFile << i2 << "// A token longer than carryRoom: scan a copy instead." << std::endl;
+  ccFile << i2 << "scratch.assign(carry.begin(), carry.end());" << std::endl;
+  ccFile << i2 << "scratch.insert(scratch.end(), s->data, s->data + s->length + 1);" << std::endl;
+  ccFile << i2 << "release();" << std::endl;
+  ccFile << i2 << "t = Tokenizer(scratch.data());" << std::endl;
+  ccFile << i2 << "end = scratch.data() + scratch.size() - 1;" << std::endl;
+  ccFile << i2 << "holding = false;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "carry.clear();" << std::endl;
+  ccFile << indent << "active = true;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "void FileTokenizer::release() {" << std::endl;
+  ccFile << indent << "{" << std::endl;
+  ccFile << i2 << "std::lock_guard<std::mutex> lock(mutex);" << std::endl;
+  ccFile << i2 << "++consumed;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "space.notify_one();" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "Token FileTokenizer::getNextToken() {" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "if (finished) {" << std::endl;
+  ccFile << i3 << "return Token{end, end, TokenType::END_OF_FILE};" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "if (!active) acquire();" << std::endl;
+  ccFile << i2 << "const char *resume = t.str;" << std::endl;
+  ccFile << i2 << "Token tkn = t.getNextToken();" << std::endl;
+  ccFile << i2 << "if (tkn.curr != end || last) {" << std::endl;
+  ccFile << i3 << "// A 0 in the file ends it, like for Tokenizer." << std::endl;
+  ccFile << i3 << "finished = tkn.tkn == TokenType::END_OF_FILE;" << std::endl;
+  ccFile << i3 << "return tkn;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "// The scan stopped at the end of the buffer, so the token may go on" << std::endl;
+  ccFile << i2 << "// in the next one. Scan again from where this call started." << std::endl;
+  ccFile << i2 << "carry.assign(resume, end);" << std::endl;
+  ccFile << i2 << "if (holding) release();" << std::endl;
+  ccFile << i2 << "active = false;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+}
+
+void lexer::cpp_emitter::emit_line_index(std::ostream &ccFile) {
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+
+  ccFile << "void LineIndex::build() {" << std::endl;
+  ccFile << indent << "built = true;" << std::endl;
+  ccFile << "#if defined(__SSE2__)" << std::endl;
+  ccFile << indent << "// Aligned loads never cross into the next page, so reading past the" << std::endl;
+  ccFile << indent << "// terminating 0 within a block is safe." << std::endl;
+  ccFile << indent << "const __m128i newline = _mm_set1_epi8('\\n');" << std::endl;
+  ccFile << indent << "const __m128i zero = _mm_setzero_si128();" << std::endl;
+  ccFile << indent << "const char *block = reinterpret_cast<const char*>(reinterpret_cast<uintptr_t>(str) & ~uintptr_t(15));" << std::endl;
+  ccFile << indent << "unsigned valid = (0xffffu << (str - block)) & 0xffffu;" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "__m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(block));" << std::endl;
+  ccFile << i2 << "unsigned newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) & valid;" << std::endl;
+  ccFile << i2 << "unsigned ends = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & valid;" << std::endl;
+  ccFile << i2 << "if (ends) {" << std::endl;
+  ccFile << i3 << "// Only the newlines in front of the terminating 0." << std::endl;
+  ccFile << i3 << "newlines &= (ends & -ends) - 1;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "while (newlines) {" << std::endl;
+  ccFile << i3 << "offsets.push_back(block - str + __builtin_ctz(newlines));" << std::endl;
+  ccFile << i3 << "newlines &= newlines - 1;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "if (ends) return;" << std::endl;
+  ccFile << i2 << "block += 16;" << std::endl;
+  ccFile << i2 << "valid = 0xffffu;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "#else" << std::endl;
+  ccFile << indent << "for (const char *p = str; *p; ++p) {" << std::endl;
+  ccFile << i2 << "if (*p == '\\n') offsets.push_back(p - str);" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "#endif" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+
+  ccFile << "LineColumn LineIndex::lookup(size_t offset) {" << std::endl;
+  ccFile << indent << "if (!built) build();" << std::endl;
+  ccFile << indent << "// Newlines in front of offset." << std::endl;
+  ccFile << indent << "size_t before = std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();" << std::endl;
+  ccFile << indent << "size_t lineStart = before ? offsets[before-1] + 1 : 0;" << std::endl;
+  ccFile << indent << "return LineColumn{before + 1, offset - lineStart + 1};" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+}
+
+void lexer::cpp_emitter::emit_checkpoints(std::ostream &ccFile) {
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+
+  ccFile << "namespace {" << std::endl;
+  ccFile << "const char checkpointMagic[8] = { 'L', 'E', 'X', 'C', 'K', 'P', 'T', 0 };" << std::endl;
+  ccFile << "const uint32_t checkpointVersion = 1;" << std::endl;
+  ccFile << "} // end unnamed namespace" << std::endl << std::endl;
+
+  ccFile << "void writeCheckpoints(std::ostream &os, const char *str, uint32_t interval) {" << std::endl;
+  ccFile << indent << "// findCheckpoint divides by it, and entries are written until" << std::endl;
+  ccFile << indent << "// count * interval passes the position." << std::endl;
+  ccFile << indent << "if (interval == 0) interval = 1;" << std::endl;
+  ccFile << indent << "std::vector<uint64_t> entries;" << std::endl;
+  ccFile << indent << "Tokenizer t(str);" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "// Every call of getNextToken starts at a valid position." << std::endl;
+  ccFile << i2 << "uint64_t position = t.str - str;" << std::endl;
+  ccFile << i2 << "while (entries.size() * interval <= position) {" << std::endl;
+  ccFile << i3 << "entries.push_back(position);" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "if (t.getNextToken().tkn == TokenType::END_OF_FILE) break;" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "CheckpointHeader h;" << std::endl;
+  ccFile << indent << "std::memset(&h, 0, sizeof(h));" << std::endl;
+  ccFile << indent << "std::memcpy(h.magic, checkpointMagic, sizeof(h.magic));" << std::endl;
+  ccFile << indent << "h.version = checkpointVersion;" << std::endl;
+  ccFile << indent << "h.interval = interval;" << std::endl;
+  ccFile << indent << "h.size = t.str - str;" << std::endl;
+  ccFile << indent << "h.count = entries.size();" << std::endl;
+  ccFile << indent << "os.write(reinterpret_cast<const char*>(&h), sizeof(h));" << std::endl;
+  ccFile << indent << "os.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(uint64_t));" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+
+  ccFile << "uint64_t findCheckpoint(const void *index, size_t indexSize, uint64_t offset) {" << std::endl;
+  ccFile << indent << "CheckpointHeader h;" << std::endl;
+  ccFile << indent << "if (indexSize < sizeof(h)) return 0;" << std::endl;
+  ccFile << indent << "std::memcpy(&h, index, sizeof(h));" << std::endl;
+  ccFile << indent << "if (std::memcmp(h.magic, checkpointMagic, sizeof(h.magic)) != 0 ||" << std::endl;
+  ccFile << indent << "    h.version != checkpointVersion || h.interval == 0 ||" << std::endl;
+  ccFile << indent << "    h.count > (indexSize - sizeof(h)) / sizeof(uint64_t)) return 0;" << std::endl;
+  ccFile << indent << "const uint64_t *entries = reinterpret_cast<const uint64_t*>(" << std::endl;
+  ccFile << indent << "    static_cast<const char*>(index) + sizeof(h));" << std::endl;
+  ccFile << indent << "// Entries are sorted and entry i is at or after i*interval, so the" << std::endl;
+  ccFile << indent << "// answer is at or before entry offset/interval." << std::endl;
+  ccFile << indent << "uint64_t last = std::min<uint64_t>(offset / h.interval + 1, h.count);" << std::endl;
+  ccFile << indent << "const uint64_t *e = std::upper_bound(entries, entries + last, offset);" << std::endl;
+  ccFile << indent << "return e == entries ? 0 : e[-1];" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+}
+
+void lexer::cpp_emitter::emit_relex(std::ostream &ccFile) {
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+  const std::string i4 = i3 + indent;
+
+  ccFile << "std::vector<TokenSpan> tokenizeSpans(const char *str) {" << std::endl;
+  ccFile << indent << "std::vector<TokenSpan> tokens;" << std::endl;
+  ccFile << indent << "Tokenizer t(str);" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "Token tkn = t.getNextToken();" << std::endl;
+  ccFile << i2 << "if (tkn.tkn == TokenType::END_OF_FILE) return tokens;" << std::endl;
+  ccFile << i2 << "tokens.push_back({size_t(tkn.start - str), size_t(tkn.curr - str), tkn.tkn});" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+
+  // Lexing from a position depends only on the bytes from there on, and
+  // the start of every token is such a restart position. A token also
+  // depends on the byte behind it, which ended it.
+  ccFile << "RelexResult relex(std::vector<TokenSpan> &tokens, const char *str," << std::endl;
+  ccFile << "                  size_t offset, size_t removed, size_t inserted) {" << std::endl;
+  ccFile << indent << "// Tokens ending before the edit did not see it, not even as the byte" << std::endl;
+  ccFile << indent << "// that ended them." << std::endl;
+  ccFile << indent << "auto changed = std::lower_bound(tokens.begin(), tokens.end(), offset," << std::endl;
+  ccFile << indent << "    [](const TokenSpan &t, size_t o) { return t.end < o; });" << std::endl;
+  ccFile << indent << "size_t first = changed - tokens.begin();" << std::endl;
+  ccFile << indent << "size_t restart = first ? tokens[first-1].end : 0;" << std::endl << std::endl;
+  ccFile << indent << "// Old tokens starting behind the removed bytes are where lexing can" << std::endl;
+  ccFile << indent << "// fall back in step with the old tokens." << std::endl;
+  ccFile << indent << "auto old = std::lower_bound(changed, tokens.end(), offset + removed," << std::endl;
+  ccFile << indent << "    [](const TokenSpan &t, size_t o) { return t.start < o; });" << std::endl;
+  ccFile << indent << "std::vector<TokenSpan> fresh;" << std::endl;
+  ccFile << indent << "Tokenizer t(str + restart);" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "Token tkn = t.getNextToken();" << std::endl;
+  ccFile << i2 << "size_t start = tkn.start - str;" << std::endl;
+  ccFile << i2 << "if (start >= offset + inserted) {" << std::endl;
+  ccFile << i3 << "while (old != tokens.end() && old->start + inserted < start + removed) {" << std::endl;
+  ccFile << i4 << "++old;" << std::endl;
+  ccFile << i3 << "}" << std::endl;
+  ccFile << i3 << "if (old != tokens.end() && old->start + inserted == start + removed) break;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "if (tkn.tkn == TokenType::END_OF_FILE) break;" << std::endl;
+  ccFile << i2 << "fresh.push_back({start, size_t(tkn.curr - str), tkn.tkn});" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "for (auto s = old; s != tokens.end(); ++s) {" << std::endl;
+  ccFile << i2 << "s->start = s->start + inserted - removed;" << std::endl;
+  ccFile << i2 << "s->end = s->end + inserted - removed;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "RelexResult r = {first, size_t(old - changed), fresh.size()};" << std::endl;
+  ccFile << indent << "tokens.insert(tokens.erase(changed, old), fresh.begin(), fresh.end());" << std::endl;
+  ccFile << indent << "return r;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+}
+
+void lexer::cpp_emitter::emit_dfa(
+  const DFA & d, 
+  std::vector<tkn_rule> &tkn_rules,
+  const std::string &outputDirectory,
+  const emit_options &options) {
+
+  std::string hhFilename = outputDirectory + "tokenizer.hh";
+  std::string ccFilename = outputDirectory + "tokenizer.cc";
+
+  std::ofstream hhFile(hhFilename);
+  std::ofstream ccFile(ccFilename);
+
+  if (hhFile.fail()) {
+    throw std::runtime_error("Could not open: " + hhFilename);
+  }
+  if (ccFile.fail()) {
+    throw std::runtime_error("Could not open: " + ccFilename);
+  }
+
+  std::vector<std::string> names;
+  for (auto const & r: tkn_rules)
+    names.push_back(r.name);
   
-  ccFile << std::endl;
-  ccFile << indent << "const uint8_t *start;" << std::endl;
-  ccFile << indent << "const uint8_t *curr = reinterpret_cast<const uint8_t*>(str);" << std::endl;
-  ccFile << "beginning:" << std::endl;
-  ccFile << indent << "start = curr;" << std::endl << std::endl;
+  std::ofstream ff("monkey.dot");
+  ff << d.toDot();
 
   auto delta = d.getDelta();
   auto accepts = d.getAcceptStates();
@@ -126,8 +776,6 @@ void lexer::cpp_emitter::emit_dfa(
     break;
   }
 
-  ccFile << indent << "goto s" << q0 << ";" << std::endl << std::endl;
-
   std::map<state, std::map<state, std::set<symbol> > > remapped;
 
   for (state i = 0; i < numberOfStates; ++i) {
@@ -145,47 +793,381 @@ void lexer::cpp_emitter::emit_dfa(
     remapped[x.first.first][x.second].insert(x.first.second);
   }
 
+  // Every (from, to) pair gets a counter in instrumented lexers.
+  std::map<std::pair<state, state>, size_t> edgeIds;
+  for (auto x : remapped) {
+    for (auto y : x.second) {
+      size_t id = edgeIds.size();
+      edgeIds[{x.first, y.first}] = id;
+    }
+  }
+
+  const transition_profile &profile = options.profile;
+
+  // Emit states in id order, or hottest first when we have a profile so the
+  // code that handles most bytes is contiguous.
+  std::vector<state> stateOrder;
+  std::set<state> hotStates;
+  if (profile.empty()) {
+    for (auto x : remapped) {
+      stateOrder.push_back(x.first);
+    }
+  } else {
+    uint64_t totalVisits = 0;
+    for (auto v : profile.stateVisits) {
+      totalVisits += v;
+    }
+    uint64_t covered = 0;
+    for (auto s : profile.hotStateOrder()) {
+      if (!remapped.count(s)) continue;
+      stateOrder.push_back(s);
+      if (covered < hotVisitShare * totalVisits && profile.getStateVisits(s) > 0) {
+	hotStates.insert(s);
+	covered += profile.getStateVisits(s);
+      }
+    }
+  }
 
-  for (auto x : remapped) { 	// key: state, value: map[state] -> set of symbols.
-    ccFile << "s" << x.first << ":" << std::endl;
-    ccFile << indent << "switch (*curr) {" << std::endl;
-    if (x.first != rejectState) {
-      for (auto y : x.second) {	// key: state, value: set of symbols
-	for (auto z : y.second) { // z is a symbol. Iterating over all edges that end in state y coming from x.
-	  ccFile << indent << "case " << static_cast<int>(z.val) << ":" << std::endl;
+  // Rule actions run on every edge into a state from which a rule with
+  // that action can still be returned, so their values are complete when
+  // the token is.
+  std::vector<token_action> actionOf(names.size()+1, token_action::NONE);
+  unsigned usedActions = 0;
+  for (size_t i = 0; i < tkn_rules.size(); ++i) {
+    actionOf[i+1] = tkn_rules[i].action;
+    usedActions |= actionBit(tkn_rules[i].action);
+  }
+  std::map<state, unsigned> liveActions;
+  if (usedActions) {
+    for (auto &x : remapped) {
+      liveActions[x.first] = actionBit(actionOf[d.getAcceptTypeForState(x.first, lexer::REJECT)]);
+    }
+    for (bool changed = true; changed; ) {
+      changed = false;
+      for (auto &x : remapped) {
+	unsigned live = liveActions[x.first];
+	for (auto &y : x.second) {
+	  live |= liveActions[y.first];
+	}
+	if (live != liveActions[x.first]) {
+	  liveActions[x.first] = live;
+	  changed = true;
 	}
-	ccFile << indent << indent << "++curr;" << std::endl;
-	ccFile << indent << indent << "goto s" << y.first << ";" << std::endl;
       }
     }
+  }
 
-    if (x.first == d.getInitialState()) {
-      ccFile << indent << "case 0:" << std::endl;
-      ccFile << indent << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
-      ccFile << indent << indent 
-	     << "return Token{reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), TokenType::END_OF_FILE};" << std::endl;
+  // The scanner, once as the body of getNextToken and, with
+  // options.pushApi, once as the body of the tokenize template, which
+  // calls a handler instead of returning each token.
+  auto emitMachine = [&](std::ostream &os, bool push) {
+    os << indent << "const uint8_t *start;" << std::endl;
+    os << indent << "const uint8_t *curr = reinterpret_cast<const uint8_t*>(str);" << std::endl;
+    bool hashes = usedActions & (actionBit(token_action::HASH) | actionBit(token_action::INTERN));
+    if (usedActions & actionBit(token_action::DECIMAL)) {
+      os << indent << "uint64_t decimalValue;" << std::endl;
+    }
+    if (hashes) {
+      os << indent << "uint64_t hashValue;" << std::endl;
+    }
+    if (usedActions & actionBit(token_action::NEWLINES)) {
+      os << indent << "uint64_t newlineCount;" << std::endl;
     }
-    
-    acceptType a = d.getAcceptTypeForState(x.first, lexer::REJECT);
+    os << "beginning:" << std::endl;
+    os << indent << "start = curr;" << std::endl;
+    if (usedActions & actionBit(token_action::DECIMAL)) {
+      os << indent << "decimalValue = 0;" << std::endl;
+    }
+    if (hashes) {
+      os << indent << "hashValue = 0xcbf29ce484222325ull;" << std::endl;
+    }
+    if (usedActions & actionBit(token_action::NEWLINES)) {
+      os << indent << "newlineCount = 0;" << std::endl;
+    }
+    os << std::endl;
+
+    os << indent << "goto s" << q0 << ";" << std::endl << std::endl;
+
+    auto emitReturn = [&](const std::string &type, token_action action) {
+      if (push && type == "END_OF_FILE") {
+	os << indent << indent << "return reinterpret_cast<const char*>(curr);" << std::endl;
+	return;
+      }
+      if (push) {
+	os << indent << indent << "if (!handler(Token{";
+      } else {
+	os << indent << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
+	if (type != "END_OF_FILE") {
+	  os << indent << indent << "LEXER_RECORD_TOKEN(TokenType::" << type << ");" << std::endl;
+	}
+	os << indent << indent << "return Token{";
+      }
+      os << "reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), TokenType::" << type;
+      if (usedActions) {
+	os << ", " << actionVariable(action);
+      }
+      if (push) {
+	os << "})) return reinterpret_cast<const char*>(curr);" << std::endl;
+	os << indent << indent << "goto beginning;" << std::endl;
+      } else {
+	os << "};" << std::endl;
+      }
+    };
+
+    for (auto s : stateOrder) {
+      auto &x = *remapped.find(s); // key: state, value: map[state] -> set of symbols.
+
+      // Order the cases by how often they were taken in the profile.
+      std::vector<std::pair<state, std::set<symbol> > > edges(std::begin(x.second), std::end(x.second));
+      if (!profile.empty()) {
+	std::stable_sort(std::begin(edges), std::end(edges),
+			 [&](const std::pair<state, std::set<symbol> > &a,
+			     const std::pair<state, std::set<symbol> > &b) {
+			   return profile.getEdgeCount(s, a.first) > profile.getEdgeCount(s, b.first);
+			 });
+      }
+
+      os << "s" << x.first << ":" << std::endl;
+      if (options.instrument && !push) {
+	os << indent << "++profileStateVisits[" << x.first << "];" << std::endl;
+      }
+
+      if (hotStates.count(s) && !edges.empty() &&
+	  profile.getEdgeCount(s, edges[0].first) >= dominantEdgeShare * profile.getStateVisits(s)) {
+	os << indent << "if (LEXER_LIKELY(";
+	emitSymbolCondition(os, edges[0].second);
+	os << ")) {" << std::endl;
+	emitActions(os, liveActions[edges[0].first], edges[0].second);
+	os << indent << indent << "++curr;" << std::endl;
+	if (options.instrument && !push) {
+	  os << indent << indent << "++profileEdgeCounts[" << edgeIds[{s, edges[0].first}] << "];" << std::endl;
+	}
+	os << indent << indent << "goto s" << edges[0].first << ";" << std::endl;
+	os << indent << "}" << std::endl;
+      }
+
+      os << indent << "switch (*curr) {" << std::endl;
+      if (x.first != rejectState) {
+	for (auto y : edges) {	// key: state, value: set of symbols
+	  for (auto z : y.second) { // z is a symbol. Iterating over all edges that end in state y coming from x.
+	    os << indent << "case " << static_cast<int>(z.val) << ":" << std::endl;
+	  }
+	  emitActions(os, liveActions[y.first], y.second);
+	  os << indent << indent << "++curr;" << std::endl;
+	  if (options.instrument && !push) {
+	    os << indent << indent << "++profileEdgeCounts[" << edgeIds[{s, y.first}] << "];" << std::endl;
+	  }
+	  os << indent << indent << "goto s" << y.first << ";" << std::endl;
+	}
+      }
 
-    ccFile << indent << "default: " << std::endl;
-    if (a == lexer::REJECT) {
       if (x.first == d.getInitialState()) {
-	ccFile << indent << indent << "++curr;" << std::endl;
+	os << indent << "case 0:" << std::endl;
+	emitReturn("END_OF_FILE", token_action::NONE);
+      }
+      
+      acceptType a = d.getAcceptTypeForState(x.first, lexer::REJECT);
+
+      os << indent << "default: " << std::endl;
+      if (a == lexer::REJECT) {
+	if (x.first == d.getInitialState()) {
+	  if (options.bulkInvalid) {
+	    os << indent << indent << "curr = " << (options.pushApi ? "detail::" : "") << "skipInvalidRun(curr);" << std::endl;
+	  } else {
+	    os << indent << indent << "++curr;" << std::endl;
+	  }
+	}
+	emitReturn("INVALID", token_action::NONE);
+      } else if (names[a-1][0] == '_') { // ignore => go back to start.
+	if (!push) {
+	  os << indent << indent << "LEXER_RECORD_SKIPPED();" << std::endl;
+	}
+	os << indent << indent << "goto beginning;" << std::endl;
+      } else {
+	emitReturn(names[a-1], actionOf[a]);
+      }
+
+      os << indent << "}" << std::endl;
+    }
+  };
+
+  std::stringstream pushApi;
+  if (options.pushApi) {
+    pushApi << "// Calls handler(const Token&) for every token of the 0 terminated str," << std::endl;
+    pushApi << "// END_OF_FILE excluded, until the handler returns false. Returns where" << std::endl;
+    pushApi << "// it stopped: behind the last token handled, or at the terminating 0." << std::endl;
+    pushApi << "// The scanner is inlined into the caller together with the handler." << std::endl;
+    pushApi << "template<typename Handler>" << std::endl;
+    pushApi << "inline const char *tokenize(const char *str, Handler &&handler) {" << std::endl;
+    emitMachine(pushApi, true);
+    pushApi << "}" << std::endl << std::endl;
+  }
+
+  bool internTable = usedActions & actionBit(token_action::INTERN);
+  emit_header(hhFile, names, options, usedActions != 0, internTable, pushApi.str());
+  
+  emit_includes(ccFile, options);
+
+  if (internTable && !options.checkpoints) {
+    ccFile << "#include <cstring>" << std::endl << std::endl;
+  }
+
+  if (options.bulkInvalid) {
+    ccFile << "#include <stdint.h>" << std::endl;
+    ccFile << "#if defined(__SSSE3__) && defined(__GNUC__)" << std::endl;
+    ccFile << "#include <tmmintrin.h>" << std::endl;
+    ccFile << "#endif" << std::endl << std::endl;
+  }
+  
+  ccFile << "namespace lexer {" << std::endl << std::endl;
+
+  emit_common(ccFile, names, options);
+
+  if (options.bulkInvalid) {
+    // An INVALID run ends at the first byte the initial state has an edge
+    // on, or at the terminating 0.
+    bool stops[256] = { true };
+    for (auto y : remapped[q0]) {
+      for (auto z : y.second) {
+	stops[z.val] = true;
       }
-      ccFile << indent << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
-      ccFile << indent << indent << "return Token{reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), TokenType::INVALID};" << std::endl;
-    } else if (names[a-1][0] == '_') { // ignore => go back to start.
-      ccFile << indent << indent << "goto beginning;" << std::endl;
-    } else {
-      ccFile << indent << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
-      ccFile << indent << indent << "return Token{reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), TokenType::" << names[a-1] << "};" << std::endl;
     }
 
+    // With the push API the header declares skipInvalidRun for tokenize.
+    ccFile << (options.pushApi ? "namespace detail {" : "namespace {") << std::endl << std::endl;
+    ccFile << "const bool stopsInvalidRun[256] = {";
+    for (int i = 0; i < 256; ++i) {
+      if (i % 32 == 0) ccFile << std::endl << indent;
+      ccFile << stops[i] << (i < 255 ? "," : "");
+    }
+    ccFile << std::endl << "};" << std::endl << std::endl;
+
+    // Bitmaps for the SSSE3 membership test. Byte b is a stop byte iff bit
+    // (b >> 4) & 7 of lowNibbleRows[b >> 7][b & 15] is set.
+    int lowNibbleRows[2][16] = {};
+    for (int b = 0; b < 256; ++b) {
+      if (stops[b]) {
+	lowNibbleRows[b >> 7][b & 15] |= 1 << ((b >> 4) & 7);
+      }
+    }
+
+    ccFile << "// Skips a run of bytes that cannot start a token. The byte at curr" << std::endl;
+    ccFile << "// is known to be one of them." << std::endl;
+    ccFile << "const uint8_t *skipInvalidRun(const uint8_t *curr) {" << std::endl;
+    ccFile << indent << "++curr;" << std::endl;
+    ccFile << "#if defined(__SSSE3__) && defined(__GNUC__)" << std::endl;
+    for (int h = 0; h < 2; ++h) {
+      ccFile << indent << "const __m128i rows" << h << " = _mm_setr_epi8(";
+      for (int i = 0; i < 16; ++i) {
+	ccFile << (i ? ", " : "") << "static_cast<char>(" << lowNibbleRows[h][i] << ")";
+      }
+      ccFile << ");" << std::endl;
+    }
+    ccFile << indent << "const __m128i highBit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(128), 1, 2, 4, 8, 16, 32, 64, static_cast<char>(128));" << std::endl;
+    ccFile << indent << "const __m128i nibble = _mm_set1_epi8(0x0f);" << std::endl;
+    ccFile << indent << "const __m128i eight = _mm_set1_epi8(8);" << std::endl << std::endl;
+    ccFile << indent << "// Aligned loads never cross into the next page, so reading past the" << std::endl;
+    ccFile << indent << "// terminating 0 within a block is safe." << std::endl;
+    ccFile << indent << "const uint8_t *block = reinterpret_cast<const uint8_t*>(reinterpret_cast<uintptr_t>(curr) & ~uintptr_t(15));" << std::endl;
+    ccFile << indent << "unsigned valid = (0xffffu << (curr - block)) & 0xffffu;" << std::endl;
+    ccFile << indent << "for (;;) {" << std::endl;
+    ccFile << indent << indent << "__m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(block));" << std::endl;
+    ccFile << indent << indent << "__m128i lo = _mm_and_si128(v, nibble);" << std::endl;
+    ccFile << indent << indent << "__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);" << std::endl;
+    ccFile << indent << indent << "__m128i lowHalf = _mm_cmpgt_epi8(eight, hi);" << std::endl;
+    ccFile << indent << indent << "__m128i row = _mm_or_si128(_mm_and_si128(lowHalf, _mm_shuffle_epi8(rows0, lo))," << std::endl;
+    ccFile << indent << indent << "                           _mm_andnot_si128(lowHalf, _mm_shuffle_epi8(rows1, lo)));" << std::endl;
+    ccFile << indent << indent << "__m128i miss = _mm_cmpeq_epi8(_mm_and_si128(row, _mm_shuffle_epi8(highBit, hi)), _mm_setzero_si128());" << std::endl;
+    ccFile << indent << indent << "unsigned stops = ~_mm_movemask_epi8(miss) & valid;" << std::endl;
+    ccFile << indent << indent << "if (stops) {" << std::endl;
+    ccFile << indent << indent << indent << "return block + __builtin_ctz(stops);" << std::endl;
+    ccFile << indent << indent << "}" << std::endl;
+    ccFile << indent << indent << "block += 16;" << std::endl;
+    ccFile << indent << indent << "valid = 0xffffu;" << std::endl;
+    ccFile << indent << "}" << std::endl;
+    ccFile << "#else" << std::endl;
+    ccFile << indent << "while (!stopsInvalidRun[*curr]) ++curr;" << std::endl;
+    ccFile << indent << "return curr;" << std::endl;
+    ccFile << "#endif" << std::endl;
+    ccFile << "}" << std::endl << std::endl;
+    ccFile << (options.pushApi ? "} // end namespace detail" : "} // end unnamed namespace") << std::endl << std::endl;
+  }
+
+  if (options.instrument) {
+    size_t numberOfEdges = std::max<size_t>(edgeIds.size(), 1);
+    ccFile << "static uint64_t profileStateVisits[" << numberOfStates << "];" << std::endl;
+    ccFile << "static uint64_t profileEdgeCounts[" << numberOfEdges << "];" << std::endl;
+    ccFile << "static const uint32_t profileEdges[" << numberOfEdges << "][2] = {";
+    bool first = true;
+    for (auto e : edgeIds) {
+      if (!first) ccFile << ",";
+      first = false;
+      ccFile << std::endl << indent << "{" << e.first.first << ", " << e.first.second << "}";
+    }
+    if (edgeIds.empty()) {
+      ccFile << std::endl << indent << "{0, 0}";
+    }
+    ccFile << std::endl << "};" << std::endl << std::endl;
+
+    ccFile << "void writeProfile(std::ostream &os) {" << std::endl;
+    ccFile << indent << "os << \"lexer-profile 2 " << numberOfStates << " " << fingerprint(d) << "\" << std::endl;" << std::endl;
+    ccFile << indent << "for (uint32_t s = 0; s < " << numberOfStates << "; ++s) {" << std::endl;
+    ccFile << indent << indent << "os << \"s \" << s << ' ' << profileStateVisits[s] << std::endl;" << std::endl;
+    ccFile << indent << "}" << std::endl;
+    ccFile << indent << "for (uint32_t e = 0; e < " << edgeIds.size() << "; ++e) {" << std::endl;
+    ccFile << indent << indent << "os << \"e \" << profileEdges[e][0] << ' ' << profileEdges[e][1] << ' ' << profileEdgeCounts[e] << std::endl;" << std::endl;
     ccFile << indent << "}" << std::endl;
+    ccFile << "}" << std::endl << std::endl;
   }
 
+  ccFile << "Token Tokenizer::getNextToken() {" << std::endl << std::endl;
+  
+  ccFile << std::endl;
+  emitMachine(ccFile, false);
+
   ccFile << std::endl << "}" << std::endl << std::endl;
 
+  if (internTable) {
+    emit_intern_table(ccFile);
+  }
+
   ccFile << "} // end namespace lexer" << std::endl;
 }
+
+void lexer::cpp_emitter::emit_intern_table(std::ostream &ccFile) {
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+
+  ccFile << "InternTable::InternTable() : slots(64, Slot{0, EMPTY}) {}" << std::endl << std::endl;
+
+  ccFile << "uint32_t InternTable::intern(const Token &tkn) {" << std::endl;
+  ccFile << indent << "size_t length = tkn.curr - tkn.start;" << std::endl;
+  ccFile << indent << "size_t mask = slots.size() - 1;" << std::endl;
+  ccFile << indent << "for (size_t i = tkn.value & mask; ; i = (i + 1) & mask) {" << std::endl;
+  ccFile << i2 << "Slot &s = slots[i];" << std::endl;
+  ccFile << i2 << "if (s.id == EMPTY) {" << std::endl;
+  ccFile << i3 << "uint32_t id = lexemes.size();" << std::endl;
+  ccFile << i3 << "s = Slot{tkn.value, id};" << std::endl;
+  ccFile << i3 << "lexemes.emplace_back(tkn.start, length);" << std::endl;
+  ccFile << i3 << "if (lexemes.size() * 2 > slots.size()) grow();" << std::endl;
+  ccFile << i3 << "return id;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "if (s.hash == tkn.value && lexemes[s.id].size() == length &&" << std::endl;
+  ccFile << i2 << "    std::memcmp(lexemes[s.id].data(), tkn.start, length) == 0) {" << std::endl;
+  ccFile << i3 << "return s.id;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+
+  ccFile << "void InternTable::grow() {" << std::endl;
+  ccFile << indent << "std::vector<Slot> old(slots.size() * 2, Slot{0, EMPTY});" << std::endl;
+  ccFile << indent << "old.swap(slots);" << std::endl;
+  ccFile << indent << "size_t mask = slots.size() - 1;" << std::endl;
+  ccFile << indent << "for (auto &s : old) {" << std::endl;
+  ccFile << i2 << "if (s.id == EMPTY) continue;" << std::endl;
+  ccFile << i2 << "size_t i = s.hash & mask;" << std::endl;
+  ccFile << i2 << "while (slots[i].id != EMPTY) i = (i + 1) & mask;" << std::endl;
+  ccFile << i2 << "slots[i] = s;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+}
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "DFA.hh"
+#include "emit_options.hh"
 #include "parser.hh"
 
 namespace lexer {
@@ -13,7 +14,47 @@ namespace lexer {
   struct cpp_emitter {
     static void emit_dfa(const DFA & d, 
 			 std::vector<tkn_rule> &tkn_rules,
-			 const std::string &outputDirectory);
+			 const std::string &outputDirectory,
+			 const emit_options &options = emit_options());
+
+    // Writes tokenizer.hh: TokenType, Token and Tokenizer. With
+    // tokenValues Token gets the value member computed by rule actions,
+    // and with internTable the InternTable class is declared.
+    // inlineDefinitions go at the end, e.g. the tokenize template.
+    static void emit_header(std::ostream &hhFile,
+			    const std::vector<std::string> &names,
+			    const emit_options &options,
+			    bool tokenValues = false,
+			    bool internTable = false,
+			    const std::string &inlineDefinitions = "");
+
+    // Writes the includes at the top of tokenizer.cc.
+    static void emit_includes(std::ostream &ccFile,
+			      const emit_options &options);
+
+    // Writes the parts of tokenizer.cc every lexer shares: printing of
+    // TokenType, the macros used by getNextToken and the functions
+    // options.incremental, options.checkpoints, options.lineIndex and
+    // options.filePipeline ask for.
+    static void emit_common(std::ostream &ccFile,
+			    const std::vector<std::string> &names,
+			    const emit_options &options);
+
+    // Writes tokenizeSpans() and relex() on top of Tokenizer.
+    static void emit_relex(std::ostream &ccFile);
+
+    // Writes LineIndex on top of the buffer, not the Tokenizer.
+    static void emit_line_index(std::ostream &ccFile);
+
+    // Writes FileTokenizer, which runs a Tokenizer over a file read on
+    // another thread.
+    static void emit_file_pipeline(std::ostream &ccFile);
+
+    // Writes InternTable, for lexers with {intern} rules.
+    static void emit_intern_table(std::ostream &ccFile);
+
+    // Writes writeCheckpoints() and findCheckpoint() on top of Tokenizer.
+    static void emit_checkpoints(std::ostream &ccFile);
 
   };
 
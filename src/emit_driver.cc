@@ -0,0 +1,510 @@
+#include "emit_driver.hh"
+
+#include <fstream>
+#include <stdexcept>
+
+using namespace lexer;
+
+const std::string indent = "    ";
+
+void lexer::driver_emitter::emit_driver(const std::string &outputDirectory) {
+
+  std::string ccFilename = outputDirectory + "lex_files.cc";
+
+  std::ofstream ccFile(ccFilename);
+
+  if (ccFile.fail()) {
+    throw std::runtime_error("Could not open: " + ccFilename);
+  }
+
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+  const std::string i4 = i3 + indent;
+
+  ccFile << "// Tokenizes many files on all cores with the lexer in tokenizer.cc." << std::endl;
+  ccFile << "//" << std::endl;
+  ccFile << "// Usage: lex_files [-j <threads>] [-o <output>] <file>..." << std::endl;
+  ccFile << "//        lex_files [-j <threads>] [-o <output>] - < file_list" << std::endl;
+  ccFile << "//" << std::endl;
+  ccFile << "// Each worker takes files from its own queue and steals from the others" << std::endl;
+  ccFile << "// when it runs dry. With -o the tokens of a file go into the arena of" << std::endl;
+  ccFile << "// the worker that lexed it, and the output is written in the order of the" << std::endl;
+  ccFile << "// file list whatever the scheduling was. Build with" << std::endl;
+  ccFile << "// g++ -O2 -pthread tokenizer.cc lex_files.cc -o lex_files" << std::endl << std::endl;
+  ccFile << "#include \"tokenizer.hh\"" << std::endl << std::endl;
+  ccFile << "#include <chrono>" << std::endl;
+  ccFile << "#include <cstdio>" << std::endl;
+  ccFile << "#include <cstdlib>" << std::endl;
+  ccFile << "#include <cstring>" << std::endl;
+  ccFile << "#include <deque>" << std::endl;
+  ccFile << "#include <fcntl.h>" << std::endl;
+  ccFile << "#include <fstream>" << std::endl;
+  ccFile << "#include <iostream>" << std::endl;
+  ccFile << "#include <mutex>" << std::endl;
+  ccFile << "#include <string>" << std::endl;
+  ccFile << "#include <sys/mman.h>" << std::endl;
+  ccFile << "#include <sys/stat.h>" << std::endl;
+  ccFile << "#include <thread>" << std::endl;
+  ccFile << "#include <unistd.h>" << std::endl;
+  ccFile << "#include <vector>" << std::endl << std::endl;
+  ccFile << "namespace {" << std::endl << std::endl;
+  ccFile << "struct TokenRecord {" << std::endl;
+  ccFile << indent << "uint64_t offset;" << std::endl;
+  ccFile << indent << "uint32_t length;" << std::endl;
+  ccFile << indent << "lexer::TokenType tkn;" << std::endl;
+  ccFile << "};" << std::endl << std::endl;
+  ccFile << "// Where the tokens of a file ended up." << std::endl;
+  ccFile << "struct FileResult {" << std::endl;
+  ccFile << indent << "size_t worker = 0;" << std::endl;
+  ccFile << indent << "size_t first = 0, count = 0;" << std::endl;
+  ccFile << indent << "uint64_t bytes = 0;" << std::endl;
+  ccFile << indent << "bool failed = false;" << std::endl;
+  ccFile << "};" << std::endl << std::endl;
+  ccFile << "struct Worker {" << std::endl;
+  ccFile << indent << "std::mutex mutex;" << std::endl;
+  ccFile << indent << "std::deque<size_t> queue;" << std::endl;
+  ccFile << indent << "// Tokens of the files this worker lexed, one file after the other," << std::endl;
+  ccFile << indent << "// kept until they are written in the order of the file list. Only" << std::endl;
+  ccFile << indent << "// filled when there is an output." << std::endl;
+  ccFile << indent << "std::vector<TokenRecord> arena;" << std::endl;
+  ccFile << "};" << std::endl << std::endl;
+  ccFile << "// Maps a file so that a 0 follows its last byte. The bytes past the end" << std::endl;
+  ccFile << "// of the file in its last page are 0. When the file ends on a page" << std::endl;
+  ccFile << "// boundary the mapping is placed in front of an anonymous zero page." << std::endl;
+  ccFile << "const char *mapFile(const std::string &filename, size_t &size, size_t &mapped) {" << std::endl;
+  ccFile << indent << "int fd = open(filename.c_str(), O_RDONLY);" << std::endl;
+  ccFile << indent << "if (fd < 0) return nullptr;" << std::endl;
+  ccFile << indent << "struct stat st;" << std::endl;
+  ccFile << indent << "if (fstat(fd, &st) != 0) {" << std::endl;
+  ccFile << i2 << "close(fd);" << std::endl;
+  ccFile << i2 << "return nullptr;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "size = st.st_size;" << std::endl;
+  ccFile << indent << "size_t page = sysconf(_SC_PAGESIZE);" << std::endl;
+  ccFile << indent << "mapped = (size / page + 1) * page;" << std::endl;
+  ccFile << indent << "void *base = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);" << std::endl;
+  ccFile << indent << "if (base == MAP_FAILED) {" << std::endl;
+  ccFile << i2 << "close(fd);" << std::endl;
+  ccFile << i2 << "return nullptr;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "if (size && mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {" << std::endl;
+  ccFile << i2 << "munmap(base, mapped);" << std::endl;
+  ccFile << i2 << "close(fd);" << std::endl;
+  ccFile << i2 << "return nullptr;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "close(fd);" << std::endl;
+  ccFile << "#if defined(MADV_SEQUENTIAL)" << std::endl;
+  ccFile << indent << "madvise(base, mapped, MADV_SEQUENTIAL);" << std::endl;
+  ccFile << "#endif" << std::endl;
+  ccFile << indent << "return static_cast<const char*>(base);" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "void lexFile(const std::string &filename, Worker &w, size_t id, bool record, FileResult &r) {" << std::endl;
+  ccFile << indent << "r.worker = id;" << std::endl;
+  ccFile << indent << "r.first = w.arena.size();" << std::endl;
+  ccFile << indent << "size_t size, mapped;" << std::endl;
+  ccFile << indent << "const char *str = mapFile(filename, size, mapped);" << std::endl;
+  ccFile << indent << "if (!str) {" << std::endl;
+  ccFile << i2 << "r.failed = true;" << std::endl;
+  ccFile << i2 << "return;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "lexer::Tokenizer t(str);" << std::endl;
+  ccFile << indent << "size_t count = 0;" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "lexer::Token tkn = t.getNextToken();" << std::endl;
+  ccFile << i2 << "if (tkn.tkn == lexer::TokenType::END_OF_FILE) break;" << std::endl;
+  ccFile << i2 << "if (record) {" << std::endl;
+  ccFile << i3 << "w.arena.push_back(TokenRecord{uint64_t(tkn.start - str), uint32_t(tkn.curr - tkn.start), tkn.tkn});" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "++count;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "r.count = count;" << std::endl;
+  ccFile << indent << "r.bytes = size;" << std::endl;
+  ccFile << indent << "munmap(const_cast<char*>(str), mapped);" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "bool takeOwn(Worker &w, size_t &file) {" << std::endl;
+  ccFile << indent << "std::lock_guard<std::mutex> lock(w.mutex);" << std::endl;
+  ccFile << indent << "if (w.queue.empty()) return false;" << std::endl;
+  ccFile << indent << "file = w.queue.back();" << std::endl;
+  ccFile << indent << "w.queue.pop_back();" << std::endl;
+  ccFile << indent << "return true;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "bool steal(std::vector<Worker> &workers, size_t thief, size_t &file) {" << std::endl;
+  ccFile << indent << "for (size_t i = 1; i < workers.size(); ++i) {" << std::endl;
+  ccFile << i2 << "Worker &victim = workers[(thief + i) % workers.size()];" << std::endl;
+  ccFile << i2 << "std::lock_guard<std::mutex> lock(victim.mutex);" << std::endl;
+  ccFile << i2 << "if (victim.queue.empty()) continue;" << std::endl;
+  ccFile << i2 << "file = victim.queue.front();" << std::endl;
+  ccFile << i2 << "victim.queue.pop_front();" << std::endl;
+  ccFile << i2 << "return true;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "return false;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "void work(std::vector<Worker> &workers, size_t id, bool record," << std::endl;
+  ccFile << "          const std::vector<std::string> &files, std::vector<FileResult> &results) {" << std::endl;
+  ccFile << indent << "// Files are never added, so once every queue is empty the work is done." << std::endl;
+  ccFile << indent << "size_t file;" << std::endl;
+  ccFile << indent << "while (takeOwn(workers[id], file) || steal(workers, id, file)) {" << std::endl;
+  ccFile << i2 << "lexFile(files[file], workers[id], id, record, results[file]);" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "void printUsage(std::ostream &o) {" << std::endl;
+  ccFile << indent << "o << \"Usage: lex_files [-j <threads>] [-o <output>] <file>...\" << std::endl;" << std::endl;
+  ccFile << indent << "o << \"       lex_files [-j <threads>] [-o <output>] - < file_list\" << std::endl;" << std::endl;
+  ccFile << indent << "o << \"Writes '<file> <offset> <length> <type>' per token to <output> in the\" << std::endl;" << std::endl;
+  ccFile << indent << "o << \"order of the files, and the throughput to stderr.\" << std::endl;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "} // end unnamed namespace" << std::endl << std::endl;
+  ccFile << "int main(int argc, char *argv[]) {" << std::endl;
+  ccFile << indent << "size_t threads = std::thread::hardware_concurrency();" << std::endl;
+  ccFile << indent << "std::string output;" << std::endl;
+  ccFile << indent << "std::vector<std::string> files;" << std::endl;
+  ccFile << indent << "for (int i = 1; i < argc; ++i) {" << std::endl;
+  ccFile << i2 << "std::string a = argv[i];" << std::endl;
+  ccFile << i2 << "if (a == \"-j\" && i+1 < argc) {" << std::endl;
+  ccFile << i3 << "threads = std::strtoul(argv[++i], nullptr, 10);" << std::endl;
+  ccFile << i2 << "} else if (a == \"-o\" && i+1 < argc) {" << std::endl;
+  ccFile << i3 << "output = argv[++i];" << std::endl;
+  ccFile << i2 << "} else if (a == \"-\") {" << std::endl;
+  ccFile << i3 << "std::string line;" << std::endl;
+  ccFile << i3 << "while (std::getline(std::cin, line)) {" << std::endl;
+  ccFile << i4 << "if (!line.empty()) files.push_back(line);" << std::endl;
+  ccFile << i3 << "}" << std::endl;
+  ccFile << i2 << "} else if (a == \"-h\" || a == \"--help\") {" << std::endl;
+  ccFile << i3 << "printUsage(std::cout);" << std::endl;
+  ccFile << i3 << "return EXIT_SUCCESS;" << std::endl;
+  ccFile << i2 << "} else {" << std::endl;
+  ccFile << i3 << "files.push_back(a);" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "if (files.empty()) {" << std::endl;
+  ccFile << i2 << "printUsage(std::cerr);" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "if (threads == 0) threads = 1;" << std::endl << std::endl;
+  ccFile << indent << "auto begin = std::chrono::steady_clock::now();" << std::endl << std::endl;
+  ccFile << indent << "// Contiguous runs of the list per worker keep neighbouring files, which" << std::endl;
+  ccFile << indent << "// are often in the same directory, on one core." << std::endl;
+  ccFile << indent << "std::vector<Worker> workers(threads);" << std::endl;
+  ccFile << indent << "for (size_t i = 0; i < files.size(); ++i) {" << std::endl;
+  ccFile << i2 << "workers[i * threads / files.size()].queue.push_back(i);" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "std::vector<FileResult> results(files.size());" << std::endl;
+  ccFile << indent << "std::vector<std::thread> pool;" << std::endl;
+  ccFile << indent << "for (size_t i = 1; i < threads; ++i) {" << std::endl;
+  ccFile << i2 << "pool.emplace_back(work, std::ref(workers), i, !output.empty(), std::cref(files), std::ref(results));" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "work(workers, 0, !output.empty(), files, results);" << std::endl;
+  ccFile << indent << "for (auto &t : pool) {" << std::endl;
+  ccFile << i2 << "t.join();" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "auto lexed = std::chrono::steady_clock::now();" << std::endl << std::endl;
+  ccFile << indent << "uint64_t bytes = 0, tokens = 0;" << std::endl;
+  ccFile << indent << "size_t failed = 0;" << std::endl;
+  ccFile << indent << "for (size_t i = 0; i < files.size(); ++i) {" << std::endl;
+  ccFile << i2 << "const FileResult &r = results[i];" << std::endl;
+  ccFile << i2 << "if (r.failed) {" << std::endl;
+  ccFile << i3 << "std::cerr << \"Could not read: \" << files[i] << std::endl;" << std::endl;
+  ccFile << i3 << "++failed;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "bytes += r.bytes;" << std::endl;
+  ccFile << i2 << "tokens += r.count;" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "if (!output.empty()) {" << std::endl;
+  ccFile << i2 << "std::ofstream os(output);" << std::endl;
+  ccFile << i2 << "if (os.fail()) {" << std::endl;
+  ccFile << i3 << "std::cerr << \"Could not open: \" << output << std::endl;" << std::endl;
+  ccFile << i3 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << i2 << "for (size_t i = 0; i < files.size(); ++i) {" << std::endl;
+  ccFile << i3 << "const FileResult &r = results[i];" << std::endl;
+  ccFile << i3 << "const TokenRecord *tkn = workers[r.worker].arena.data() + r.first;" << std::endl;
+  ccFile << i3 << "for (size_t k = 0; k < r.count; ++k) {" << std::endl;
+  ccFile << i4 << "os << files[i] << ' ' << tkn[k].offset << ' ' << tkn[k].length << ' ' << tkn[k].tkn << '\\n';" << std::endl;
+  ccFile << i3 << "}" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "double seconds = std::chrono::duration<double>(lexed - begin).count();" << std::endl;
+  ccFile << indent << "std::cerr << files.size() << \" files, \" << bytes << \" bytes, \" << tokens << \" tokens in \"" << std::endl;
+  ccFile << "              << seconds << \" s on \" << threads << \" threads: \"" << std::endl;
+  ccFile << "              << bytes / seconds / 1e6 << \" MB/s, \" << tokens / seconds / 1e6 << \" Mtokens/s\" << std::endl;" << std::endl;
+  ccFile << indent << "return failed ? EXIT_FAILURE : EXIT_SUCCESS;" << std::endl;
+  ccFile << "}" << std::endl;
+
+}
+
+void lexer::driver_emitter::emit_token_stream(const std::string &outputDirectory) {
+
+  std::string hhFilename = outputDirectory + "token_stream.hh";
+  std::string ccFilename = outputDirectory + "tokenize.cc";
+
+  std::ofstream hhFile(hhFilename);
+  std::ofstream ccFile(ccFilename);
+
+  if (hhFile.fail()) {
+    throw std::runtime_error("Could not open: " + hhFilename);
+  }
+  if (ccFile.fail()) {
+    throw std::runtime_error("Could not open: " + ccFilename);
+  }
+
+  const std::string i2 = indent + indent;
+  const std::string i3 = i2 + indent;
+  const std::string i4 = i3 + indent;
+
+  hhFile << "#ifndef TOKEN_STREAM_HH_GUARD" << std::endl;
+  hhFile << "#define TOKEN_STREAM_HH_GUARD" << std::endl << std::endl;
+  hhFile << "// A compact binary format for the tokens of a buffer. After a" << std::endl;
+  hhFile << "// TokenStreamHeader every token is three LEB128 varints: the gap from" << std::endl;
+  hhFile << "// the end of the previous token to its start, its length and its type." << std::endl;
+  hhFile << "// With a block index every blockSize tokens start a block whose first" << std::endl;
+  hhFile << "// gap is from the position in its TokenStreamBlock, so a reader can" << std::endl;
+  hhFile << "// start at any block. Numbers are in the byte order of the writer." << std::endl << std::endl;
+  hhFile << "#include <cstring>" << std::endl;
+  hhFile << "#include <ostream>" << std::endl;
+  hhFile << "#include <stdint.h>" << std::endl;
+  hhFile << "#include <string>" << std::endl;
+  hhFile << "#include <vector>" << std::endl << std::endl;
+  hhFile << "namespace lexer {" << std::endl << std::endl;
+  hhFile << "struct TokenStreamHeader {" << std::endl;
+  hhFile << indent << "char magic[8];" << std::endl;
+  hhFile << indent << "uint32_t version;" << std::endl;
+  hhFile << indent << "// Tokens per block of the index, 0 without index." << std::endl;
+  hhFile << indent << "uint32_t blockSize;" << std::endl;
+  hhFile << indent << "uint64_t tokenCount;" << std::endl;
+  hhFile << indent << "uint64_t dataOffset, dataSize;" << std::endl;
+  hhFile << indent << "// Offset of TokenStreamBlock[blocks], 0 without index." << std::endl;
+  hhFile << indent << "uint64_t indexOffset;" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+  hhFile << "struct TokenStreamBlock {" << std::endl;
+  hhFile << indent << "// Offset of the first token of the block from dataOffset." << std::endl;
+  hhFile << indent << "uint64_t dataOffset;" << std::endl;
+  hhFile << indent << "// End of the token in front of the block." << std::endl;
+  hhFile << indent << "uint64_t position;" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+  hhFile << "struct StreamToken {" << std::endl;
+  hhFile << indent << "uint64_t start, length;" << std::endl;
+  hhFile << indent << "uint32_t type;" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+  hhFile << "const char tokenStreamMagic[8] = { 'L', 'E', 'X', 'T', 'O', 'K', 'S', 0 };" << std::endl;
+  hhFile << "const uint32_t tokenStreamVersion = 1;" << std::endl << std::endl;
+  hhFile << "class TokenStreamWriter {" << std::endl;
+  hhFile << "public:" << std::endl;
+  hhFile << indent << "explicit TokenStreamWriter(uint32_t blockSize = 0) : blockSize(blockSize), count(0), position(0) {}" << std::endl << std::endl;
+  hhFile << indent << "// Tokens must be added in order and must not overlap." << std::endl;
+  hhFile << indent << "void add(uint64_t start, uint64_t length, uint32_t type) {" << std::endl;
+  hhFile << i2 << "if (blockSize && count % blockSize == 0) {" << std::endl;
+  hhFile << i3 << "index.push_back(TokenStreamBlock{data.size(), position});" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << i2 << "putVarint(start - position);" << std::endl;
+  hhFile << i2 << "putVarint(length);" << std::endl;
+  hhFile << i2 << "putVarint(type);" << std::endl;
+  hhFile << i2 << "position = start + length;" << std::endl;
+  hhFile << i2 << "++count;" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "void write(std::ostream &os) const {" << std::endl;
+  hhFile << i2 << "TokenStreamHeader h;" << std::endl;
+  hhFile << i2 << "std::memset(&h, 0, sizeof(h));" << std::endl;
+  hhFile << i2 << "std::memcpy(h.magic, tokenStreamMagic, sizeof(h.magic));" << std::endl;
+  hhFile << i2 << "h.version = tokenStreamVersion;" << std::endl;
+  hhFile << i2 << "h.blockSize = blockSize;" << std::endl;
+  hhFile << i2 << "h.tokenCount = count;" << std::endl;
+  hhFile << i2 << "h.dataOffset = sizeof(h);" << std::endl;
+  hhFile << i2 << "h.dataSize = data.size();" << std::endl;
+  hhFile << i2 << "// The index is kept 8 byte aligned for readers using it in place." << std::endl;
+  hhFile << i2 << "size_t padding = (8 - (sizeof(h) + data.size()) % 8) % 8;" << std::endl;
+  hhFile << i2 << "h.indexOffset = blockSize ? sizeof(h) + data.size() + padding : 0;" << std::endl;
+  hhFile << i2 << "os.write(reinterpret_cast<const char*>(&h), sizeof(h));" << std::endl;
+  hhFile << i2 << "os.write(data.data(), data.size());" << std::endl;
+  hhFile << i2 << "if (blockSize) {" << std::endl;
+  hhFile << i3 << "os.write(\"\\0\\0\\0\\0\\0\\0\\0\", padding);" << std::endl;
+  hhFile << i3 << "os.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(TokenStreamBlock));" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << "private:" << std::endl;
+  hhFile << indent << "void putVarint(uint64_t v) {" << std::endl;
+  hhFile << i2 << "while (v >= 0x80) {" << std::endl;
+  hhFile << i3 << "data.push_back(static_cast<char>(v | 0x80));" << std::endl;
+  hhFile << i3 << "v >>= 7;" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << i2 << "data.push_back(static_cast<char>(v));" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "uint32_t blockSize;" << std::endl;
+  hhFile << indent << "uint64_t count;" << std::endl;
+  hhFile << indent << "uint64_t position;" << std::endl;
+  hhFile << indent << "std::string data;" << std::endl;
+  hhFile << indent << "std::vector<TokenStreamBlock> index;" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+  hhFile << "// Iterates the tokens of a stream in place, e.g. in a mapped file." << std::endl;
+  hhFile << "class TokenStreamReader {" << std::endl;
+  hhFile << "public:" << std::endl;
+  hhFile << indent << "// valid() is false when data of size bytes is not a token stream." << std::endl;
+  hhFile << indent << "TokenStreamReader(const void *data, size_t size) : begin(nullptr), curr(nullptr), end(nullptr)," << std::endl;
+  hhFile << "                                                       index(nullptr), blocks(0), position(0), remaining(0) {" << std::endl;
+  hhFile << i2 << "std::memset(&h, 0, sizeof(h));" << std::endl;
+  hhFile << i2 << "if (size < sizeof(h)) return;" << std::endl;
+  hhFile << i2 << "std::memcpy(&h, data, sizeof(h));" << std::endl;
+  hhFile << i2 << "if (std::memcmp(h.magic, tokenStreamMagic, sizeof(h.magic)) != 0 || h.version != tokenStreamVersion ||" << std::endl;
+  hhFile << i3 << "h.dataOffset > size || h.dataSize > size - h.dataOffset) return;" << std::endl;
+  hhFile << i2 << "const uint8_t *base = static_cast<const uint8_t*>(data);" << std::endl;
+  hhFile << i2 << "if (h.blockSize) {" << std::endl;
+  hhFile << i3 << "uint64_t n = (h.tokenCount + h.blockSize - 1) / h.blockSize;" << std::endl;
+  hhFile << i3 << "if (h.indexOffset % 8 || h.indexOffset > size ||" << std::endl;
+  hhFile << i4 << "n > (size - h.indexOffset) / sizeof(TokenStreamBlock)) return;" << std::endl;
+  hhFile << i3 << "index = reinterpret_cast<const TokenStreamBlock*>(base + h.indexOffset);" << std::endl;
+  hhFile << i3 << "blocks = n;" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << i2 << "begin = base + h.dataOffset;" << std::endl;
+  hhFile << i2 << "curr = begin;" << std::endl;
+  hhFile << i2 << "end = begin + h.dataSize;" << std::endl;
+  hhFile << i2 << "remaining = h.tokenCount;" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "bool valid() const { return curr != nullptr; }" << std::endl;
+  hhFile << indent << "uint64_t size() const { return h.tokenCount; }" << std::endl << std::endl;
+  hhFile << indent << "// Number of blocks in the index and the index of the block of a token." << std::endl;
+  hhFile << indent << "size_t numberOfBlocks() const { return blocks; }" << std::endl;
+  hhFile << indent << "size_t blockOf(uint64_t token) const { return h.blockSize ? token / h.blockSize : 0; }" << std::endl << std::endl;
+  hhFile << indent << "// Continues with the first token of block b. An index entry pointing" << std::endl;
+  hhFile << indent << "// behind the data damages the stream." << std::endl;
+  hhFile << indent << "void seekBlock(size_t b) {" << std::endl;
+  hhFile << i2 << "if (b >= blocks) return;" << std::endl;
+  hhFile << i2 << "if (index[b].dataOffset > h.dataSize) {" << std::endl;
+  hhFile << i3 << "remaining = 0;" << std::endl;
+  hhFile << i3 << "return;" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << i2 << "curr = begin + index[b].dataOffset;" << std::endl;
+  hhFile << i2 << "position = index[b].position;" << std::endl;
+  hhFile << i2 << "remaining = h.tokenCount - uint64_t(b) * h.blockSize;" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "// Returns false after the last token or when the stream is damaged." << std::endl;
+  hhFile << indent << "bool next(StreamToken &tkn) {" << std::endl;
+  hhFile << i2 << "if (!remaining) return false;" << std::endl;
+  hhFile << i2 << "uint64_t gap, length, type;" << std::endl;
+  hhFile << i2 << "if (!getVarint(gap) || !getVarint(length) || !getVarint(type)) {" << std::endl;
+  hhFile << i3 << "remaining = 0;" << std::endl;
+  hhFile << i3 << "return false;" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << i2 << "tkn.start = position + gap;" << std::endl;
+  hhFile << i2 << "tkn.length = length;" << std::endl;
+  hhFile << i2 << "tkn.type = static_cast<uint32_t>(type);" << std::endl;
+  hhFile << i2 << "position = tkn.start + length;" << std::endl;
+  hhFile << i2 << "--remaining;" << std::endl;
+  hhFile << i2 << "return true;" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << "private:" << std::endl;
+  hhFile << indent << "bool getVarint(uint64_t &v) {" << std::endl;
+  hhFile << i2 << "v = 0;" << std::endl;
+  hhFile << i2 << "for (int shift = 0; curr < end && shift < 64; shift += 7) {" << std::endl;
+  hhFile << i3 << "uint8_t b = *curr++;" << std::endl;
+  hhFile << i3 << "v |= uint64_t(b & 0x7f) << shift;" << std::endl;
+  hhFile << i3 << "if (!(b & 0x80)) return true;" << std::endl;
+  hhFile << i2 << "}" << std::endl;
+  hhFile << i2 << "return false;" << std::endl;
+  hhFile << indent << "}" << std::endl << std::endl;
+  hhFile << indent << "TokenStreamHeader h;" << std::endl;
+  hhFile << indent << "const uint8_t *begin, *curr, *end;" << std::endl;
+  hhFile << indent << "const TokenStreamBlock *index;" << std::endl;
+  hhFile << indent << "size_t blocks;" << std::endl;
+  hhFile << indent << "uint64_t position, remaining;" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+  hhFile << "} // end namespace lexer" << std::endl << std::endl;
+  hhFile << "#endif // TOKEN_STREAM_HH_GUARD" << std::endl;
+
+
+  ccFile << "// Writes the tokens of a file as a token stream, see token_stream.hh," << std::endl;
+  ccFile << "// or prints the tokens of a token stream." << std::endl;
+  ccFile << "//" << std::endl;
+  ccFile << "// Usage: tokenize [-b <block_size>] <input> <output>" << std::endl;
+  ccFile << "//        tokenize -d <token_stream>" << std::endl;
+  ccFile << "//" << std::endl;
+  ccFile << "// Build with g++ -O2 tokenizer.cc tokenize.cc -o tokenize" << std::endl << std::endl;
+  ccFile << "#include \"token_stream.hh\"" << std::endl;
+  ccFile << "#include \"tokenizer.hh\"" << std::endl << std::endl;
+  ccFile << "#include <cstdlib>" << std::endl;
+  ccFile << "#include <fcntl.h>" << std::endl;
+  ccFile << "#include <fstream>" << std::endl;
+  ccFile << "#include <iostream>" << std::endl;
+  ccFile << "#include <sstream>" << std::endl;
+  ccFile << "#include <string>" << std::endl;
+  ccFile << "#include <sys/mman.h>" << std::endl;
+  ccFile << "#include <sys/stat.h>" << std::endl;
+  ccFile << "#include <unistd.h>" << std::endl << std::endl;
+  ccFile << "namespace {" << std::endl << std::endl;
+  ccFile << "void printUsage(std::ostream &o) {" << std::endl;
+  ccFile << indent << "o << \"Usage: tokenize [-b <block_size>] <input> <output>\" << std::endl;" << std::endl;
+  ccFile << indent << "o << \"       tokenize -d <token_stream>\" << std::endl;" << std::endl;
+  ccFile << indent << "o << \"-b adds an index with a block every <block_size> tokens.\" << std::endl;" << std::endl;
+  ccFile << indent << "o << \"-d prints '<offset> <length> <type>' for every token.\" << std::endl;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "int dump(const std::string &filename) {" << std::endl;
+  ccFile << indent << "int fd = open(filename.c_str(), O_RDONLY);" << std::endl;
+  ccFile << indent << "struct stat st;" << std::endl;
+  ccFile << indent << "if (fd < 0 || fstat(fd, &st) != 0) {" << std::endl;
+  ccFile << i2 << "std::cerr << \"Could not open: \" << filename << std::endl;" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "size_t size = st.st_size;" << std::endl;
+  ccFile << indent << "void *data = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;" << std::endl;
+  ccFile << indent << "close(fd);" << std::endl;
+  ccFile << indent << "if (data == MAP_FAILED) {" << std::endl;
+  ccFile << i2 << "std::cerr << \"Could not map: \" << filename << std::endl;" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "lexer::TokenStreamReader r(data, size);" << std::endl;
+  ccFile << indent << "if (!r.valid()) {" << std::endl;
+  ccFile << i2 << "std::cerr << \"Not a token stream: \" << filename << std::endl;" << std::endl;
+  ccFile << i2 << "munmap(data, size);" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "lexer::StreamToken tkn;" << std::endl;
+  ccFile << indent << "while (r.next(tkn)) {" << std::endl;
+  ccFile << i2 << "std::cout << tkn.start << ' ' << tkn.length << ' ' << static_cast<lexer::TokenType>(tkn.type) << '\\n';" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "munmap(data, size);" << std::endl;
+  ccFile << indent << "return EXIT_SUCCESS;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+  ccFile << "} // end unnamed namespace" << std::endl << std::endl;
+  ccFile << "int main(int argc, char *argv[]) {" << std::endl;
+  ccFile << indent << "uint32_t blockSize = 0;" << std::endl;
+  ccFile << indent << "std::vector<std::string> positional;" << std::endl;
+  ccFile << indent << "for (int i = 1; i < argc; ++i) {" << std::endl;
+  ccFile << i2 << "std::string a = argv[i];" << std::endl;
+  ccFile << i2 << "if (a == \"-b\" && i+1 < argc) {" << std::endl;
+  ccFile << i3 << "blockSize = std::strtoul(argv[++i], nullptr, 10);" << std::endl;
+  ccFile << i2 << "} else if (a == \"-d\" && i+1 < argc) {" << std::endl;
+  ccFile << i3 << "return dump(argv[++i]);" << std::endl;
+  ccFile << i2 << "} else if (a == \"-h\" || a == \"--help\") {" << std::endl;
+  ccFile << i3 << "printUsage(std::cout);" << std::endl;
+  ccFile << i3 << "return EXIT_SUCCESS;" << std::endl;
+  ccFile << i2 << "} else {" << std::endl;
+  ccFile << i3 << "positional.push_back(a);" << std::endl;
+  ccFile << i2 << "}" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "if (positional.size() != 2) {" << std::endl;
+  ccFile << i2 << "printUsage(std::cerr);" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "std::ifstream in(positional[0], std::ios::binary);" << std::endl;
+  ccFile << indent << "if (in.fail()) {" << std::endl;
+  ccFile << i2 << "std::cerr << \"Could not open: \" << positional[0] << std::endl;" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "std::stringstream ss;" << std::endl;
+  ccFile << indent << "ss << in.rdbuf();" << std::endl;
+  ccFile << indent << "std::string text = ss.str();" << std::endl << std::endl;
+  ccFile << indent << "lexer::TokenStreamWriter w(blockSize);" << std::endl;
+  ccFile << indent << "lexer::Tokenizer t(text.c_str());" << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << i2 << "lexer::Token tkn = t.getNextToken();" << std::endl;
+  ccFile << i2 << "if (tkn.tkn == lexer::TokenType::END_OF_FILE) break;" << std::endl;
+  ccFile << i2 << "w.add(tkn.start - text.c_str(), tkn.curr - tkn.start, static_cast<uint32_t>(tkn.tkn));" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "std::ofstream out(positional[1], std::ios::binary);" << std::endl;
+  ccFile << indent << "if (out.fail()) {" << std::endl;
+  ccFile << i2 << "std::cerr << \"Could not open: \" << positional[1] << std::endl;" << std::endl;
+  ccFile << i2 << "return EXIT_FAILURE;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "w.write(out);" << std::endl;
+  ccFile << indent << "return EXIT_SUCCESS;" << std::endl;
+  ccFile << "}" << std::endl;
+
+}
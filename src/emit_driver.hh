@@ -0,0 +1,23 @@
+#ifndef EMIT_DRIVER_HH_GUARD
+#define EMIT_DRIVER_HH_GUARD
+
+#include <string>
+
+namespace lexer {
+
+  // Emits programs and runtime support around the tokenizer.hh and
+  // tokenizer.cc emitted by cpp_emitter. None of it depends on the rules.
+  struct driver_emitter {
+    // lex_files.cc: tokenizes a list of files on all cores.
+    static void emit_driver(const std::string &outputDirectory);
+
+    // token_stream.hh: a compact binary format for tokens with a writer
+    // and an in-place reader, and tokenize.cc: writes the token stream
+    // of a file.
+    static void emit_token_stream(const std::string &outputDirectory);
+
+  };
+
+} // end namespace lexer
+
+#endif
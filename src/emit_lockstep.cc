@@ -0,0 +1,168 @@
+#include "emit_lockstep.hh"
+#include "emit_c++.hh"
+#include "DFA.hh"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace lexer;
+
+const std::string indent = "    ";
+
+namespace {
+
+  // Writes the transitions of group g as a dense [state][byte] table with
+  // an extra dead row. Edges on 0, into states that cannot accept and
+  // missing edges go to the dead row. Then the accept types by state.
+  void emitGroup(std::ostream &os, const rule_group &g, size_t i) {
+    const DFA &d = g.dfa;
+    size_t numberOfStates = d.getNumberOfStates();
+    size_t dead = numberOfStates;
+    std::vector<bool> live = d.getLiveStates();
+
+    os << "// Rules";
+    for (auto r : g.rules) {
+      os << " " << r+1;
+    }
+    os << std::endl;
+    os << "const uint32_t dead" << i << " = " << dead << ";" << std::endl;
+    os << "const uint32_t initial" << i << " = "
+       << (live[d.getInitialState()] ? d.getInitialState() : dead) << ";" << std::endl;
+
+    os << "const uint32_t delta" << i << "[" << numberOfStates+1 << "][256] = {";
+    for (state s = 0; s <= numberOfStates; ++s) {
+      std::vector<size_t> row(256, dead);
+      auto it = d.getDelta().lower_bound({s, symbol::min()});
+      for (; s < numberOfStates && it != std::end(d.getDelta()) && it->first.first == s; ++it) {
+	if (it->first.second.lambda || it->first.second.val == 0 || !live[it->second]) continue;
+	row[it->first.second.val] = it->second;
+      }
+      os << (s ? "," : "") << std::endl << indent << "{";
+      for (int c = 0; c < 256; ++c) {
+	os << (c ? ", " : "") << row[c];
+      }
+      os << "}";
+    }
+    os << std::endl << "};" << std::endl;
+
+    os << "const uint32_t accept" << i << "[" << numberOfStates+1 << "] = {";
+    for (state s = 0; s <= numberOfStates; ++s) {
+      if (s % 32 == 0) os << std::endl << indent;
+      os << d.getAcceptTypeForState(s, lexer::REJECT) << (s < numberOfStates ? "," : "");
+    }
+    os << std::endl << "};" << std::endl << std::endl;
+  }
+
+} // end unnamed namespace
+
+void lexer::lockstep_emitter::emit_dfas(
+  const std::vector<rule_group> &groups,
+  std::vector<tkn_rule> &tkn_rules,
+  const std::string &outputDirectory,
+  const emit_options &options) {
+
+  std::string hhFilename = outputDirectory + "tokenizer.hh";
+  std::string ccFilename = outputDirectory + "tokenizer.cc";
+
+  std::ofstream hhFile(hhFilename);
+  std::ofstream ccFile(ccFilename);
+
+  if (hhFile.fail()) {
+    throw std::runtime_error("Could not open: " + hhFilename);
+  }
+  if (ccFile.fail()) {
+    throw std::runtime_error("Could not open: " + ccFilename);
+  }
+
+  std::vector<std::string> names;
+  for (auto const & r: tkn_rules)
+    names.push_back(r.name);
+
+  cpp_emitter::emit_header(hhFile, names, options);
+
+  cpp_emitter::emit_includes(ccFile, options);
+  ccFile << "namespace lexer {" << std::endl << std::endl;
+
+  cpp_emitter::emit_common(ccFile, names, options);
+
+  ccFile << "namespace {" << std::endl << std::endl;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    emitGroup(ccFile, groups[i], i);
+  }
+
+  ccFile << "// Accept types of rules starting with '_'." << std::endl;
+  ccFile << "const bool ignored[" << names.size()+1 << "] = { false";
+  for (auto &s : names) {
+    ccFile << ", " << (s[0] == '_');
+  }
+  ccFile << " };" << std::endl << std::endl;
+  ccFile << "} // end unnamed namespace" << std::endl << std::endl;
+
+  ccFile << "Token Tokenizer::getNextToken() {" << std::endl << std::endl;
+  ccFile << indent << "const uint8_t *start;" << std::endl;
+  ccFile << indent << "const uint8_t *curr = reinterpret_cast<const uint8_t*>(str);" << std::endl;
+  ccFile << "beginning:" << std::endl;
+  ccFile << indent << "start = curr;" << std::endl << std::endl;
+
+  ccFile << indent << "{" << std::endl;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    ccFile << indent << "uint32_t s" << i << " = initial" << i << ";" << std::endl;
+  }
+  ccFile << std::endl;
+  ccFile << indent << "// Advance while some group can still reach an accepting state." << std::endl;
+  ccFile << indent << "for (;;) {" << std::endl;
+  ccFile << indent << indent << "uint8_t c = *curr;" << std::endl;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    ccFile << indent << indent << "uint32_t n" << i << " = delta" << i << "[s" << i << "][c];" << std::endl;
+  }
+  ccFile << indent << indent << "if (";
+  for (size_t i = 0; i < groups.size(); ++i) {
+    ccFile << (i ? " && " : "") << "n" << i << " == dead" << i;
+  }
+  ccFile << ") break;" << std::endl;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    ccFile << indent << indent << "s" << i << " = n" << i << ";" << std::endl;
+  }
+  ccFile << indent << indent << "++curr;" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+
+  ccFile << indent << "// With every group in its initial state the DFA of all rules is in" << std::endl;
+  ccFile << indent << "// its initial state too, and its lexer ends at the terminating 0 or" << std::endl;
+  ccFile << indent << "// takes the byte it stopped on, also after a prefix of a token." << std::endl;
+  ccFile << indent << "bool initial = ";
+  for (size_t i = 0; i < groups.size(); ++i) {
+    ccFile << (i ? " && " : "") << "s" << i << " == initial" << i;
+  }
+  ccFile << ";" << std::endl;
+  ccFile << indent << "if (initial && *curr == 0) {" << std::endl;
+  ccFile << indent << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
+  ccFile << indent << indent << "return Token{reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), TokenType::END_OF_FILE};" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+
+  ccFile << indent << "// On a tie the rule defined last wins, as in the DFA of all rules." << std::endl;
+  ccFile << indent << "uint32_t type = accept0[s0];" << std::endl;
+  for (size_t i = 1; i < groups.size(); ++i) {
+    ccFile << indent << "if (accept" << i << "[s" << i << "] > type) type = accept" << i << "[s" << i << "];" << std::endl;
+  }
+  ccFile << std::endl;
+
+  ccFile << indent << "if (type == 0) {" << std::endl;
+  ccFile << indent << indent << "if (initial) ++curr;" << std::endl;
+  ccFile << indent << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
+  ccFile << indent << indent << "LEXER_RECORD_TOKEN(TokenType::INVALID);" << std::endl;
+  ccFile << indent << indent << "return Token{reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), TokenType::INVALID};" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "if (ignored[type]) {" << std::endl;
+  ccFile << indent << indent << "LEXER_RECORD_SKIPPED();" << std::endl;
+  ccFile << indent << indent << "goto beginning;" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "str = reinterpret_cast<const char*>(curr);" << std::endl;
+  ccFile << indent << "LEXER_RECORD_TOKEN(static_cast<TokenType>(type - 1));" << std::endl;
+  ccFile << indent << "return Token{reinterpret_cast<const char*>(start), reinterpret_cast<const char*>(curr), static_cast<TokenType>(type - 1)};" << std::endl;
+  ccFile << indent << "}" << std::endl;
+
+  ccFile << "}" << std::endl << std::endl;
+
+  ccFile << "} // end namespace lexer" << std::endl;
+}
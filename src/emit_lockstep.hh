@@ -0,0 +1,35 @@
+#ifndef EMIT_LOCKSTEP_HH_GUARD
+#define EMIT_LOCKSTEP_HH_GUARD
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "emit_options.hh"
+#include "parser.hh"
+#include "partition.hh"
+
+namespace lexer {
+
+  // Emits tokenizer.hh and tokenizer.cc for rules split into several
+  // groups by partitionRules. The Tokenizer runs the DFAs of all groups
+  // in lockstep over the same bytes and returns the same tokens as a
+  // lexer built from the DFA of all rules. A scan that stops with every
+  // group in its initial state is handled like a stop in the initial
+  // state of that DFA. That DFA can also be back in its initial state
+  // while a group is not, when rules of other groups shadow all the group
+  // can still match; only there can the tokens differ, and only in where
+  // INVALID and END_OF_FILE tokens end. That needs rules of two groups
+  // that match a common string, which overlappingRules finds and
+  // generate_lexer warns about.
+  struct lockstep_emitter {
+    static void emit_dfas(const std::vector<rule_group> &groups,
+			  std::vector<tkn_rule> &tkn_rules,
+			  const std::string &outputDirectory,
+			  const emit_options &options = emit_options());
+
+  };
+
+} // end namespace lexer
+
+#endif
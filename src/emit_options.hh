@@ -0,0 +1,49 @@
+#ifndef EMIT_OPTIONS_HH_GUARD
+#define EMIT_OPTIONS_HH_GUARD
+
+#include "profile.hh"
+
+namespace lexer {
+
+  struct emit_options {
+    // Count state visits and transitions in the emitted lexer and give
+    // it a writeProfile() function.
+    bool instrument = false;
+
+    // Return one INVALID token for a whole run of bytes that cannot start
+    // a token instead of one per byte.
+    bool bulkInvalid = false;
+
+    // Write the transition table as table.bin and an assembly stub,
+    // table.S, that includes it with .incbin instead of table.cc. The
+    // stub is for ELF targets with the Itanium C++ ABI only.
+    bool tableBlob = false;
+
+    // Give the c++ lexer TokenSpan, tokenizeSpans() and relex() for
+    // updating the tokens of an edited buffer.
+    bool incremental = false;
+
+    // Give the c++ lexer writeCheckpoints() and findCheckpoint() for
+    // starting it in the middle of a large buffer.
+    bool checkpoints = false;
+
+    // Give the c++ lexer LineIndex for finding the line and column of a
+    // position.
+    bool lineIndex = false;
+
+    // Give the c++ lexer FileTokenizer, which tokenizes a file while a
+    // reader thread reads ahead.
+    bool filePipeline = false;
+
+    // Also emit the scanner into tokenizer.hh as a template that calls a
+    // handler per token, so it can be inlined into the caller.
+    bool pushApi = false;
+
+    // Frequencies from a training run used to lay out the emitted code
+    // and tables. Empty when no profile was given.
+    transition_profile profile;
+  };
+
+} // end namespace lexer
+
+#endif // EMIT_OPTIONS_HH_GUARD
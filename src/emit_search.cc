@@ -0,0 +1,289 @@
+#include "emit_search.hh"
+#include "DFA.hh"
+#include "parser.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+
+using namespace lexer;
+
+const std::string indent = "    ";
+
+namespace {
+
+  // True if every non-empty string accepted by d contains the byte b.
+  bool isRequired(const DFA &d, uint8_t b) {
+    std::vector<bool> visited(d.getNumberOfStates(), false);
+    std::queue<state> Q;
+    Q.push(d.getInitialState());
+    while (!Q.empty()) {
+      state curr = Q.front(); Q.pop();
+      auto it = d.getDelta().lower_bound({curr, symbol::min()});
+      for (; it != std::end(d.getDelta()) && it->first.first == curr; ++it) {
+	if (it->first.second == symbol(b)) continue;
+	state target = it->second;
+	if (d.getAcceptTypeForState(target, lexer::REJECT) != lexer::REJECT) {
+	  return false;
+	}
+	if (!visited[target]) {
+	  visited[target] = true;
+	  Q.push(target);
+	}
+      }
+    }
+    return true;
+  }
+
+  // Longest number of bytes read from s on other bytes than b, into live
+  // states, or -1 if a cycle makes it unbounded. lead holds -2 for states
+  // not seen yet and -3 for states on the current path.
+  long longestLead(const DFA &d, state s, uint8_t b, const std::vector<bool> &live, std::vector<long> &lead) {
+    if (lead[s] == -3) return -1;
+    if (lead[s] != -2) return lead[s];
+    lead[s] = -3;
+    long res = 0;
+    auto it = d.getDelta().lower_bound({s, symbol::min()});
+    for (; it != std::end(d.getDelta()) && it->first.first == s; ++it) {
+      if (it->first.second == symbol(b) || !live[it->second]) continue;
+      long l = longestLead(d, it->second, b, live, lead);
+      if (l < 0) {
+	res = -1;
+	break;
+      }
+      res = std::max(res, l + 1);
+    }
+    lead[s] = res;
+    return res;
+  }
+
+  // Writes delta as a dense [state][byte] table. Missing edges and edges
+  // into states that cannot accept go to dead.
+  void emitTable(std::ostream &os, const std::string &name, const DFA &d,
+		 const std::vector<bool> &live, size_t dead) {
+    size_t numberOfStates = d.getNumberOfStates();
+    os << "const uint32_t " << name << "[" << numberOfStates << "][256] = {";
+    for (state s = 0; s < numberOfStates; ++s) {
+      std::vector<size_t> row(256, dead);
+      auto it = d.getDelta().lower_bound({s, symbol::min()});
+      for (; it != std::end(d.getDelta()) && it->first.first == s; ++it) {
+	if (it->first.second.lambda || !live[it->second]) continue;
+	row[it->first.second.val] = it->second;
+      }
+      os << (s ? "," : "") << std::endl << indent << "{";
+      for (int i = 0; i < 256; ++i) {
+	os << (i ? ", " : "") << row[i];
+      }
+      os << "}";
+    }
+    os << std::endl << "};" << std::endl << std::endl;
+  }
+
+} // end unnamed namespace
+
+long lexer::search_emitter::maxLead(const DFA &d, uint8_t b) {
+  std::vector<long> lead(d.getNumberOfStates(), -2);
+  return longestLead(d, d.getInitialState(), b, d.getLiveStates(), lead);
+}
+
+void lexer::search_emitter::emit_dfa(
+  const DFA & d,
+  const DFA & unanchored,
+  std::vector<tkn_rule> &tkn_rules,
+  const std::string &outputDirectory) {
+
+  std::string hhFilename = outputDirectory + "searcher.hh";
+  std::string ccFilename = outputDirectory + "searcher.cc";
+
+  std::ofstream hhFile(hhFilename);
+  std::ofstream ccFile(ccFilename);
+
+  if (hhFile.fail()) {
+    throw std::runtime_error("Could not open: " + hhFilename);
+  }
+  if (ccFile.fail()) {
+    throw std::runtime_error("Could not open: " + ccFilename);
+  }
+
+  std::vector<std::string> names;
+  for (auto const & r: tkn_rules)
+    names.push_back(r.name);
+
+  size_t numberOfStates = d.getNumberOfStates();
+  std::vector<bool> live = d.getLiveStates();
+  std::vector<bool> searchLive(unanchored.getNumberOfStates(), true);
+
+  bool canStart[256] = { false };
+  {
+    auto it = d.getDelta().lower_bound({d.getInitialState(), symbol::min()});
+    for (; it != std::end(d.getDelta()) && it->first.first == d.getInitialState(); ++it) {
+      if (!it->first.second.lambda && live[it->second]) {
+	canStart[it->first.second.val] = true;
+      }
+    }
+  }
+
+  // Prefer a byte that is rare in text if several are required.
+  int requiredByte = -1;
+  for (int b = 0; b < 256; ++b) {
+    if (!isRequired(d, b)) continue;
+    if (requiredByte == -1 || (isalnum(requiredByte) || isspace(requiredByte))) {
+      requiredByte = b;
+    }
+  }
+  long lead = requiredByte >= 0 ? maxLead(d, requiredByte) : -1;
+
+  hhFile << "#ifndef SEARCHER_HH_GUARD" << std::endl;
+  hhFile << "#define SEARCHER_HH_GUARD" << std::endl << std::endl;
+
+  hhFile << "#include <stdint.h>" << std::endl << std::endl;
+
+  hhFile << "namespace lexer {" << std::endl << std::endl;
+
+  hhFile << "enum class SearchRule {" << std::endl;
+  hhFile << indent;
+  for (size_t i = 0; i < names.size(); ++i) {
+    hhFile << (i ? ", " : "") << names[i];
+  }
+  hhFile << std::endl << "};" << std::endl << std::endl;
+
+  hhFile << "struct Match {" << std::endl;
+  hhFile << indent << "const char *start, *end;" << std::endl;
+  hhFile << indent << "SearchRule rule;" << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+
+  hhFile << "// Finds the non-overlapping leftmost-longest matches of the rules in" << std::endl;
+  hhFile << "// [begin, end). On equally long matches the rule defined last wins." << std::endl;
+  hhFile << "// The buffer does not have to be 0 terminated." << std::endl;
+  hhFile << "struct Searcher {" << std::endl << std::endl;
+  hhFile << indent << "Searcher(const char *begin, const char *end);" << std::endl << std::endl;
+  hhFile << indent << "// Stores the next match in m. Returns false when there are no more." << std::endl;
+  hhFile << indent << "bool next(Match &m);" << std::endl << std::endl;
+  hhFile << "private:" << std::endl;
+  hhFile << indent << "const uint8_t *pos, *end;" << std::endl;
+  hhFile << indent << "// Next occurrence of a byte every match contains." << std::endl;
+  hhFile << indent << "const uint8_t *required;" << std::endl << std::endl;
+  hhFile << "};" << std::endl << std::endl;
+
+  hhFile << "} // end namespace lexer" << std::endl << std::endl;
+
+  hhFile << "#endif // SEARCHER_HH_GUARD" << std::endl;
+
+  ccFile << "#include \"searcher.hh\"" << std::endl << std::endl;
+  ccFile << "#include <stddef.h>" << std::endl;
+  ccFile << "#include <string.h>" << std::endl << std::endl;
+
+  ccFile << "namespace lexer {" << std::endl << std::endl;
+  ccFile << "namespace {" << std::endl << std::endl;
+
+  ccFile << "const uint32_t DEAD = " << numberOfStates << ";" << std::endl << std::endl;
+  ccFile << "const uint32_t anchoredInitial = " << d.getInitialState() << ";" << std::endl;
+  emitTable(ccFile, "anchoredDelta", d, live, numberOfStates);
+
+  ccFile << "// Rule index + 1 of the longest match ending in each state, 0 if none." << std::endl;
+  ccFile << "const uint32_t anchoredAccept[" << numberOfStates << "] = {";
+  for (state s = 0; s < numberOfStates; ++s) {
+    if (s % 32 == 0) ccFile << std::endl << indent;
+    ccFile << d.getAcceptTypeForState(s, lexer::REJECT) << (s+1 < numberOfStates ? "," : "");
+  }
+  ccFile << std::endl << "};" << std::endl << std::endl;
+
+  ccFile << "const uint32_t searchInitial = " << unanchored.getInitialState() << ";" << std::endl;
+  emitTable(ccFile, "searchDelta", unanchored, searchLive, unanchored.getInitialState());
+
+  ccFile << "// Some match ends after the bytes read to reach the state." << std::endl;
+  ccFile << "const bool searchAccept[" << unanchored.getNumberOfStates() << "] = {";
+  for (state s = 0; s < unanchored.getNumberOfStates(); ++s) {
+    if (s % 32 == 0) ccFile << std::endl << indent;
+    ccFile << (unanchored.getAcceptTypeForState(s, lexer::REJECT) != lexer::REJECT)
+	   << (s+1 < unanchored.getNumberOfStates() ? "," : "");
+  }
+  ccFile << std::endl << "};" << std::endl << std::endl;
+
+  ccFile << "const bool canStart[256] = {";
+  for (int i = 0; i < 256; ++i) {
+    if (i % 32 == 0) ccFile << std::endl << indent;
+    ccFile << canStart[i] << (i < 255 ? "," : "");
+  }
+  ccFile << std::endl << "};" << std::endl << std::endl;
+
+  ccFile << "// A byte every match contains, or -1 if there is none." << std::endl;
+  ccFile << "const int requiredByte = " << requiredByte << ";" << std::endl << std::endl;
+
+  ccFile << "// Most bytes a match has before the first required byte in it, or -1" << std::endl;
+  ccFile << "// if that is not bounded." << std::endl;
+  ccFile << "const ptrdiff_t maxLead = " << lead << ";" << std::endl << std::endl;
+
+  ccFile << "// Length of the longest match starting at p, 0 if there is none." << std::endl;
+  ccFile << "size_t longestMatch(const uint8_t *p, const uint8_t *end, uint32_t &type) {" << std::endl;
+  ccFile << indent << "uint32_t s = anchoredInitial;" << std::endl;
+  ccFile << indent << "size_t length = 0;" << std::endl;
+  ccFile << indent << "for (const uint8_t *q = p; q < end; ) {" << std::endl;
+  ccFile << indent << indent << "s = anchoredDelta[s][*q++];" << std::endl;
+  ccFile << indent << indent << "if (s == DEAD) break;" << std::endl;
+  ccFile << indent << indent << "if (anchoredAccept[s]) {" << std::endl;
+  ccFile << indent << indent << indent << "length = q - p;" << std::endl;
+  ccFile << indent << indent << indent << "type = anchoredAccept[s];" << std::endl;
+  ccFile << indent << indent << "}" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "return length;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+
+  ccFile << "} // end unnamed namespace" << std::endl << std::endl;
+
+  ccFile << "Searcher::Searcher(const char *begin, const char *end) :" << std::endl;
+  ccFile << indent << "pos(reinterpret_cast<const uint8_t*>(begin))," << std::endl;
+  ccFile << indent << "end(reinterpret_cast<const uint8_t*>(end))," << std::endl;
+  ccFile << indent << "required(reinterpret_cast<const uint8_t*>(begin)) {}" << std::endl << std::endl;
+
+  ccFile << "bool Searcher::next(Match &m) {" << std::endl;
+  ccFile << indent << "if (requiredByte >= 0 && required < end) {" << std::endl;
+  ccFile << indent << indent << "if (required < pos || *required != requiredByte) {" << std::endl;
+  ccFile << indent << indent << indent << "const void *r = memchr(pos, requiredByte, end - pos);" << std::endl;
+  ccFile << indent << indent << indent << "required = r ? static_cast<const uint8_t*>(r) : end;" << std::endl;
+  ccFile << indent << indent << "}" << std::endl;
+  ccFile << indent << "}" << std::endl;
+  ccFile << indent << "if (requiredByte >= 0 && required == end) {" << std::endl;
+  ccFile << indent << indent << "// no match can start at or after pos" << std::endl;
+  ccFile << indent << indent << "pos = end;" << std::endl;
+  ccFile << indent << indent << "return false;" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+
+  ccFile << indent << "// Every match from pos on has a required byte at or after required," << std::endl;
+  ccFile << indent << "// so none starts more than maxLead bytes before it." << std::endl;
+  ccFile << indent << "const uint8_t *from = pos;" << std::endl;
+  ccFile << indent << "if (maxLead >= 0 && required - pos > maxLead) {" << std::endl;
+  ccFile << indent << indent << "from = required - maxLead;" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+
+  ccFile << indent << "uint32_t s = searchInitial;" << std::endl;
+  ccFile << indent << "const uint8_t *tried = from;" << std::endl;
+  ccFile << indent << "for (const uint8_t *p = from; p < end; ) {" << std::endl;
+  ccFile << indent << indent << "s = searchDelta[s][*p++];" << std::endl;
+  ccFile << indent << indent << "if (!searchAccept[s]) continue;" << std::endl << std::endl;
+  ccFile << indent << indent << "// A match ends at p, so the leftmost match starts at the first" << std::endl;
+  ccFile << indent << indent << "// position before p where the anchored automaton matches." << std::endl;
+  ccFile << indent << indent << "for (; tried < p; ++tried) {" << std::endl;
+  ccFile << indent << indent << indent << "if (!canStart[*tried]) continue;" << std::endl;
+  ccFile << indent << indent << indent << "uint32_t type = 0;" << std::endl;
+  ccFile << indent << indent << indent << "size_t length = longestMatch(tried, end, type);" << std::endl;
+  ccFile << indent << indent << indent << "if (length) {" << std::endl;
+  ccFile << indent << indent << indent << indent << "m.start = reinterpret_cast<const char*>(tried);" << std::endl;
+  ccFile << indent << indent << indent << indent << "m.end = reinterpret_cast<const char*>(tried + length);" << std::endl;
+  ccFile << indent << indent << indent << indent << "m.rule = static_cast<SearchRule>(type - 1);" << std::endl;
+  ccFile << indent << indent << indent << indent << "pos = tried + length;" << std::endl;
+  ccFile << indent << indent << indent << indent << "return true;" << std::endl;
+  ccFile << indent << indent << indent << "}" << std::endl;
+  ccFile << indent << indent << "}" << std::endl;
+  ccFile << indent << "}" << std::endl << std::endl;
+  ccFile << indent << "pos = end;" << std::endl;
+  ccFile << indent << "return false;" << std::endl;
+  ccFile << "}" << std::endl << std::endl;
+
+  ccFile << "} // end namespace lexer" << std::endl;
+}
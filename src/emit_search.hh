@@ -0,0 +1,33 @@
+#ifndef EMIT_SEARCH_HH_GUARD
+#define EMIT_SEARCH_HH_GUARD
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "DFA.hh"
+#include "parser.hh"
+
+namespace lexer {
+
+  // Emits searcher.hh and searcher.cc: a scanner that finds every
+  // non-overlapping leftmost-longest match of any rule in a buffer.
+  //
+  // d is the minimized DFA of the rules as used for the tokenizer and
+  // unanchored the minimized DFA of Σ*(r1|r2|...), see NFA::unanchored.
+  struct search_emitter {
+    static void emit_dfa(const DFA & d,
+			 const DFA & unanchored,
+			 std::vector<tkn_rule> &tkn_rules,
+			 const std::string &outputDirectory);
+
+    // The most bytes a match of d has before the first b in it, or -1 if
+    // there is no bound. Searcher starts looking for matches that many
+    // bytes before the next b.
+    static long maxLead(const DFA &d, uint8_t b);
+
+  };
+
+} // end namespace lexer
+
+#endif
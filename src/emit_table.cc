@@ -15,20 +15,17 @@ using namespace lexer;
 void lexer::table_emitter::emit_dfa(
   const DFA & d, 
   std::vector<tkn_rule> &tkn_rules,
-  const std::string &outputDirectory) {
+  const std::string &outputDirectory,
+  const emit_options &options) {
 
   std::string hhFilename = outputDirectory + "table.hh";
   std::string ccFilename = outputDirectory + "table.cc";
 
   std::ofstream hhFile(hhFilename);
-  std::ofstream ccFile(ccFilename);
 
   if (hhFile.fail()) {
     throw std::runtime_error("Could not open: " + hhFilename);
   }
-  if (ccFile.fail()) {
-    throw std::runtime_error("Could not open: " + ccFilename);
-  }
 
   std::vector<std::string> names;
   for (auto const & r: tkn_rules)
@@ -53,6 +50,21 @@ void lexer::table_emitter::emit_dfa(
     break;
   }
   
+  // Row of each state in the table. With a profile the most visited states
+  // get the first rows so the hot part of the table shares cache lines.
+  std::vector<state> stateOrder;
+  if (options.profile.empty()) {
+    for (state s = 0; s < numberOfStates; ++s) {
+      stateOrder.push_back(s);
+    }
+  } else {
+    stateOrder = options.profile.hotStateOrder();
+  }
+  std::vector<state> row(numberOfStates);
+  for (state r = 0; r < numberOfStates; ++r) {
+    row[stateOrder[r]] = r;
+  }
+
   std::stringstream oscc;
   std::stringstream oshh;
   hhFile << "#ifndef TABLE_HH_GUARD" << std::endl;
@@ -69,17 +81,14 @@ void lexer::table_emitter::emit_dfa(
   for (auto &s : names) 
     hhFile << "," << std::endl << "    " << s << "=" << i++;
   hhFile << "};" << std::endl;
-  hhFile << "extern int table[][256];" << std::endl;
-  hhFile << "const int initialState=" << q0 << ";" << std::endl;
+  // The blob lives in .rodata, so only its declaration is const.
+  hhFile << "extern " << (options.tableBlob ? "const " : "") << "int table[][256];" << std::endl;
+  hhFile << "const int initialState=" << row[q0] << ";" << std::endl;
   hhFile << "} // end namespace lexer" << std::endl << std::endl;
   hhFile << "#endif // TABLE_HH_GUARD" << std::endl;
   
-  ccFile << "#include \"table.hh\"" << std::endl << std::endl;
-  ccFile << "namespace lexer {" << std::endl << std::endl;
-  ccFile << "int table[][256] = {";
-
-  bool first=true;
-  for (state s = 0; s < numberOfStates; ++s) {
+  std::vector<int> cells;
+  for (auto s : stateOrder) {
     int jumps[256];
     if (accepts.count(s)) 
       std::fill(jumps, jumps+256, INVALID+accepts[s]);
@@ -89,14 +98,58 @@ void lexer::table_emitter::emit_dfa(
 	 iter->first.first == s; 
 	 ++iter) {
       if (iter->second == rejectState) continue;
-      jumps[iter->first.second.val] = iter->second;
+      jumps[iter->first.second.val] = row[iter->second];
     }
-    if (first) first=false;
-    else ccFile << ',';
+    cells.insert(cells.end(), jumps, jumps+256);
+  }
+
+  if (options.tableBlob) {
+    // The rows are written raw in the byte order of this machine and
+    // pulled into the object by the assembler, so compiling the table
+    // costs the same for any number of states. table.S uses ELF
+    // directives and the Itanium C++ ABI name of lexer::table;
+    // generate_lexer refuses --table-blob on other targets.
+    std::string binFilename = outputDirectory + "table.bin";
+    std::string sFilename = outputDirectory + "table.S";
+    std::ofstream binFile(binFilename, std::ios::binary);
+    std::ofstream sFile(sFilename);
+    if (binFile.fail()) {
+      throw std::runtime_error("Could not open: " + binFilename);
+    }
+    if (sFile.fail()) {
+      throw std::runtime_error("Could not open: " + sFilename);
+    }
+    binFile.write(reinterpret_cast<const char*>(cells.data()), cells.size() * sizeof(int));
+
+    sFile << "// lexer::table, " << numberOfStates << " rows of 256 ints read from table.bin." << std::endl;
+    sFile << "// table.bin is looked up in the directories given to the assembler with -I." << std::endl;
+    sFile << "// ELF targets with the Itanium C++ ABI only." << std::endl;
+    sFile << "    .section .rodata" << std::endl;
+    sFile << "    .balign 64" << std::endl;
+    sFile << "    .globl _ZN5lexer5tableE" << std::endl;
+    sFile << "    .type _ZN5lexer5tableE, @object" << std::endl;
+    sFile << "    .size _ZN5lexer5tableE, " << cells.size() * sizeof(int) << std::endl;
+    sFile << "_ZN5lexer5tableE:" << std::endl;
+    sFile << "    .incbin \"table.bin\"" << std::endl;
+    sFile << "    .section .note.GNU-stack,\"\",@progbits" << std::endl;
+    return;
+  }
+
+  std::ofstream ccFile(ccFilename);
+  if (ccFile.fail()) {
+    throw std::runtime_error("Could not open: " + ccFilename);
+  }
+
+  ccFile << "#include \"table.hh\"" << std::endl << std::endl;
+  ccFile << "namespace lexer {" << std::endl << std::endl;
+  ccFile << "int table[][256] = {";
+
+  for (size_t r = 0; r < numberOfStates; ++r) {
+    if (r != 0) ccFile << ',';
     ccFile << std::endl << "    {";
     for (int i=0; i < 256; ++i) {
       if (i != 0) ccFile << ", ";
-      ccFile << jumps[i];
+      ccFile << cells[r*256 + i];
     }
     ccFile << "}";
   }
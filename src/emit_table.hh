@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "DFA.hh"
+#include "emit_options.hh"
 #include "parser.hh"
 
 namespace lexer {
@@ -13,7 +14,8 @@ namespace lexer {
   struct table_emitter {
     static void emit_dfa(const DFA & d,
 			 std::vector<tkn_rule> &tkn_rules,
-			 const std::string &outputDirectory);
+			 const std::string &outputDirectory,
+			 const emit_options &options = emit_options());
 
   };
 
@@ -1,6 +1,14 @@
+#include "derivatives.hh"
 #include "emit_c++.hh"
+#include "emit_driver.hh"
+#include "emit_lockstep.hh"
+#include "emit_search.hh"
 #include "emit_table.hh"
+#include "matcher.hh"
 #include "parser.hh"
+#include "partition.hh"
+#include "profile.hh"
+#include "simplify.hh"
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
@@ -9,11 +17,16 @@ using namespace lexer;
 
 void printUsage(std::ostream & o) {
   o << "The program generates a fast lexer." << std::endl << std::endl;
-  o << "Usage: ./generate_lexer [--emit-cpp] [--emit-table] <regexp_file> <output_directory>" << std::endl << std::endl;
+  o << "Usage: ./generate_lexer [--emit-cpp] [--emit-table] [--table-blob] [--emit-search] [--emit-binary] [--emit-driver] [--emit-token-stream] [--bulk-invalid] [--incremental] [--checkpoints] [--line-index] [--file-pipeline] [--push-api] [--glushkov] [--derivatives] [--check-derivatives] [--max-states=<n>] [--profile-generate] [--profile-use=<profile>] <regexp_file> <output_directory>" << std::endl << std::endl;
 
   o << "The <regexp_file> is a collection of token definitions on the form:" << std::endl << std::endl;
   o << "<TOKEN_NAME> := <regexp definition>" << std::endl << std::endl;
   o << "Each definition is on its own line." << std::endl;
+  o << "An action in braces after the name makes the c++ lexer compute Token::value while it" << std::endl
+    << "scans the token: <TOKEN_NAME> {decimal} := <regexp definition>. The actions are" << std::endl
+    << "'decimal' (the digits as a decimal number), 'hash' (FNV-1a hash of the token) and" << std::endl
+    << "'newlines' (number of newlines in the token). 'intern' computes the hash too and" << std::endl
+    << "adds an InternTable class that gives every distinct lexeme a small id." << std::endl;
   o << "The syntax for the regular expression is as follows." << std::endl;
   o << "A single character is a regular expression: c" << std::endl;
   o << "The special character '.' matches any one single character." << std::endl;
@@ -29,13 +42,94 @@ void printUsage(std::ostream & o) {
 
   o << "In the <output_directory> two files will be created: tokenizer.hh and tokenizer.cc." << std::endl << "These two files make up the lexer." << std::endl;
   o << "Currently only C++11 lexers are supported, but more languages can be added." << std::endl
-    << "Look at 'generate_lexer.cc', 'emit_c++.hh', and 'emit_c++.cc' for adding new languages." << std::endl;
+    << "Look at 'generate_lexer.cc', 'emit_c++.hh', and 'emit_c++.cc' for adding new languages." << std::endl << std::endl;
+
+  o << "With --emit-table the files table.hh and table.cc hold the transition table as a" << std::endl
+    << "lexer::table array. With --table-blob table.cc is replaced by table.bin, the raw table" << std::endl
+    << "in the byte order of this machine, and table.S, which includes it with .incbin." << std::endl
+    << "Assemble table.S with the output directory on the assembler include path, e.g." << std::endl
+    << "-Wa,-I<output_directory>. table.S is for ELF targets with the Itanium C++ ABI, like" << std::endl
+    << "Linux and the BSDs, only, and the blob table is const." << std::endl << std::endl;
+
+  o << "With --emit-search the files searcher.hh and searcher.cc are created. They find every" << std::endl
+    << "leftmost-longest match of any rule anywhere in a buffer, like grep." << std::endl << std::endl;
+
+  o << "With --emit-binary the file lexer.dfa is created. It holds the minimized DFA and the" << std::endl
+    << "token names, and lexer::Matcher::load maps it and tokenizes straight from the file." << std::endl << std::endl;
+
+  o << "With --emit-driver the file lex_files.cc is created, a program that tokenizes many" << std::endl
+    << "files on all cores with the c++ lexer and reports the throughput. Build it with" << std::endl
+    << "g++ -O2 -pthread tokenizer.cc lex_files.cc -o lex_files" << std::endl << std::endl;
+
+  o << "With --emit-token-stream the files token_stream.hh and tokenize.cc are created." << std::endl
+    << "tokenize writes the tokens of a file in a compact binary format of varints with an" << std::endl
+    << "optional block index, and token_stream.hh reads it in place, e.g. from a mapped file." << std::endl
+    << "Build it with g++ -O2 tokenizer.cc tokenize.cc -o tokenize" << std::endl << std::endl;
+
+  o << "With --bulk-invalid the c++ lexer returns a single INVALID token for a whole run of" << std::endl
+    << "bytes that cannot start any token, instead of one token per byte." << std::endl << std::endl;
+
+  o << "With --incremental the c++ lexer also gets tokenizeSpans(), which returns the tokens" << std::endl
+    << "as offsets, and relex(), which updates them after an edit of the buffer. relex() lexes" << std::endl
+    << "from the token before the edit until the tokens are in step with the old ones again." << std::endl << std::endl;
+
+  o << "With --checkpoints the c++ lexer also gets writeCheckpoints(), which lexes a buffer" << std::endl
+    << "and writes a compact index of token boundaries every <interval> bytes, and" << std::endl
+    << "findCheckpoint(), which looks up where to start lexing near any offset in the index," << std::endl
+    << "e.g. in a mapped file stored beside the buffer." << std::endl << std::endl;
+
+  o << "With --line-index the c++ lexer also gets LineIndex, which finds the line and column" << std::endl
+    << "of a position in a buffer. It indexes the newlines on its first lookup." << std::endl << std::endl;
+
+  o << "With --file-pipeline the c++ lexer also gets FileTokenizer, which tokenizes a file" << std::endl
+    << "in constant memory while a reader thread reads ahead into a ring of buffers." << std::endl
+    << "Link it with -pthread." << std::endl << std::endl;
+
+  o << "With --push-api tokenizer.hh also gets 'template<typename Handler> const char *" << std::endl
+    << "tokenize(const char *str, Handler &&handler)', which calls handler(const Token&) for" << std::endl
+    << "every token until it returns false. The scanner is inlined into the caller." << std::endl << std::endl;
+
+  o << "With --glushkov the NFA of the rules is built with the Glushkov construction: one" << std::endl
+    << "state per character class in the rules and no lambda edges, so determinizing skips" << std::endl
+    << "the lambda elimination. The lexer is the same." << std::endl << std::endl;
+
+  o << "With --derivatives the DFA is built from the regular expressions with Brzozowski" << std::endl
+    << "derivatives instead of from an NFA. The lexer is the same. --check-derivatives builds" << std::endl
+    << "the DFA both ways and fails if they differ." << std::endl << std::endl;
+
+  o << "With --max-states=<n> the rules are split into groups whose DFAs have at most <n>" << std::endl
+    << "states, and the c++ lexer runs the DFAs of all groups in lockstep. This avoids the" << std::endl
+    << "state explosion of conflicting rules at the cost of a slower lexer. The group DFAs are" << std::endl
+    << "built as chosen by --glushkov and --derivatives. A warning names rules of different" << std::endl
+    << "groups that match a common string; only then can INVALID and END_OF_FILE tokens end" << std::endl
+    << "elsewhere than with a single DFA." << std::endl << std::endl;
+
+  o << "With --profile-generate the c++ lexer counts state visits and transitions and gets a" << std::endl
+    << "writeProfile(std::ostream&) function. Run it on a training corpus and save the profile." << std::endl
+    << "With --profile-use=<profile> the states and cases are laid out hottest first, and the" << std::endl
+    << "dominant edges of the hottest states get a fast path. The profile holds a fingerprint" << std::endl
+    << "of the DFA, and is refused unless the rules and construction options are unchanged." << std::endl << std::endl;
+
+  o << "Compile the c++ lexer and its users with -DLEXER_ENABLE_STATS to give each Tokenizer" << std::endl
+    << "a 'stats' member counting tokens per type, END_OF_FILE excluded, consumed, skipped" << std::endl
+    << "and invalid bytes, INVALID tokens and token lengths. TokenizerStats::merge adds up" << std::endl
+    << "the counters of several tokenizers." << std::endl;
 }
 
 int main(int argc, char *argv[]) {
   bool emit_cpp=false;
   bool emit_table=false;
+  bool emit_search=false;
+  bool emit_binary=false;
+  bool emit_driver=false;
+  bool emit_token_stream=false;
+  bool glushkov=false;
+  bool derivatives=false;
+  bool checkDerivatives=false;
   bool show_usage=false;
+  emit_options options;
+  std::string profileFile;
+  size_t maxStates=0;
 
   std::vector<std::string> positional;
   for (char ** arg = argv+1; *arg; ++arg) {
@@ -51,6 +145,40 @@ int main(int argc, char *argv[]) {
 	emit_cpp=true;
       else if (a == "--emit-table")
 	emit_table=true;
+      else if (a == "--table-blob")
+	options.tableBlob=true;
+      else if (a == "--emit-search")
+	emit_search=true;
+      else if (a == "--emit-binary")
+	emit_binary=true;
+      else if (a == "--emit-driver")
+	emit_driver=true;
+      else if (a == "--emit-token-stream")
+	emit_token_stream=true;
+      else if (a == "--bulk-invalid")
+	options.bulkInvalid=true;
+      else if (a == "--incremental")
+	options.incremental=true;
+      else if (a == "--checkpoints")
+	options.checkpoints=true;
+      else if (a == "--line-index")
+	options.lineIndex=true;
+      else if (a == "--file-pipeline")
+	options.filePipeline=true;
+      else if (a == "--push-api")
+	options.pushApi=true;
+      else if (a == "--glushkov")
+	glushkov=true;
+      else if (a == "--derivatives")
+	derivatives=true;
+      else if (a == "--check-derivatives")
+	derivatives=checkDerivatives=true;
+      else if (a == "--profile-generate")
+	options.instrument=true;
+      else if (a.compare(0, 14, "--profile-use=") == 0)
+	profileFile=a.substr(14);
+      else if (a.compare(0, 13, "--max-states=") == 0)
+	maxStates=std::stoul(a.substr(13));
       else {
 	std::cerr << "Unknwon switch " << a << std::endl;
 	printUsage(std::cerr);
@@ -88,6 +216,14 @@ int main(int argc, char *argv[]) {
     return EXIT_SUCCESS;
   }
   
+#if !defined(__ELF__) || !defined(__GXX_ABI_VERSION)
+  // table.S uses ELF directives and the Itanium C++ ABI name of lexer::table.
+  if (options.tableBlob) {
+    std::cerr << "--table-blob needs an ELF target with the Itanium C++ ABI" << std::endl;
+    return EXIT_FAILURE;
+  }
+#endif
+
   std::string tokenFile(positional[0]);
   std::string outputDirectory="./";
   if (positional.size() > 1) 
@@ -96,23 +232,126 @@ int main(int argc, char *argv[]) {
   std::cout << "Reading input" << std::endl;
   std::fstream fs(tokenFile);
   std::vector<tkn_rule> tkn_rules = std::move(parseFile(fs));
-  
+  std::cout << "Simplifying" << std::endl;
+  simplifyRules(tkn_rules);
+
+  if (emit_driver) {
+    std::cout << "Outputting driver" << std::endl;
+    driver_emitter::emit_driver(outputDirectory);
+  }
+
+  if (emit_token_stream) {
+    std::cout << "Outputting token stream" << std::endl;
+    driver_emitter::emit_token_stream(outputDirectory);
+  }
+
+  if (maxStates) {
+    std::cout << "Partitioning rules" << std::endl;
+    rule_construction construction = rule_construction::THOMPSON;
+    if (derivatives)
+      construction = rule_construction::DERIVATIVES;
+    else if (glushkov)
+      construction = rule_construction::GLUSHKOV;
+    std::vector<rule_group> groups = partitionRules(tkn_rules, maxStates, construction);
+    if (groups.size() > 1) {
+      std::cout << "Split rules into " << groups.size() << " groups" << std::endl;
+      if (checkDerivatives) {
+	for (auto &g : groups) {
+	  if (!DFA::equivalent(g.dfa, buildRuleDFA(tkn_rules, g.rules))) {
+	    std::cerr << "The DFA from derivatives differs from the DFA of the NFA" << std::endl;
+	    return EXIT_FAILURE;
+	  }
+	}
+      }
+      for (auto &x : overlappingRules(groups)) {
+	std::cerr << "Warning: " << tkn_rules[x.first].name << " and " << tkn_rules[x.second].name
+		  << " are in different groups and match a common string, so INVALID and"
+		  << " END_OF_FILE tokens can differ from those of a single DFA" << std::endl;
+      }
+      if (emit_table || emit_search || emit_binary || options.bulkInvalid || options.pushApi ||
+	  options.instrument || !profileFile.empty()) {
+	std::cerr << "--emit-table, --emit-search, --emit-binary, --bulk-invalid, --push-api and profiles need a single DFA" << std::endl;
+	return EXIT_FAILURE;
+      }
+      for (auto &r : tkn_rules) {
+	if (r.action != token_action::NONE) {
+	  std::cerr << "Rule actions need a single DFA" << std::endl;
+	  return EXIT_FAILURE;
+	}
+      }
+      if (emit_cpp) {
+	std::cout << "Outputting c++" << std::endl;
+	lockstep_emitter::emit_dfas(groups, tkn_rules, outputDirectory, options);
+      }
+      std::cout << "Done" << std::endl;
+      return EXIT_SUCCESS;
+    }
+  }
+
+  // --derivatives alone never builds the NFA of the rules.
   NFA f(1, std::unordered_map<state, acceptType>(), 0, {});
-  for (size_t i = 0; i < tkn_rules.size(); ++i)
-    f = lexer::NFA::join(f, tkn_rules[i].regexp->getNFA(i+1));
-  std::cout << "Determinizing" << std::endl;
-  DFA d = f.determinize();
-  std::cout << "Minimizing" << std::endl;
-  d.minimize();
+  if (!derivatives || checkDerivatives || emit_search) {
+    std::cout << "Building NFA" << std::endl;
+    for (size_t i = 0; i < tkn_rules.size(); ++i) {
+      if (glushkov)
+	f = lexer::NFA::joinInitials(f, tkn_rules[i].regexp->getGlushkovNFA(i+1));
+      else
+	f = lexer::NFA::join(f, tkn_rules[i].regexp->getNFA(i+1));
+    }
+  }
+  DFA d;
+  if (derivatives) {
+    std::cout << "Taking derivatives" << std::endl;
+    d = buildDerivativeDFA(tkn_rules);
+  }
+  if (!derivatives || checkDerivatives) {
+    std::cout << "Determinizing" << std::endl;
+    DFA n = f.determinize();
+    std::cout << "Minimizing" << std::endl;
+    n.minimize();
+    if (checkDerivatives && !DFA::equivalent(d, n)) {
+      std::cerr << "The DFA from derivatives differs from the DFA of the NFA" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (!derivatives)
+      d = std::move(n);
+  }
+
+  if (!profileFile.empty()) {
+    std::cout << "Reading profile" << std::endl;
+    std::ifstream pfs(profileFile);
+    if (pfs.fail()) {
+      std::cerr << "Could not open: " << profileFile << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.profile = readProfile(pfs, d);
+  }
 
   if (emit_cpp) {
     std::cout << "Outputting c++" << std::endl;
-    cpp_emitter::emit_dfa(d, tkn_rules,  outputDirectory);
+    cpp_emitter::emit_dfa(d, tkn_rules,  outputDirectory, options);
   }
 
   if (emit_table) {
     std::cout << "Outputting table" << std::endl;
-    table_emitter::emit_dfa(d, tkn_rules,  outputDirectory);
+    table_emitter::emit_dfa(d, tkn_rules,  outputDirectory, options);
+  }
+
+  if (emit_binary) {
+    std::cout << "Outputting binary" << std::endl;
+    std::vector<std::string> names;
+    for (auto const & r: tkn_rules)
+      names.push_back(r.name);
+    std::ofstream bfs(outputDirectory + "lexer.dfa", std::ios::binary);
+    Matcher(d, names).save(bfs);
+  }
+
+  if (emit_search) {
+    std::cout << "Determinizing search automaton" << std::endl;
+    DFA u = lexer::NFA::unanchored(f).determinize();
+    u.minimize();
+    std::cout << "Outputting search" << std::endl;
+    search_emitter::emit_dfa(d, u, tkn_rules, outputDirectory);
   }
 
   std::cout << "Done" << std::endl;
@@ -0,0 +1,359 @@
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+
+#include "jit.hh"
+#include "partition.hh"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define LEXER_JIT_X86_64 1
+#endif
+
+namespace {
+
+  std::vector<std::string> namesOf(const std::vector<lexer::tkn_rule> &tkn_rules) {
+    std::vector<std::string> names;
+    for (auto const & r: tkn_rules)
+      names.push_back(r.name);
+    return names;
+  }
+
+  std::vector<size_t> allRules(const std::vector<lexer::tkn_rule> &tkn_rules) {
+    std::vector<size_t> all;
+    for (size_t i = 0; i < tkn_rules.size(); ++i) {
+      all.push_back(i);
+    }
+    return all;
+  }
+
+#ifdef LEXER_JIT_X86_64
+
+  // States with more byte ranges than this dispatch through a jump table.
+  const size_t maxCompareRanges = 8;
+  // Self loops on up to this many byte ranges get the SSE2 loop.
+  const size_t maxSimdRanges = 4;
+
+  const uint32_t noEdge = UINT32_MAX;
+
+  // Position of a label not bound yet.
+  const size_t unbound = SIZE_MAX;
+
+  // Collects machine code and patches the displacements to labels once
+  // everything is laid out. The code only uses relative addressing, so it
+  // can be copied anywhere.
+  class assembler {
+
+  public:
+
+    typedef size_t label;
+
+    std::vector<uint8_t> code;
+
+    label newLabel() {
+      positions.push_back(unbound);
+      return positions.size() - 1;
+    }
+
+    void bind(label l) { positions[l] = code.size(); }
+
+    void bytes(std::initializer_list<uint8_t> b) { code.insert(code.end(), b); }
+
+    void imm32(uint32_t x) {
+      for (int i = 0; i < 4; ++i) {
+	code.push_back(static_cast<uint8_t>(x >> (8*i)));
+      }
+    }
+
+    // An instruction ending in the displacement to l from its end: a jump
+    // or a rip relative operand.
+    void rel32(std::initializer_list<uint8_t> opcode, label l) {
+      bytes(opcode);
+      fixups.push_back({code.size(), l, unbound});
+      imm32(0);
+    }
+
+    // The offset of l from base, for jump tables.
+    void offset32(label l, label base) {
+      fixups.push_back({code.size(), l, base});
+      imm32(0);
+    }
+
+    void align(size_t alignment, uint8_t fill) {
+      while (code.size() % alignment) code.push_back(fill);
+    }
+
+    void link() {
+      for (auto &f : fixups) {
+	size_t origin = f.base == unbound ? f.at + 4 : positions[f.base];
+	int32_t d = static_cast<int32_t>(static_cast<int64_t>(positions[f.target]) - static_cast<int64_t>(origin));
+	std::memcpy(&code[f.at], &d, 4);
+      }
+    }
+
+  private:
+
+    struct fixup {
+      size_t at;
+      label target;
+      label base; // unbound for displacements from the end of the instruction
+    };
+
+    std::vector<size_t> positions;
+    std::vector<fixup> fixups;
+
+  };
+
+  struct byte_range {
+    int lo, hi;
+    uint32_t to;
+  };
+
+  // The scanner as a function void scan(const char *str, Token *out).
+  // rdi is curr, rdx start, rsi out and eax the byte at curr.
+  std::vector<uint8_t> generateScanner(const lexer::DFA &d, const std::vector<std::string> &names) {
+    typedef assembler::label label;
+
+    size_t n = d.getNumberOfStates();
+    std::vector<bool> live = d.getLiveStates();
+    lexer::state q0 = d.getInitialState();
+
+    // Like Matcher, edges on 0 and into states that cannot accept are
+    // dropped, the scan stops there.
+    std::vector<uint32_t> next(n * 256, noEdge);
+    for (auto x : d.getDelta()) {
+      lexer::symbol c = x.first.second;
+      if (c.lambda || c.val == 0 || !live[x.second]) continue;
+      next[x.first.first*256 + c.val] = x.second;
+    }
+
+    assembler a;
+    std::vector<label> advance(n), entry(n), dispatch(n), selfLoop(n);
+    for (lexer::state s = 0; s < n; ++s) {
+      advance[s] = a.newLabel();
+      entry[s] = a.newLabel();
+      dispatch[s] = a.newLabel();
+      selfLoop[s] = a.newLabel();
+    }
+    label beginning = a.newLabel();
+    label endOfInput = a.newLabel();
+
+    // SSE2 constants, laid out after the code.
+    std::vector<std::pair<label, uint8_t> > constants;
+    auto constant = [&](uint8_t byte) {
+      constants.push_back({a.newLabel(), byte});
+      return constants.back().first;
+    };
+
+    auto emitReturn = [&](uint32_t type) {
+      a.bytes({0x48, 0x89, 0x16});             // mov [rsi], rdx
+      a.bytes({0x48, 0x89, 0x7e, 0x08});       // mov [rsi+8], rdi
+      a.bytes({0xc7, 0x46, 0x10});             // mov dword [rsi+16], type
+      a.imm32(type);
+      a.bytes({0xc3});                         // ret
+    };
+
+    a.bind(beginning);
+    a.bytes({0x48, 0x89, 0xfa});               // mov rdx, rdi
+    a.bytes({0x0f, 0xb6, 0x07});               // movzx eax, byte [rdi]
+    a.bytes({0x85, 0xc0});                     // test eax, eax
+    a.rel32({0x0f, 0x84}, endOfInput);         // jz endOfInput
+    if (live[q0]) {
+      a.rel32({0xe9}, dispatch[q0]);           // jmp
+    } else {
+      a.bytes({0x48, 0xff, 0xc7});             // inc rdi
+      emitReturn(names.size() + 1);
+    }
+    a.bind(endOfInput);
+    emitReturn(names.size());
+
+    for (lexer::state s = 0; s < n; ++s) {
+      if (!live[s]) continue;
+
+      std::vector<byte_range> loops, others;
+      for (int c = 1; c < 256; ++c) {
+	uint32_t t = next[s*256 + c];
+	if (t == noEdge) continue;
+	std::vector<byte_range> &ranges = t == s ? loops : others;
+	if (!ranges.empty() && ranges.back().hi == c-1 && ranges.back().to == t) {
+	  ranges.back().hi = c;
+	} else {
+	  ranges.push_back({c, c, t});
+	}
+      }
+      bool simd = !loops.empty() && loops.size() <= maxSimdRanges;
+      auto target = [&](uint32_t t) { return (t == s && simd) ? selfLoop[s] : advance[t]; };
+
+      a.bind(advance[s]);
+      a.bytes({0x48, 0xff, 0xc7});             // inc rdi
+      a.bind(entry[s]);
+      a.bytes({0x0f, 0xb6, 0x07});             // movzx eax, byte [rdi]
+      a.bind(dispatch[s]);
+
+      label stop = a.newLabel();
+      label table = a.newLabel();
+      bool useTable = loops.size() + others.size() > maxCompareRanges;
+      if (useTable) {
+	a.rel32({0x48, 0x8d, 0x0d}, table);    // lea rcx, [rip+table]
+	a.bytes({0x48, 0x63, 0x04, 0x81});     // movsxd rax, dword [rcx+rax*4]
+	a.bytes({0x48, 0x01, 0xc8});           // add rax, rcx
+	a.bytes({0xff, 0xe0});                 // jmp rax
+      } else {
+	// The self loop first, it is taken most.
+	for (auto *ranges : { &loops, &others }) {
+	  for (auto &r : *ranges) {
+	    if (r.lo == r.hi) {
+	      a.bytes({0x3d});                 // cmp eax, lo
+	      a.imm32(r.lo);
+	      a.rel32({0x0f, 0x84}, target(r.to)); // je
+	    } else {
+	      a.bytes({0x8d, 0x88});           // lea ecx, [rax-lo]
+	      a.imm32(-r.lo);
+	      a.bytes({0x81, 0xf9});           // cmp ecx, hi-lo
+	      a.imm32(r.hi - r.lo);
+	      a.rel32({0x0f, 0x86}, target(r.to)); // jbe
+	    }
+	  }
+	}
+      }
+
+      a.bind(stop);
+      if (s == q0) {
+	// Stops in the initial state are handled as in Matcher. The jump
+	// table leaves the address in rax, so the byte is read again.
+	a.bytes({0x80, 0x3f, 0x00});           // cmp byte [rdi], 0
+	a.rel32({0x0f, 0x84}, endOfInput);     // je
+      }
+      lexer::acceptType accept = d.getAcceptTypeForState(s, lexer::REJECT);
+      if (accept == lexer::REJECT) {
+	if (s == q0) {
+	  a.bytes({0x48, 0xff, 0xc7});         // inc rdi
+	}
+	emitReturn(names.size() + 1);
+      } else if (names[accept-1][0] == '_') {
+	a.rel32({0xe9}, beginning);            // jmp
+      } else {
+	emitReturn(accept - 1);
+      }
+
+      if (useTable) {
+	a.align(4, 0xcc);
+	a.bind(table);
+	for (int c = 0; c < 256; ++c) {
+	  uint32_t t = next[s*256 + c];
+	  a.offset32(t == noEdge ? stop : target(t), table);
+	}
+      }
+
+      if (simd) {
+	// Skips the rest of a run of loop bytes 16 aligned bytes at a time.
+	// Aligned loads never cross into the next page, so reading past the
+	// terminating 0, which ends every run, is safe. Byte x is in range
+	// r iff x - r.lo + 0x80, as a signed byte, is less than
+	// r.hi - r.lo + 1 - 0x80.
+	label block = a.newLabel();
+	label found = a.newLabel();
+	a.bind(selfLoop[s]);
+	a.bytes({0x48, 0xff, 0xc7});           // inc rdi
+	a.bytes({0x49, 0x89, 0xf9});           // mov r9, rdi
+	a.bytes({0x49, 0x83, 0xe1, 0xf0});     // and r9, -16
+	a.bytes({0x89, 0xf9});                 // mov ecx, edi
+	a.bytes({0x83, 0xe1, 0x0f});           // and ecx, 15
+	a.bytes({0x41, 0xb8});                 // mov r8d, 0xffff
+	a.imm32(0xffff);
+	a.bytes({0x41, 0xd3, 0xe0});           // shl r8d, cl
+	a.bind(block);
+	a.bytes({0x66, 0x41, 0x0f, 0x6f, 0x01}); // movdqa xmm0, [r9]
+	for (size_t i = 0; i < loops.size(); ++i) {
+	  const byte_range &r = loops[i];
+	  a.bytes({0x66, 0x0f, 0x6f, 0xc8});   // movdqa xmm1, xmm0
+	  a.rel32({0x66, 0x0f, 0xfc, 0x0d}, constant(0x80 - r.lo)); // paddb xmm1, [rip+bias]
+	  a.rel32({0x66, 0x0f, 0x6f, 0x15}, constant(r.hi - r.lo + 1 - 0x80)); // movdqa xmm2, [rip+limit]
+	  a.bytes({0x66, 0x0f, 0x64, 0xd1});   // pcmpgtb xmm2, xmm1
+	  if (i == 0) {
+	    a.bytes({0x66, 0x0f, 0x6f, 0xda}); // movdqa xmm3, xmm2
+	  } else {
+	    a.bytes({0x66, 0x0f, 0xeb, 0xda}); // por xmm3, xmm2
+	  }
+	}
+	a.bytes({0x66, 0x0f, 0xd7, 0xc3});     // pmovmskb eax, xmm3
+	a.bytes({0x35});                       // xor eax, 0xffff
+	a.imm32(0xffff);
+	a.bytes({0x44, 0x21, 0xc0});           // and eax, r8d
+	a.rel32({0x0f, 0x85}, found);          // jnz
+	a.bytes({0x49, 0x83, 0xc1, 0x10});     // add r9, 16
+	a.bytes({0x41, 0xb8});                 // mov r8d, 0xffff
+	a.imm32(0xffff);
+	a.rel32({0xe9}, block);                // jmp
+	a.bind(found);
+	a.bytes({0x0f, 0xbc, 0xc0});           // bsf eax, eax
+	a.bytes({0x49, 0x8d, 0x3c, 0x01});     // lea rdi, [r9+rax]
+	a.rel32({0xe9}, entry[s]);             // jmp
+      }
+    }
+
+    a.align(16, 0xcc);
+    for (auto &c : constants) {
+      a.bind(c.first);
+      for (int i = 0; i < 16; ++i) {
+	a.code.push_back(c.second);
+      }
+    }
+    a.link();
+    return a.code;
+  }
+
+#endif // LEXER_JIT_X86_64
+
+} // end unnamed namespace
+
+namespace lexer {
+
+  static_assert(offsetof(Matcher::Token, start) == 0 &&
+		offsetof(Matcher::Token, curr) == 8 &&
+		offsetof(Matcher::Token, tkn) == 16,
+		"the generated code fills in Token by offset");
+
+  JitMatcher::JitMatcher(const std::vector<tkn_rule> &tkn_rules)
+    : JitMatcher(buildRuleDFA(tkn_rules, allRules(tkn_rules)), namesOf(tkn_rules)) {
+  }
+
+  JitMatcher::JitMatcher(const DFA &d, const std::vector<std::string> &names) : matcher(d, names) {
+    compile(d);
+  }
+
+  JitMatcher JitMatcher::fromStream(std::istream &rules) {
+    return JitMatcher(parseFile(rules));
+  }
+
+  void JitMatcher::compile(const DFA &d) {
+#ifdef LEXER_JIT_X86_64
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < getEndOfFileType(); ++i) {
+      names.push_back(getName(i));
+    }
+    std::vector<uint8_t> generated = generateScanner(d, names);
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t size = (generated.size() + pageSize - 1) / pageSize * pageSize;
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return;
+    std::memcpy(addr, generated.data(), generated.size());
+    if (mprotect(addr, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(addr, size);
+      return;
+    }
+    code = std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(addr),
+					  [size](const uint8_t *p) {
+					    munmap(const_cast<uint8_t*>(p), size);
+					  });
+    codeSize = generated.size();
+    scan = reinterpret_cast<scan_function>(addr);
+#else
+    (void)d;
+#endif
+  }
+
+} // end namespace lexer
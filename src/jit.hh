@@ -0,0 +1,90 @@
+#ifndef JIT_HH_GUARD
+#define JIT_HH_GUARD
+
+#include <istream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DFA.hh"
+#include "matcher.hh"
+#include "parser.hh"
+
+namespace lexer {
+
+  // A Matcher whose scanner is compiled to x86-64 machine code at runtime,
+  // with the structure of the code cpp_emitter writes: every state is a
+  // sequence of compares and jumps, or a jump table when it has many
+  // edges, and returns its token itself. States with a self loop on a few
+  // byte ranges skip runs of those bytes with SSE2.
+  //
+  // Elsewhere than on x86-64 Linux, or when no executable memory can be
+  // had, the tokens come from the table engine of Matcher instead.
+  // Either way they are the same as Matcher's for the same rules.
+  class JitMatcher {
+
+  public:
+
+    typedef Matcher::Token Token;
+
+    // Keeps the position in one 0 terminated input.
+    class Tokenizer {
+    public:
+      Tokenizer(const JitMatcher &m, const char *str) : m(&m), str(str) {}
+      Token getNextToken() { return m->getNextToken(str); }
+    private:
+      const JitMatcher *m;
+      const char *str;
+    };
+
+    explicit JitMatcher(const std::vector<tkn_rule> &tkn_rules);
+
+    // d must be minimized and use rule index + 1 as accept types.
+    JitMatcher(const DFA &d, const std::vector<std::string> &names);
+
+    // Reads rules in the format of parseFile.
+    static JitMatcher fromStream(std::istream &rules);
+
+    // Returns the token at str, which must be 0 terminated, and moves str
+    // past it.
+    Token getNextToken(const char *&str) const {
+      if (!scan) return matcher.getNextToken(str);
+      Token t;
+      scan(str, &t);
+      str = t.curr;
+      return t;
+    }
+
+    Tokenizer tokenize(const char *str) const { return Tokenizer(*this, str); }
+
+    uint32_t getEndOfFileType() const { return matcher.getEndOfFileType(); }
+    uint32_t getInvalidType() const { return matcher.getInvalidType(); }
+
+    // Rule name of a token type, or END_OF_FILE or INVALID.
+    const std::string &getName(uint32_t type) const { return matcher.getName(type); }
+
+    // False when the tokens come from the table engine.
+    bool isNative() const { return scan != nullptr; }
+
+    size_t getCodeSize() const { return codeSize; }
+
+  private:
+
+    // Fills in the token at str.
+    typedef void (*scan_function)(const char *str, Token *out);
+
+    void compile(const DFA &d);
+
+    Matcher matcher;
+
+    // Executable pages, shared by copies.
+    std::shared_ptr<const uint8_t> code;
+    size_t codeSize = 0;
+    scan_function scan = nullptr;
+
+  };
+
+} // end namespace lexer
+
+#endif // JIT_HH_GUARD
@@ -2,8 +2,11 @@
 #define LEXER_COMMON_HH_GUARD
 
 #include <algorithm>
+#include <bitset>
 #include <cctype>
 #include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <limits>
 #include <set>
 #include <stdint.h>
@@ -115,6 +118,95 @@ namespace lexer {
 
   const symbol LAMBDA{0, true};
 
+  // A set of symbols: a mask of the 256 byte values and a flag for λ.
+  // Iterates in symbol order, λ first.
+  class symbol_set {
+
+  public:
+
+    class const_iterator {
+    public:
+      typedef std::input_iterator_tag iterator_category;
+      typedef symbol value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const symbol *pointer;
+      typedef symbol reference;
+
+      const_iterator(const symbol_set *s, int i) : s(s), i(i) { skip(); }
+      symbol operator*() const { return i < 0 ? LAMBDA : symbol(static_cast<symbol::value_type>(i)); }
+      const_iterator &operator++() { ++i; skip(); return *this; }
+      bool operator!=(const const_iterator &o) const { return i != o.i; }
+      bool operator==(const const_iterator &o) const { return i == o.i; }
+    private:
+      void skip() {
+	if (i < 0 && !s->lambda) i = 0;
+	while (i >= 0 && i < 256 && !s->bits.test(i)) ++i;
+      }
+      const symbol_set *s;
+      int i;
+    };
+
+    symbol_set() : lambda(false) {}
+
+    symbol_set(std::initializer_list<symbol> symbols) : lambda(false) {
+      for (auto x : symbols) insert(x);
+    }
+
+    static symbol_set allBytes() {
+      symbol_set res;
+      res.bits.set();
+      return res;
+    }
+
+    void insert(symbol x) {
+      if (x.lambda) lambda = true;
+      else bits.set(x.val);
+    }
+
+    size_t count(symbol x) const {
+      return x.lambda ? lambda : bits.test(x.val);
+    }
+
+    bool hasLambda() const { return lambda; }
+
+    // The bytes, without λ.
+    const std::bitset<256> &bytes() const { return bits; }
+
+    symbol_set withoutLambda() const {
+      symbol_set res(*this);
+      res.lambda = false;
+      return res;
+    }
+
+    // The bytes not in the set. Never λ.
+    symbol_set complement() const {
+      symbol_set res;
+      res.bits = ~bits;
+      return res;
+    }
+
+    bool empty() const { return !lambda && bits.none(); }
+    size_t size() const { return lambda + bits.count(); }
+
+    symbol_set &operator|=(const symbol_set &o) {
+      bits |= o.bits;
+      lambda = lambda || o.lambda;
+      return *this;
+    }
+
+    bool operator==(const symbol_set &o) const { return bits == o.bits && lambda == o.lambda; }
+    bool operator!=(const symbol_set &o) const { return !(*this == o); }
+
+    const_iterator begin() const { return const_iterator(this, -1); }
+    const_iterator end() const { return const_iterator(this, 256); }
+
+  private:
+
+    std::bitset<256> bits;
+    bool lambda;
+
+  };
+
   template <typename T>
   const std::unordered_set<symbol> getAlphabet(const T &FA) {
     
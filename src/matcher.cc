@@ -0,0 +1,323 @@
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matcher.hh"
+#include "partition.hh"
+
+namespace {
+
+  const std::string endOfFileName = "END_OF_FILE";
+  const std::string invalidName = "INVALID";
+
+  const char imageMagic[8] = { 'L', 'E', 'X', 'D', 'F', 'A', 0, 0 };
+  const uint32_t imageVersion = 1;
+  // Reads back as a different value on a machine with other byte order.
+  const uint32_t imageEndianTag = 0x01020304;
+
+  // Start of every image. Offsets are from the start of the image. The
+  // image is written in the byte order of the machine that wrote it.
+  struct image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t numberOfStates; // including the dead state
+    uint32_t numberOfClasses;
+    uint32_t initialState;
+    uint32_t dead;
+    uint32_t numberOfNames;
+    uint32_t reserved;
+    uint64_t classOfOffset;  // uint8_t[256]
+    uint64_t deltaOffset;    // uint32_t[numberOfStates][numberOfClasses], on a cache line
+    uint64_t onStopOffset;   // uint8_t[numberOfStates]
+    uint64_t acceptOffset;   // uint32_t[numberOfStates]
+    uint64_t namesOffset;    // uint32_t[numberOfNames] end of each name, then the names
+    uint64_t imageSize;
+  };
+
+  // What the scan does in the state it stops in.
+  enum stop_action : uint8_t { STOP_INVALID, STOP_IGNORE, STOP_TOKEN };
+
+  size_t alignUp(size_t x, size_t alignment) {
+    return (x + alignment - 1) / alignment * alignment;
+  }
+
+  bool inImage(uint64_t offset, uint64_t length, size_t imageSize) {
+    return offset <= imageSize && length <= imageSize - offset;
+  }
+
+} // end unnamed namespace
+
+namespace lexer {
+
+  Matcher::Matcher(const std::vector<tkn_rule> &tkn_rules) {
+    for (auto const & r: tkn_rules)
+      names.push_back(r.name);
+
+    std::vector<size_t> all;
+    for (size_t i = 0; i < tkn_rules.size(); ++i) {
+      all.push_back(i);
+    }
+    buildImage(buildRuleDFA(tkn_rules, all));
+  }
+
+  Matcher::Matcher(const DFA &d, const std::vector<std::string> &names) : names(names) {
+    buildImage(d);
+  }
+
+  Matcher::Matcher(std::shared_ptr<const uint8_t> image, size_t imageSize) {
+    attach(std::move(image), imageSize);
+  }
+
+  Matcher Matcher::fromStream(std::istream &rules) {
+    return Matcher(parseFile(rules));
+  }
+
+  void Matcher::buildImage(const DFA &d) {
+    size_t n = d.getNumberOfStates();
+    std::vector<bool> live = d.getLiveStates();
+    uint32_t deadState = n;
+
+    // Full [state][byte] table first, with an extra row for the dead
+    // state. The emitted lexers never take an edge on 0, so 0 always goes
+    // to dead and ends the scan.
+    std::vector<uint32_t> full((n+1) * 256, deadState);
+    for (auto x : d.getDelta()) {
+      symbol c = x.first.second;
+      if (c.lambda || c.val == 0 || !live[x.second]) continue;
+      full[x.first.first*256 + c.val] = x.second;
+    }
+
+    // Bytes whose columns are equal get the same class.
+    uint8_t classes[256];
+    std::map<std::vector<uint32_t>, uint8_t> columns;
+    for (int c = 0; c < 256; ++c) {
+      std::vector<uint32_t> column(n+1);
+      for (state s = 0; s <= n; ++s) {
+	column[s] = full[s*256 + c];
+      }
+      auto x = columns.insert({column, static_cast<uint8_t>(columns.size())});
+      classes[c] = x.first->second;
+    }
+    size_t C = columns.size();
+
+    image_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, imageMagic, sizeof(h.magic));
+    h.version = imageVersion;
+    h.endianTag = imageEndianTag;
+    h.numberOfStates = n+1;
+    h.numberOfClasses = C;
+    h.initialState = live[d.getInitialState()] ? d.getInitialState() : deadState;
+    h.dead = deadState;
+    h.numberOfNames = names.size();
+    h.classOfOffset = sizeof(image_header);
+    h.deltaOffset = alignUp(h.classOfOffset + 256, 64);
+    h.onStopOffset = h.deltaOffset + (n+1) * C * sizeof(uint32_t);
+    h.acceptOffset = alignUp(h.onStopOffset + n+1, sizeof(uint32_t));
+    h.namesOffset = h.acceptOffset + (n+1) * sizeof(uint32_t);
+    size_t nameChars = 0;
+    for (auto &s : names) {
+      nameChars += s.size();
+    }
+    h.imageSize = alignUp(h.namesOffset + names.size() * sizeof(uint32_t) + nameChars, 64);
+
+    uint8_t *buffer = new uint8_t[h.imageSize]();
+    std::shared_ptr<const uint8_t> owned(buffer, std::default_delete<uint8_t[]>());
+
+    std::memcpy(buffer, &h, sizeof(h));
+    std::memcpy(buffer + h.classOfOffset, classes, 256);
+
+    uint32_t *newDelta = reinterpret_cast<uint32_t*>(buffer + h.deltaOffset);
+    for (state s = 0; s <= n; ++s) {
+      for (int c = 0; c < 256; ++c) {
+	newDelta[s*C + classes[c]] = full[s*256 + c];
+      }
+    }
+
+    uint8_t *newOnStop = buffer + h.onStopOffset;
+    uint32_t *newAccept = reinterpret_cast<uint32_t*>(buffer + h.acceptOffset);
+    for (state s = 0; s <= n; ++s) {
+      acceptType a = (s < n) ? d.getAcceptTypeForState(s, lexer::REJECT) : lexer::REJECT;
+      if (a == lexer::REJECT) {
+	newOnStop[s] = STOP_INVALID;
+	newAccept[s] = getInvalidType();
+      } else {
+	newOnStop[s] = names[a-1][0] == '_' ? STOP_IGNORE : STOP_TOKEN;
+	newAccept[s] = a - 1;
+      }
+    }
+
+    uint32_t *nameEnds = reinterpret_cast<uint32_t*>(buffer + h.namesOffset);
+    char *nameChar = reinterpret_cast<char*>(nameEnds + names.size());
+    uint32_t end = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+      std::memcpy(nameChar + end, names[i].data(), names[i].size());
+      end += names[i].size();
+      nameEnds[i] = end;
+    }
+
+    attach(std::move(owned), h.imageSize);
+  }
+
+  void Matcher::attach(std::shared_ptr<const uint8_t> newImage, size_t newImageSize) {
+    if (newImageSize < sizeof(image_header)) {
+      throw std::runtime_error("DFA image error: file too small");
+    }
+    image_header h;
+    std::memcpy(&h, newImage.get(), sizeof(h));
+    if (std::memcmp(h.magic, imageMagic, sizeof(h.magic)) != 0) {
+      throw std::runtime_error("DFA image error: not a DFA image");
+    }
+    if (h.endianTag != imageEndianTag) {
+      throw std::runtime_error("DFA image error: written on a machine with different byte order");
+    }
+    if (h.version != imageVersion) {
+      throw std::runtime_error("DFA image error: unsupported version " + std::to_string(h.version));
+    }
+    uint64_t cells = uint64_t(h.numberOfStates) * h.numberOfClasses;
+    if (h.imageSize != newImageSize || h.numberOfStates == 0 ||
+	h.initialState >= h.numberOfStates || h.dead >= h.numberOfStates ||
+	h.numberOfClasses == 0 || h.numberOfClasses > 256 ||
+	h.deltaOffset % sizeof(uint32_t) || h.acceptOffset % sizeof(uint32_t) ||
+	h.namesOffset % sizeof(uint32_t) ||
+	!inImage(h.classOfOffset, 256, newImageSize) ||
+	!inImage(h.deltaOffset, cells * sizeof(uint32_t), newImageSize) ||
+	!inImage(h.onStopOffset, h.numberOfStates, newImageSize) ||
+	!inImage(h.acceptOffset, uint64_t(h.numberOfStates) * sizeof(uint32_t), newImageSize) ||
+	!inImage(h.namesOffset, uint64_t(h.numberOfNames) * sizeof(uint32_t), newImageSize)) {
+      throw std::runtime_error("DFA image error: corrupt header");
+    }
+
+    // The scan indexes with the tables as they are, so every entry is
+    // checked: classes and states in range, the terminating 0 ends the
+    // scan in every state, and tokens have a name.
+    const uint8_t *base = newImage.get();
+    const uint8_t *newClassOf = base + h.classOfOffset;
+    const uint32_t *newDelta = reinterpret_cast<const uint32_t*>(base + h.deltaOffset);
+    const uint8_t *newOnStop = base + h.onStopOffset;
+    const uint32_t *newAccept = reinterpret_cast<const uint32_t*>(base + h.acceptOffset);
+    for (int c = 0; c < 256; ++c) {
+      if (newClassOf[c] >= h.numberOfClasses) {
+	throw std::runtime_error("DFA image error: corrupt tables");
+      }
+    }
+    for (uint64_t i = 0; i < cells; ++i) {
+      if (newDelta[i] >= h.numberOfStates) {
+	throw std::runtime_error("DFA image error: corrupt tables");
+      }
+    }
+    for (uint32_t s = 0; s < h.numberOfStates; ++s) {
+      if (newDelta[uint64_t(s)*h.numberOfClasses + newClassOf[0]] != h.dead || newOnStop[s] > STOP_TOKEN ||
+	  (newOnStop[s] == STOP_TOKEN && newAccept[s] >= h.numberOfNames)) {
+	throw std::runtime_error("DFA image error: corrupt tables");
+      }
+    }
+
+    const uint32_t *nameEnds = reinterpret_cast<const uint32_t*>(base + h.namesOffset);
+    const char *nameChar = reinterpret_cast<const char*>(nameEnds + h.numberOfNames);
+    uint64_t nameCharOffset = h.namesOffset + uint64_t(h.numberOfNames) * sizeof(uint32_t);
+    names.clear();
+    uint32_t begin = 0;
+    for (uint32_t i = 0; i < h.numberOfNames; ++i) {
+      if (nameEnds[i] < begin || !inImage(nameCharOffset, nameEnds[i], newImageSize)) {
+	throw std::runtime_error("DFA image error: corrupt names");
+      }
+      names.emplace_back(nameChar + begin, nameChar + nameEnds[i]);
+      begin = nameEnds[i];
+    }
+
+    image = std::move(newImage);
+    imageSize = newImageSize;
+    numberOfStates = h.numberOfStates;
+    numberOfClasses = h.numberOfClasses;
+    initialState = h.initialState;
+    dead = h.dead;
+    classOf = newClassOf;
+    delta = newDelta;
+    onStop = newOnStop;
+    accept = newAccept;
+  }
+
+  Matcher Matcher::load(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open: " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      throw std::runtime_error("Could not read: " + filename);
+    }
+    size_t size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("Could not map: " + filename);
+    }
+    std::shared_ptr<const uint8_t> mapped(static_cast<const uint8_t*>(addr),
+					  [size](const uint8_t *p) {
+					    munmap(const_cast<uint8_t*>(p), size);
+					  });
+    return Matcher(std::move(mapped), size);
+  }
+
+  void Matcher::save(std::ostream &os) const {
+    os.write(reinterpret_cast<const char*>(image.get()), imageSize);
+  }
+
+  Matcher::Token Matcher::getNextToken(const char *&str) const {
+    const uint8_t *start;
+    const uint8_t *curr = reinterpret_cast<const uint8_t*>(str);
+
+    for (;;) {
+      start = curr;
+      if (*curr == 0) {
+	str = reinterpret_cast<const char*>(curr);
+	return Token{str, str, getEndOfFileType()};
+      }
+
+      // Advance until there is no edge, exactly like the emitted lexer.
+      uint32_t s = initialState;
+      for (;;) {
+	uint32_t next = delta[s*numberOfClasses + classOf[*curr]];
+	if (next == dead) break;
+	s = next;
+	++curr;
+      }
+
+      // Like the emitted lexer, a scan that stops in the initial state
+      // ends at the terminating 0, or else takes the byte it stopped on
+      // into an INVALID token, also when the initial state was entered
+      // again after a prefix of a token.
+      if (s == initialState && *curr == 0) {
+	str = reinterpret_cast<const char*>(curr);
+	return Token{reinterpret_cast<const char*>(start), str, getEndOfFileType()};
+      }
+
+      switch (onStop[s]) {
+      case STOP_IGNORE:
+	continue;
+      case STOP_TOKEN:
+	str = reinterpret_cast<const char*>(curr);
+	return Token{reinterpret_cast<const char*>(start), str, accept[s]};
+      case STOP_INVALID:
+      default:
+	if (s == initialState) ++curr;
+	str = reinterpret_cast<const char*>(curr);
+	return Token{reinterpret_cast<const char*>(start), str, getInvalidType()};
+      }
+    }
+  }
+
+  const std::string &Matcher::getName(uint32_t type) const {
+    if (type < names.size()) return names[type];
+    if (type == getEndOfFileType()) return endOfFileName;
+    return invalidName;
+  }
+
+} // end namespace lexer
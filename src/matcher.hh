@@ -0,0 +1,111 @@
+#ifndef MATCHER_HH_GUARD
+#define MATCHER_HH_GUARD
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DFA.hh"
+#include "parser.hh"
+
+namespace lexer {
+
+  // A lexer compiled in-process from rules, without emitting code. It
+  // returns the same tokens as the Tokenizer cpp_emitter emits for the
+  // same rules. Token types are rule indices, followed by the types
+  // getEndOfFileType() and getInvalidType(), like the emitted TokenType.
+  //
+  // The tables are kept in one image with the layout of the files save()
+  // writes, so load() can scan straight from the mapped file.
+  //
+  // A Matcher is immutable once constructed, so one instance can be used
+  // from several threads at the same time. Copies share the image.
+  class Matcher {
+
+  public:
+
+    struct Token {
+      const char *start, *curr;
+      uint32_t tkn;
+    };
+
+    // Keeps the position in one 0 terminated input.
+    class Tokenizer {
+    public:
+      Tokenizer(const Matcher &m, const char *str) : m(&m), str(str) {}
+      Token getNextToken() { return m->getNextToken(str); }
+    private:
+      const Matcher *m;
+      const char *str;
+    };
+
+    explicit Matcher(const std::vector<tkn_rule> &tkn_rules);
+
+    // d must be minimized and use rule index + 1 as accept types.
+    Matcher(const DFA &d, const std::vector<std::string> &names);
+
+    // Reads rules in the format of parseFile.
+    static Matcher fromStream(std::istream &rules);
+
+    // Maps a file written by save(). The tables are used in place, so
+    // processes loading the same file share its pages. The header and
+    // every table entry are checked, and a corrupt file throws.
+    static Matcher load(const std::string &filename);
+
+    // Writes the versioned binary image of the tables and rule names.
+    void save(std::ostream &os) const;
+
+    // Returns the token at str, which must be 0 terminated, and moves str
+    // past it.
+    Token getNextToken(const char *&str) const;
+
+    Tokenizer tokenize(const char *str) const { return Tokenizer(*this, str); }
+
+    uint32_t getEndOfFileType() const { return names.size(); }
+    uint32_t getInvalidType() const { return names.size() + 1; }
+
+    // Rule name of a token type, or END_OF_FILE or INVALID.
+    const std::string &getName(uint32_t type) const;
+
+    size_t getNumberOfStates() const { return numberOfStates; }
+    size_t getNumberOfClasses() const { return numberOfClasses; }
+
+  private:
+
+    Matcher(std::shared_ptr<const uint8_t> image, size_t imageSize);
+
+    void buildImage(const DFA &d);
+
+    // Points the table members into the image and reads the names.
+    void attach(std::shared_ptr<const uint8_t> image, size_t imageSize);
+
+    std::vector<std::string> names;
+
+    std::shared_ptr<const uint8_t> image;
+    size_t imageSize;
+
+    size_t numberOfStates;
+    uint32_t dead;
+    uint32_t initialState;
+
+    // Bytes with the same transitions in every state share a class.
+    const uint8_t *classOf;
+    size_t numberOfClasses;
+
+    // delta[s*numberOfClasses + classOf[c]] is the next state or dead.
+    const uint32_t *delta;
+
+    // What to do when the scan stops in a state, see stop_action in
+    // matcher.cc.
+    const uint8_t *onStop;
+    // Token type returned when the scan stops in a state.
+    const uint32_t *accept;
+
+  };
+
+} // end namespace lexer
+
+#endif // MATCHER_HH_GUARD
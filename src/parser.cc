@@ -79,7 +79,7 @@ std::shared_ptr<RegularExpression> Parser::parseInner() {
       ++pos;
     }
   
-    std::unordered_set<symbol> chars;
+    symbol_set chars;
     while (*pos != ']') {
       switch (*pos) {
       case '\\':
@@ -165,9 +165,23 @@ std::shared_ptr<RegularExpression> Parser::parseInner() {
 
 }
 
+static token_action parseAction(const std::string &action, size_t linenumber) {
+  if (action == "decimal") return token_action::DECIMAL;
+  if (action == "hash") return token_action::HASH;
+  if (action == "newlines") return token_action::NEWLINES;
+  if (action == "intern") return token_action::INTERN;
+  std::stringstream error_string;
+  error_string << "Parser error: unknown action '" << action << "'" << std::endl;
+  error_string << "Error on line " << linenumber << std::endl;
+  throw std::runtime_error(error_string.str());
+}
+
 tkn_rule parseLine(std::string &line, size_t linenumber) {
 
   std::stringstream ss;
+  std::stringstream action;
+  bool inAction = false;
+  bool hasAction = false;
   size_t pos = 0;
   for (; pos < line.length()-1; ++pos) {
     if (line[pos] == ':' && line[pos+1] == '=') {
@@ -175,8 +189,13 @@ tkn_rule parseLine(std::string &line, size_t linenumber) {
       break;
     }
 
-    if (line[pos] != ' ')
-      ss << line[pos];
+    if (line[pos] == '{' && !hasAction) {
+      inAction = hasAction = true;
+    } else if (line[pos] == '}' && inAction) {
+      inAction = false;
+    } else if (line[pos] != ' ') {
+      (inAction ? action : ss) << line[pos];
+    }
   }
   
   while (line[pos] == ' ') ++pos;
@@ -185,7 +204,12 @@ tkn_rule parseLine(std::string &line, size_t linenumber) {
   std::string rest = line.substr(pos);
   Parser p(rest, linenumber, pos);
 
-  tkn_rule a = {name, p.parseTree, name[0]=='_'};
+  token_action a_action = token_action::NONE;
+  if (hasAction) {
+    a_action = parseAction(action.str(), linenumber);
+  }
+
+  tkn_rule a = {name, p.parseTree, name[0]=='_', a_action};
 
   return a;
 
@@ -7,13 +7,25 @@
 
 namespace lexer {
 
+// Value computed from the bytes of a token while it is scanned, written
+// after the rule name: NAME {decimal} := regexp
+enum class token_action {
+  NONE,
+  DECIMAL,  // {decimal}: the digits of the token as a decimal number
+  HASH,     // {hash}: FNV-1a hash of the token
+  NEWLINES, // {newlines}: number of '\n' in the token
+  INTERN    // {intern}: like hash, and the lexer gets an InternTable
+};
+
 struct tkn_rule {
   std::string name;
   std::shared_ptr<RegularExpression> regexp;
   bool ignore = false;   
+  token_action action = token_action::NONE;
 
-  tkn_rule(std::string name, std::shared_ptr<RegularExpression> regexp, bool ignore = false) :
-    name(name), regexp(regexp), ignore(ignore) {}
+  tkn_rule(std::string name, std::shared_ptr<RegularExpression> regexp, bool ignore = false,
+	   token_action action = token_action::NONE) :
+    name(name), regexp(regexp), ignore(ignore), action(action) {}
 };
 
 class Parser {
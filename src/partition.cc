@@ -0,0 +1,93 @@
+#include "partition.hh"
+#include "NFA.hh"
+#include "RegularExpression.hh"
+#include "derivatives.hh"
+
+#include <queue>
+#include <set>
+
+namespace lexer {
+
+  DFA buildRuleDFA(const std::vector<tkn_rule> &tkn_rules, const std::vector<size_t> &indices,
+		   rule_construction construction) {
+    if (construction == rule_construction::DERIVATIVES) {
+      std::vector<tkn_rule> selected;
+      for (auto i : indices)
+	selected.push_back(tkn_rules[i]);
+      DFA d = buildDerivativeDFA(selected);
+      // Types are positions in selected plus one, make them rule indices plus one.
+      std::unordered_map<state, acceptType> A;
+      for (auto &x : d.getAcceptStates())
+	A[x.first] = indices[x.second - 1] + 1;
+      return DFA(d.getNumberOfStates(), A, d.getInitialState(), d.getDelta());
+    }
+    NFA f(1, std::unordered_map<state, acceptType>(), 0, {});
+    for (auto i : indices) {
+      if (construction == rule_construction::GLUSHKOV)
+	f = lexer::NFA::joinInitials(f, tkn_rules[i].regexp->getGlushkovNFA(i+1));
+      else
+	f = lexer::NFA::join(f, tkn_rules[i].regexp->getNFA(i+1));
+    }
+    DFA d = f.determinize();
+    d.minimize();
+    return d;
+  }
+
+  std::vector<rule_group> partitionRules(const std::vector<tkn_rule> &tkn_rules, size_t stateBudget,
+					 rule_construction construction) {
+    std::vector<rule_group> groups;
+
+    for (size_t i = 0; i < tkn_rules.size(); ++i) {
+      bool placed = false;
+      for (auto &g : groups) {
+	std::vector<size_t> candidate(g.rules);
+	candidate.push_back(i);
+	DFA d = buildRuleDFA(tkn_rules, candidate, construction);
+	if (d.getNumberOfStates() <= stateBudget) {
+	  g.rules = std::move(candidate);
+	  g.dfa = std::move(d);
+	  placed = true;
+	  break;
+	}
+      }
+      if (!placed) {
+	groups.push_back(rule_group{{i}, buildRuleDFA(tkn_rules, {i}, construction)});
+      }
+    }
+
+    return groups;
+  }
+
+  std::vector<std::pair<size_t, size_t> > overlappingRules(const std::vector<rule_group> &groups) {
+    std::vector<std::pair<size_t, size_t> > res;
+    for (size_t g = 0; g < groups.size(); ++g) {
+      for (size_t h = g+1; h < groups.size(); ++h) {
+	const DFA &a = groups[g].dfa, &b = groups[h].dfa;
+	// Breadth first over the pairs of states both DFAs reach on a string.
+	std::set<std::pair<state, state> > seen = {{a.getInitialState(), b.getInitialState()}};
+	std::queue<std::pair<state, state> > queue;
+	queue.push(*seen.begin());
+	while (!queue.empty()) {
+	  auto p = queue.front();
+	  queue.pop();
+	  acceptType x = a.getAcceptTypeForState(p.first, REJECT);
+	  acceptType y = b.getAcceptTypeForState(p.second, REJECT);
+	  if (x != REJECT && y != REJECT) {
+	    res.push_back({x - 1, y - 1});
+	    break;
+	  }
+	  for (auto iter = a.getDelta().lower_bound({p.first, symbol::min()});
+	       iter != a.getDelta().end() && iter->first.first == p.first; ++iter) {
+	    auto other = b.getDelta().find({p.second, iter->first.second});
+	    if (other == b.getDelta().end()) continue;
+	    std::pair<state, state> next{iter->second, other->second};
+	    if (seen.insert(next).second)
+	      queue.push(next);
+	  }
+	}
+      }
+    }
+    return res;
+  }
+
+} // end namespace lexer
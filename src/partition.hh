@@ -0,0 +1,42 @@
+#ifndef PARTITION_HH_GUARD
+#define PARTITION_HH_GUARD
+
+#include <utility>
+#include <vector>
+
+#include "DFA.hh"
+#include "parser.hh"
+
+namespace lexer {
+
+  struct rule_group {
+    std::vector<size_t> rules; // indices into the rule list, increasing
+    DFA dfa;
+  };
+
+  // How buildRuleDFA gets the DFA of the rules: from their Thompson or
+  // Glushkov NFAs, or from Brzozowski derivatives without an NFA. All give
+  // the same minimized DFA.
+  enum class rule_construction { THOMPSON, GLUSHKOV, DERIVATIVES };
+
+  // Builds the minimized DFA of the rules with the given indices. Accept
+  // types are the index of the rule plus one, like for the DFA of all
+  // rules, so the DFAs of different groups agree on them.
+  DFA buildRuleDFA(const std::vector<tkn_rule> &tkn_rules, const std::vector<size_t> &indices,
+		   rule_construction construction = rule_construction::THOMPSON);
+
+  // Splits the rules into groups whose DFAs have at most stateBudget
+  // states. Each rule goes into the first group that stays within the
+  // budget with it, or into a new group. A rule that exceeds the budget
+  // on its own gets a group to itself.
+  std::vector<rule_group> partitionRules(const std::vector<tkn_rule> &tkn_rules, size_t stateBudget,
+					 rule_construction construction = rule_construction::THOMPSON);
+
+  // For every two groups whose DFAs accept a common string, the indices
+  // of one rule of each that both match it. Without such rules the
+  // lockstep Tokenizer returns the tokens of the DFA of all rules.
+  std::vector<std::pair<size_t, size_t> > overlappingRules(const std::vector<rule_group> &groups);
+
+} // end namespace lexer
+
+#endif // PARTITION_HH_GUARD
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "profile.hh"
+
+namespace lexer {
+
+  bool transition_profile::empty() const {
+    return numberOfStates == 0;
+  }
+
+  uint64_t transition_profile::getStateVisits(state s) const {
+    if (s >= stateVisits.size()) return 0;
+    return stateVisits[s];
+  }
+
+  uint64_t transition_profile::getEdgeCount(state from, state to) const {
+    auto x = edgeCounts.find({from, to});
+    return (x == std::end(edgeCounts)) ? 0 : x->second;
+  }
+
+  std::vector<state> transition_profile::hotStateOrder() const {
+    std::vector<state> order(numberOfStates);
+    for (state s = 0; s < numberOfStates; ++s) {
+      order[s] = s;
+    }
+    std::stable_sort(std::begin(order), std::end(order),
+		     [this](state a, state b) {
+		       return getStateVisits(a) > getStateVisits(b);
+		     });
+    return order;
+  }
+
+  uint64_t fingerprint(const DFA &d) {
+    // FNV-1a over the numbers, the delta in its map order.
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto add = [&h](uint64_t x) {
+      for (int i = 0; i < 8; ++i) {
+	h = (h ^ ((x >> (8*i)) & 0xff)) * 0x100000001b3ull;
+      }
+    };
+    add(d.getNumberOfStates());
+    add(d.getInitialState());
+    for (state s = 0; s < d.getNumberOfStates(); ++s) {
+      add(d.getAcceptTypeForState(s, REJECT));
+    }
+    for (auto &x : d.getDelta()) {
+      add(x.first.first);
+      add(x.first.second.lambda ? 256 : x.first.second.val);
+      add(x.second);
+    }
+    return h;
+  }
+
+  // The file is line based:
+  //
+  //   lexer-profile 2 <number of states> <fingerprint of the DFA>
+  //   s <state> <visits>
+  //   e <from> <to> <transitions>
+  //
+  transition_profile readProfile(std::istream &is, const DFA &d) {
+    transition_profile p;
+    std::string magic;
+    int version;
+    size_t numberOfStates;
+    uint64_t dfaFingerprint;
+
+    if (!(is >> magic >> version) || magic != "lexer-profile") {
+      throw std::runtime_error("Profile error: missing 'lexer-profile' header");
+    }
+    if (version != 2) {
+      throw std::runtime_error("Profile error: unsupported version " + std::to_string(version));
+    }
+    if (!(is >> numberOfStates >> dfaFingerprint)) {
+      throw std::runtime_error("Profile error: malformed 'lexer-profile' header");
+    }
+    if (numberOfStates != d.getNumberOfStates()) {
+      std::stringstream error_string;
+      error_string << "Profile error: profile has " << numberOfStates
+		   << " states but the DFA has " << d.getNumberOfStates() << std::endl
+		   << "The profile must be recorded on a lexer generated from the same rules.";
+      throw std::runtime_error(error_string.str());
+    }
+    if (dfaFingerprint != fingerprint(d)) {
+      throw std::runtime_error("Profile error: profile was recorded on a lexer for another DFA\n"
+			       "The profile must be recorded on a lexer generated from the same rules and options.");
+    }
+
+    p.numberOfStates = numberOfStates;
+    p.stateVisits.assign(numberOfStates, 0);
+
+    std::string kind;
+    while (is >> kind) {
+      if (kind == "s") {
+	state s;
+	uint64_t visits;
+	if (!(is >> s >> visits) || s >= numberOfStates) {
+	  throw std::runtime_error("Profile error: malformed state line");
+	}
+	p.stateVisits[s] += visits;
+      } else if (kind == "e") {
+	state from, to;
+	uint64_t count;
+	if (!(is >> from >> to >> count) || from >= numberOfStates || to >= numberOfStates) {
+	  throw std::runtime_error("Profile error: malformed edge line");
+	}
+	p.edgeCounts[{from, to}] += count;
+      } else {
+	throw std::runtime_error("Profile error: unexpected entry '" + kind + "'");
+      }
+    }
+
+    return p;
+  }
+
+} // end namespace lexer
@@ -0,0 +1,44 @@
+#ifndef PROFILE_HH_GUARD
+#define PROFILE_HH_GUARD
+
+#include <istream>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "DFA.hh"
+#include "lexer_common.hh"
+
+namespace lexer {
+
+  // Transition frequencies recorded by a lexer emitted with
+  // --profile-generate. State ids refer to the minimized DFA the
+  // instrumented lexer was emitted from.
+  struct transition_profile {
+    size_t numberOfStates = 0;
+    std::vector<uint64_t> stateVisits;
+    std::map<std::pair<state, state>, uint64_t> edgeCounts;
+
+    bool empty() const;
+
+    uint64_t getStateVisits(state s) const;
+
+    uint64_t getEdgeCount(state from, state to) const;
+
+    // All states of the DFA, most visited first. Ties keep id order.
+    std::vector<state> hotStateOrder() const;
+
+  };
+
+  // A hash of the states, edges and accept types of d. The instrumented
+  // lexer writes it into its profile, so a profile recorded on a lexer
+  // for another DFA with the same number of states is not taken.
+  uint64_t fingerprint(const DFA &d);
+
+  // Parses a profile written by the instrumented lexer and checks that
+  // it was recorded on a lexer for d.
+  transition_profile readProfile(std::istream &is, const DFA &d);
+
+} // end namespace lexer
+
+#endif // PROFILE_HH_GUARD
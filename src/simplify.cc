@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include "simplify.hh"
+
+namespace lexer {
+
+  std::shared_ptr<RegularExpression> Simplifier::simplify(const std::shared_ptr<RegularExpression> &r) {
+    if (auto x = std::dynamic_pointer_cast<RegExpChars>(r)) {
+      return makeChars(x->chars);
+    }
+    if (auto x = std::dynamic_pointer_cast<RegExpConcat>(r)) {
+      node l = simplify(x->left);
+      return makeConcat({l, simplify(x->right)});
+    }
+    if (auto x = std::dynamic_pointer_cast<RegExpOr>(r)) {
+      node l = simplify(x->left);
+      return makeOr({l, simplify(x->right)});
+    }
+    if (auto x = std::dynamic_pointer_cast<RegExpStar>(r)) {
+      return makeStar(simplify(x->inner));
+    }
+    if (auto x = std::dynamic_pointer_cast<RegExpPlus>(r)) {
+      return makePlus(simplify(x->inner));
+    }
+    if (auto x = std::dynamic_pointer_cast<RegExpOpt>(r)) {
+      return makeOpt(simplify(x->left));
+    }
+    throw std::runtime_error("Unknown regular expression node");
+  }
+
+  Simplifier::node Simplifier::makeChars(const symbol_set &chars) {
+    std::string k = (chars.hasLambda() ? "cL" : "c") + chars.bytes().to_string();
+    auto x = nodes.find(k);
+    if (x != std::end(nodes)) return x->second;
+    return intern(k, std::make_shared<RegExpChars>(chars, false));
+  }
+
+  Simplifier::node Simplifier::makeConcat(const std::vector<node> &parts) {
+    std::vector<node> all;
+    for (auto &p : parts) {
+      std::vector<node> f = factors(p);
+      all.insert(std::end(all), std::begin(f), std::end(f));
+    }
+    // Right nested, so equal suffixes are shared.
+    node res = all.back();
+    for (size_t i = all.size() - 1; i-- > 0; ) {
+      res = intern(key('.', {all[i], res}), std::make_shared<RegExpConcat>(all[i], res));
+    }
+    return res;
+  }
+
+  Simplifier::node Simplifier::makeOr(const std::vector<node> &parts) {
+    std::vector<node> alternatives;
+    for (node p : parts) {
+      while (auto x = std::dynamic_pointer_cast<RegExpOr>(p)) {
+	alternatives.push_back(x->left);
+	p = x->right;
+      }
+      alternatives.push_back(p);
+    }
+
+    // Alternatives with the same first factor share it.
+    std::vector<node> heads;
+    std::map<const RegularExpression*, std::vector<std::vector<node> > > tails;
+    for (auto &a : alternatives) {
+      std::vector<node> f = factors(a);
+      auto &t = tails[f[0].get()];
+      if (t.empty()) heads.push_back(f[0]);
+      t.emplace_back(std::begin(f) + 1, std::end(f));
+    }
+    std::vector<node> factored;
+    symbol_set chars;
+    bool hasChars = false;
+    for (auto &h : heads) {
+      auto &t = tails[h.get()];
+      node alt = h;
+      if (t.size() > 1) {
+	std::vector<node> rests;
+	bool optional = false;
+	for (auto &r : t) {
+	  if (r.empty())
+	    optional = true;
+	  else
+	    rests.push_back(makeConcat(r));
+	}
+	if (!rests.empty()) {
+	  node rest = makeOr(rests);
+	  alt = makeConcat({h, optional ? makeOpt(rest) : rest});
+	}
+      } else if (!t[0].empty()) {
+	std::vector<node> whole(1, h);
+	whole.insert(std::end(whole), std::begin(t[0]), std::end(t[0]));
+	alt = makeConcat(whole);
+      }
+      if (auto x = std::dynamic_pointer_cast<RegExpChars>(alt)) {
+	chars |= x->chars;
+	hasChars = true;
+      } else {
+	factored.push_back(alt);
+      }
+    }
+    if (hasChars) factored.push_back(makeChars(chars));
+
+    std::sort(std::begin(factored), std::end(factored), [this](const node &a, const node &b) {
+	return ids.at(a.get()) < ids.at(b.get());
+      });
+    factored.erase(std::unique(std::begin(factored), std::end(factored)), std::end(factored));
+
+    node res = factored.back();
+    for (size_t i = factored.size() - 1; i-- > 0; ) {
+      res = intern(key('|', {factored[i], res}), std::make_shared<RegExpOr>(factored[i], res));
+    }
+    return res;
+  }
+
+  Simplifier::node Simplifier::makeStar(const node &inner) {
+    if (std::dynamic_pointer_cast<RegExpStar>(inner)) return inner;
+    if (auto x = std::dynamic_pointer_cast<RegExpPlus>(inner)) return makeStar(x->inner);
+    if (auto x = std::dynamic_pointer_cast<RegExpOpt>(inner)) return makeStar(x->left);
+    return intern(key('*', {inner}), std::make_shared<RegExpStar>(inner));
+  }
+
+  Simplifier::node Simplifier::makePlus(const node &inner) {
+    if (std::dynamic_pointer_cast<RegExpStar>(inner)) return inner;
+    if (std::dynamic_pointer_cast<RegExpPlus>(inner)) return inner;
+    if (auto x = std::dynamic_pointer_cast<RegExpOpt>(inner)) return makeStar(x->left);
+    return intern(key('+', {inner}), std::make_shared<RegExpPlus>(inner));
+  }
+
+  Simplifier::node Simplifier::makeOpt(const node &inner) {
+    if (std::dynamic_pointer_cast<RegExpStar>(inner)) return inner;
+    if (std::dynamic_pointer_cast<RegExpOpt>(inner)) return inner;
+    if (auto x = std::dynamic_pointer_cast<RegExpPlus>(inner)) return makeStar(x->inner);
+    return intern(key('?', {inner}), std::make_shared<RegExpOpt>(inner));
+  }
+
+  std::vector<Simplifier::node> Simplifier::factors(const node &n) const {
+    std::vector<node> res;
+    node curr = n;
+    while (auto x = std::dynamic_pointer_cast<RegExpConcat>(curr)) {
+      res.push_back(x->left);
+      curr = x->right;
+    }
+    res.push_back(curr);
+    return res;
+  }
+
+  Simplifier::node Simplifier::intern(const std::string &k, node n) {
+    auto x = nodes.insert({k, n});
+    if (x.second) {
+      size_t id = ids.size();
+      ids[n.get()] = id;
+    }
+    return x.first->second;
+  }
+
+  std::string Simplifier::key(char kind, const std::vector<node> &children) const {
+    std::string res(1, kind);
+    for (auto &c : children) {
+      res += std::to_string(ids.at(c.get())) + ",";
+    }
+    return res;
+  }
+
+  void simplifyRules(std::vector<tkn_rule> &tkn_rules) {
+    Simplifier s;
+    for (auto &r : tkn_rules) {
+      r.regexp = s.simplify(r.regexp);
+    }
+  }
+
+} // end namespace lexer
@@ -0,0 +1,55 @@
+#ifndef SIMPLIFY_HH_GUARD
+#define SIMPLIFY_HH_GUARD
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "parser.hh"
+#include "RegularExpression.hh"
+
+namespace lexer {
+
+  // Rewrites regular expressions into smaller ones for the same strings,
+  // so their NFAs have fewer states:
+  //  - alternatives of single characters become one RegExpChars,
+  //  - nested *, + and ? collapse into one,
+  //  - alternatives with a common first part share it: ab|ac is a(b|c),
+  //  - equal subexpressions, also across rules, are one shared node.
+  class Simplifier {
+
+  public:
+
+    std::shared_ptr<RegularExpression> simplify(const std::shared_ptr<RegularExpression> &r);
+
+  private:
+
+    typedef std::shared_ptr<RegularExpression> node;
+
+    node makeChars(const symbol_set &chars);
+    node makeConcat(const std::vector<node> &factors);
+    node makeOr(const std::vector<node> &alternatives);
+    node makeStar(const node &inner);
+    node makePlus(const node &inner);
+    node makeOpt(const node &inner);
+
+    // The factors of a concatenation, or n alone.
+    std::vector<node> factors(const node &n) const;
+
+    // Returns the node equal to n if there is one, else n.
+    node intern(const std::string &key, node n);
+    std::string key(char kind, const std::vector<node> &children) const;
+
+    std::unordered_map<std::string, node> nodes;
+    // Interned nodes are numbered in the order they were made.
+    std::unordered_map<const RegularExpression*, size_t> ids;
+
+  };
+
+  // Simplifies the regular expressions of all rules with one Simplifier.
+  void simplifyRules(std::vector<tkn_rule> &tkn_rules);
+
+} // end namespace lexer
+
+#endif // SIMPLIFY_HH_GUARD
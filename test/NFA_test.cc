@@ -6,7 +6,11 @@
 
 #include "../src/DFA.hh"
 #include "../src/NFA.hh"
+#include "../src/bit_nfa.hh"
+#include "../src/derivatives.hh"
 #include "../src/lexer_common.hh"
+#include "../src/parser.hh"
+#include "../src/simplify.hh"
 
 size_t counter = 0;
 
@@ -21,6 +25,25 @@ bool agree(T1 &m1, T2 &m2, std::string &x, std::string error) {
   return true;
 }
 
+// Calls fn on every string over alphabet up to maxLength, shortest first,
+// until it returns false. Returns whether it returned true for all.
+template<typename F>
+bool forAllStrings(const std::string &alphabet, size_t maxLength, F fn) {
+  std::vector<std::string> strs = {""};
+  for (size_t i = 0; i < strs.size(); ++i) {
+    std::string x = strs[i];
+    if (!fn(x)) {
+      return false;
+    }
+    if (x.size() < maxLength) {
+      for (char c : alphabet) {
+	strs.push_back(x + c);
+      }
+    }
+  }
+  return true;
+}
+
 void printResult(bool success) {
   std::cout << "Test case #" << counter++ << ":\t" << (success?"Pass":"Fail") << std::endl;
 }
@@ -105,6 +128,205 @@ void testDeterminize2() {
   std::cout << "testDeterminize2: passed" << std::endl;
 }
 
+// A negated set is one edge on the other bytes, and it does not match
+// the empty string.
+void testNegatedSet() {
+  lexer::Parser p("a[^b]", 0, 0);
+  lexer::NFA nfa = p.parseTree->getNFA(1);
+  if (nfa.getDelta().size() != 3 || nfa.accept("a") || !nfa.accept("ac") || nfa.accept("ab") ||
+      !nfa.accept(std::string("a\0", 2)) || !nfa.accept("a\xff")) {
+    std::cout << "testNegatedSet: failed" << std::endl;
+    return;
+  }
+  std::cout << "testNegatedSet: passed" << std::endl;
+}
+
+// Closures from the strongly connected components are the states
+// reachable on λ edges.
+void testLambdaClosures() {
+  // Cycles 0-1-2 and 4-5, a chain 2-3-4, 6 alone and 7-6.
+  std::multimap<std::pair<lexer::state, lexer::symbol>, lexer::state> d;
+  std::vector<std::pair<lexer::state, lexer::state> > lambdas = {{0,1}, {1,2}, {2,0}, {2,3}, {3,4},
+								    {4,5}, {5,4}, {7,6}, {1,1}};
+  for (auto &x : lambdas) {
+    d.insert({{x.first, lexer::LAMBDA}, x.second});
+  }
+  d.insert({{3, symbol('a')}, 7});
+  lexer::NFA nfa(8, {{5,1}}, 0, d);
+  lexer::LambdaClosures closures(nfa);
+  for (lexer::state s = 0; s < 8; ++s) {
+    std::vector<bool> reached(8, false);
+    std::vector<lexer::state> stack = {s};
+    reached[s] = true;
+    while (!stack.empty()) {
+      lexer::state x = stack.back();
+      stack.pop_back();
+      for (auto &e : lambdas) {
+	if (e.first == x && !reached[e.second]) {
+	  reached[e.second] = true;
+	  stack.push_back(e.second);
+	}
+      }
+    }
+    for (lexer::state t = 0; t < 8; ++t) {
+      if (reached[t] != (closures.of(s)[0] >> t & 1)) {
+	std::cout << "testLambdaClosures: failed, " << t << " in closure of " << s << std::endl;
+	return;
+      }
+    }
+  }
+  if (closures.getNumberOfComponents() != 5 || closures.getComponent(0) != closures.getComponent(2)) {
+    std::cout << "testLambdaClosures: failed, " << closures.getNumberOfComponents() << " components" << std::endl;
+    return;
+  }
+  std::cout << "testLambdaClosures: passed" << std::endl;
+}
+
+// BitParallelNFA against the DFA of the same NFA, on every string over
+// {a, b, c} up to length 8. The last NFA has more than 64 states.
+void testBitParallel() {
+  std::vector<std::string> regexps = {"a*b", "(a|b)*abb", "a?b+c*", "[^a]c|ab",
+				      "((a|b)(a|c))*", "((a|b)*a(a|b)(a|b)(a|b)|(b|c)*c(b|c)(b|c)(b|c)|(a|c)*b(a|c)(a|c))(a|c)"};
+  for (auto &r : regexps) {
+    lexer::Parser p1(r, 0, 0), p2("(a|b|c)c", 0, 0);
+    lexer::NFA nfa = lexer::NFA::join(p1.parseTree->getNFA(1), p2.parseTree->getNFA(2));
+    lexer::BitParallelNFA bits(nfa);
+    lexer::NFA copy(nfa);
+    lexer::DFA dfa = copy.determinize();
+
+    bool ok = forAllStrings("abc", 8, [&](const std::string &x) {
+	if (bits.accept(x) != dfa.accept(x)) {
+	  std::cout << "testBitParallel: failed on " << r << " and " << x << std::endl;
+	  return false;
+	}
+	return true;
+      });
+    if (!ok) {
+      return;
+    }
+  }
+  std::cout << "testBitParallel: passed" << std::endl;
+}
+
+// Glushkov automata have one state per leaf plus the initial state, no
+// λ edges, and accept the same strings as the Thompson automata.
+void testGlushkov() {
+  std::vector<std::string> regexps = {"a*b", "(a|b)*abb", "a?b+c*", "[^a]c|ab", "((a|b)(a|c))*",
+				      "(a*)*|b?", "(ab|c)+a?"};
+  lexer::NFA thompson(1, std::unordered_map<lexer::state, lexer::acceptType>(), 0, {});
+  lexer::NFA glushkov(thompson);
+  for (size_t i = 0; i < regexps.size(); ++i) {
+    lexer::Parser p(regexps[i], 0, 0);
+    lexer::NFA g = p.parseTree->getGlushkovNFA(i+1);
+    lexer::glushkov_positions positions;
+    p.parseTree->getPositions(positions);
+    if (g.getNumberOfStates() != positions.chars.size() + 1) {
+      std::cout << "testGlushkov: failed, " << g.getNumberOfStates() << " states for " << regexps[i] << std::endl;
+      return;
+    }
+    thompson = lexer::NFA::join(thompson, p.parseTree->getNFA(i+1));
+    glushkov = lexer::NFA::joinInitials(glushkov, g);
+  }
+  for (auto &x : glushkov.getDelta()) {
+    if (x.second.symbols.hasLambda()) {
+      std::cout << "testGlushkov: failed, lambda edge" << std::endl;
+      return;
+    }
+  }
+
+  lexer::DFA dfa = lexer::NFA(glushkov).determinize();
+  lexer::BitParallelNFA glushkovBits(glushkov), thompsonBits(thompson);
+  bool ok = forAllStrings("abcd", 8, [&](const std::string &x) {
+      if (glushkovBits.accept(x) != thompsonBits.accept(x) || dfa.accept(x) != thompsonBits.accept(x)) {
+	std::cout << "testGlushkov: failed on " << x << std::endl;
+	return false;
+      }
+      return true;
+    });
+  if (!ok) {
+    return;
+  }
+  std::cout << "testGlushkov: passed" << std::endl;
+}
+
+void testDerivatives() {
+  std::vector<std::string> regexps = {"a*b", "(a|b)*abb", "a?b+c*", "[^a]c|ab", "((a|b)(a|c))*",
+				      "(a*)*|b?", "(ab|c)+a?", "(a|ab)(c|bcd)", "[ab]*a[ab][ab]"};
+  std::vector<lexer::tkn_rule> rules;
+  lexer::NFA thompson(1, std::unordered_map<lexer::state, lexer::acceptType>(), 0, {});
+  for (size_t i = 0; i < regexps.size(); ++i) {
+    lexer::Parser p(regexps[i], 0, 0);
+    rules.emplace_back("R" + std::to_string(i), p.parseTree);
+    thompson = lexer::NFA::join(thompson, p.parseTree->getNFA(i+1));
+  }
+  lexer::DFA derived = lexer::buildDerivativeDFA(rules);
+  lexer::DFA dfa = thompson.determinize();
+  dfa.minimize();
+  if (!lexer::DFA::equivalent(derived, dfa) || derived.getNumberOfStates() != dfa.getNumberOfStates()) {
+    std::cout << "testDerivatives: failed, " << derived.getNumberOfStates() << " states, not "
+	      << dfa.getNumberOfStates() << std::endl;
+    return;
+  }
+
+  lexer::BitParallelNFA thompsonBits(thompson);
+  bool ok = forAllStrings("abcd", 7, [&](const std::string &x) {
+      if (derived.accept(x) != thompsonBits.accept(x)) {
+	std::cout << "testDerivatives: failed on " << x << std::endl;
+	return false;
+      }
+      return true;
+    });
+  if (!ok) {
+    return;
+  }
+
+  // Without the last rule some strings are accepted with other types.
+  rules.pop_back();
+  if (lexer::DFA::equivalent(lexer::buildDerivativeDFA(rules), dfa)) {
+    std::cout << "testDerivatives: failed, equivalent without a rule" << std::endl;
+    return;
+  }
+  std::cout << "testDerivatives: passed" << std::endl;
+}
+
+void testSimplify() {
+  std::vector<std::string> regexps = {"a|b|c", "(a*)*", "((a?)+)?", "ab|ac|a", "abc|abd|b",
+				      "(a|b)c|(a|b)d", "[^a]|b|[^c]", "(ab|ab)*c", "a(b|c)|a[bc]d?"};
+  lexer::Simplifier simplifier;
+  std::vector<std::shared_ptr<lexer::RegularExpression> > simplified;
+  for (size_t i = 0; i < regexps.size(); ++i) {
+    lexer::Parser p(regexps[i], 0, 0);
+    simplified.push_back(simplifier.simplify(p.parseTree));
+    lexer::NFA before = p.parseTree->getNFA(1);
+    lexer::NFA after = simplified.back()->getNFA(1);
+    if (after.getNumberOfStates() > before.getNumberOfStates()) {
+      std::cout << "testSimplify: failed, " << regexps[i] << " grew" << std::endl;
+      return;
+    }
+    lexer::BitParallelNFA beforeBits(before), afterBits(after);
+    bool ok = forAllStrings("abcd", 5, [&](const std::string &x) {
+	if (beforeBits.accept(x) != afterBits.accept(x)) {
+	  std::cout << "testSimplify: failed on " << regexps[i] << " and " << x << std::endl;
+	  return false;
+	}
+	return true;
+      });
+    if (!ok) {
+      return;
+    }
+  }
+
+  // a|b|c is one character set, and equal expressions are one node.
+  lexer::Parser p("[a-c]", 0, 0);
+  if (!std::dynamic_pointer_cast<lexer::RegExpChars>(simplified[0]) ||
+      simplifier.simplify(p.parseTree) != simplified[0] ||
+      simplified[1] != simplifier.simplify(lexer::Parser("a*", 0, 0).parseTree)) {
+    std::cout << "testSimplify: failed, not shared" << std::endl;
+    return;
+  }
+  std::cout << "testSimplify: passed" << std::endl;
+}
+
 int main() {
 
   testAcceptSingle();
@@ -115,4 +337,16 @@ int main() {
 
   testDeterminize2();
 
+  testNegatedSet();
+
+  testLambdaClosures();
+
+  testBitParallel();
+
+  testGlushkov();
+
+  testDerivatives();
+
+  testSimplify();
+
 }
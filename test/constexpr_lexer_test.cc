@@ -0,0 +1,91 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../src/constexpr_lexer.hh"
+#include "../src/matcher.hh"
+
+using namespace lexer;
+
+constexpr char small_rules[] =
+  "LITERAL := [_a-zA-Z][_a-zA-Z0-9]*\n"
+  "NUMBER := 0|[1-9][0-9]*\n"
+  "IF := if\n"
+  "ELSE := else\n"
+  "WHILE := while\n"
+  "_COMMENT := (//|#)[^\\n]*\n"
+  "_WHITESPACE := [\\t ]+\n"
+  "_NEWLINE := ([\\n]+)|(([\\r][\\n])+)\n";
+
+constexpr ct::static_lexer<> small_lang(small_rules);
+
+// The token of each call in turn, compared at compile time.
+constexpr bool expectTokens(const char *input, std::string_view names, std::string_view texts) {
+  auto t = small_lang.tokenize(input);
+  for (;;) {
+    ct::Token tkn = t.getNextToken();
+    std::string_view name = small_lang.getName(tkn.tkn);
+    std::string_view text(tkn.start, tkn.curr - tkn.start);
+    size_t nameEnd = names.find(' ');
+    size_t textEnd = texts.find(' ');
+    if (names.substr(0, nameEnd) != name || texts.substr(0, textEnd) != text) return false;
+    if (nameEnd == std::string_view::npos) return true;
+    names.remove_prefix(nameEnd + 1);
+    texts.remove_prefix(textEnd + 1);
+  }
+}
+
+static_assert(small_lang.getType("IF") == 2, "rule types are rule indices");
+static_assert(expectTokens("if x12 else 42 while # comment\nfoo 007 @@ bar",
+			   "IF LITERAL ELSE NUMBER WHILE LITERAL NUMBER NUMBER NUMBER INVALID INVALID LITERAL END_OF_FILE",
+			   "if x12 else 42 while foo 0 0 7 @ @ bar "),
+	      "tokens of small_lang");
+
+// The scan stops in a non-accepting state without backing up.
+constexpr ct::static_lexer<2, 16, 8> prefix_lang("A := ab\nB := abcd\n");
+constexpr bool testPrefixInvalid() {
+  const char *s = "ababcabcd";
+  ct::Token a = prefix_lang.getNextToken(s);
+  ct::Token b = prefix_lang.getNextToken(s);
+  ct::Token c = prefix_lang.getNextToken(s);
+  return a.tkn == 0 && b.tkn == prefix_lang.getInvalidType() && b.curr - b.start == 3 &&
+    c.tkn == 1 && prefix_lang.getNextToken(s).tkn == prefix_lang.getEndOfFileType();
+}
+static_assert(testPrefixInvalid(), "prefix of a token is invalid");
+
+// Random inputs give the same tokens as a Matcher built from the same rules.
+void testSameAsMatcher() {
+  std::stringstream rules(small_rules);
+  Matcher m = Matcher::fromStream(rules);
+  const char alphabet[] = "ifelsewhx_09 \t\r\n#/@";
+  srand(42);
+  bool ok = true;
+  for (int round = 0; round < 1000 && ok; ++round) {
+    std::string input;
+    for (int i = rand() % 64; i > 0; --i) {
+      input += alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    Matcher::Tokenizer mt = m.tokenize(input.c_str());
+    auto ct = small_lang.tokenize(input.c_str());
+    for (;;) {
+      Matcher::Token a = mt.getNextToken();
+      ct::Token b = ct.getNextToken();
+      if (a.start != b.start || a.curr != b.curr || a.tkn != b.tkn) {
+	std::cout << "Differs on '" << input << "' at " << a.start - input.c_str() << std::endl;
+	ok = false;
+	break;
+      }
+      if (a.tkn == m.getEndOfFileType()) break;
+    }
+  }
+  std::cout << "testSameAsMatcher: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+int main() {
+
+  std::cout << "Compiled " << small_lang.getNumberOfStates() << " states" << std::endl;
+
+  testSameAsMatcher();
+
+}
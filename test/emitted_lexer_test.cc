@@ -0,0 +1,1211 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/constexpr_lexer.hh"
+#include "../src/emit_c++.hh"
+#include "../src/emit_driver.hh"
+#include "../src/emit_lockstep.hh"
+#include "../src/emit_search.hh"
+#include "../src/jit.hh"
+#include "../src/matcher.hh"
+#include "../src/partition.hh"
+#include "../src/profile.hh"
+
+using namespace lexer;
+
+// The emitted lexers are compiled with the compiler of this build into
+// a directory per test under the build directory, and run there.
+
+std::string outputDirectory(const std::string &name) {
+  std::string dir = std::string(CMAKE_CURRENT_BINARY_DIR) + "/emitted/" + name + "/";
+  if (std::system(("mkdir -p " + dir).c_str()) != 0) {
+    std::cout << "Cannot create " << dir << std::endl;
+  }
+  return dir;
+}
+
+std::vector<tkn_rule> parseRules(const std::string &rules) {
+  std::stringstream rs(rules);
+  return parseFile(rs);
+}
+
+DFA ruleDFA(const std::vector<tkn_rule> &tkn_rules) {
+  std::vector<size_t> all;
+  for (size_t i = 0; i < tkn_rules.size(); ++i) {
+    all.push_back(i);
+  }
+  return buildRuleDFA(tkn_rules, all);
+}
+
+// Compiles the given sources of dir with the compiler flags into the
+// program in dir.
+bool build(const std::string &dir, const std::string &sources, const std::string &flags,
+	   const std::string &program) {
+  std::string compile = std::string(CMAKE_CXX_COMPILER) + " -std=c++17 -O1 -pthread " + flags + " -I" + dir +
+    " -o " + dir + program;
+  std::stringstream files(sources);
+  for (std::string f; files >> f; ) {
+    compile += " " + dir + f;
+  }
+  if (std::system(compile.c_str()) != 0) {
+    std::cout << "Cannot compile the lexer in " << dir << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Writes driver.cc and input into dir, compiles the driver with the
+// given sources of dir and compiler flags and returns what it prints when
+// run on the input file, or "" if it does not build.
+std::string run(const std::string &dir, const std::string &driver, const std::string &input,
+		const std::string &sources = "tokenizer.cc", const std::string &flags = "") {
+  std::ofstream(dir + "driver.cc") << driver;
+  std::ofstream(dir + "input", std::ios::binary) << input;
+  if (!build(dir, "driver.cc " + sources, flags, "driver")) {
+    return "";
+  }
+  if (std::system((dir + "driver " + dir + "input > " + dir + "output").c_str()) != 0) {
+    std::cout << "The driver in " << dir << " failed" << std::endl;
+    return "";
+  }
+  std::stringstream output;
+  output << std::ifstream(dir + "output").rdbuf();
+  return output.str();
+}
+
+// Runs generate_lexer in dir with the given arguments and returns what it
+// prints, or "" if it fails.
+std::string generate(const std::string &dir, const std::string &args) {
+  std::string command = "cd " + dir + " && " + CMAKE_BINARY_DIR + "/generate_lexer " + args + " > generated 2>&1";
+  if (std::system(command.c_str()) != 0) {
+    std::cout << "generate_lexer " << args << " failed in " << dir << std::endl;
+    return "";
+  }
+  std::stringstream output;
+  output << std::ifstream(dir + "generated").rdbuf();
+  return output.str();
+}
+
+// The drivers handle each line of the input file on its own.
+const char *readLinesSource =
+  "#include <fstream>\n"
+  "#include <iostream>\n"
+  "#include <sstream>\n"
+  "#include <string>\n"
+  "#include <vector>\n"
+  "std::vector<std::string> readLines(const char *filename) {\n"
+  "  std::ifstream fs(filename, std::ios::binary);\n"
+  "  std::vector<std::string> lines;\n"
+  "  for (std::string line; std::getline(fs, line); ) lines.push_back(line);\n"
+  "  return lines;\n"
+  "}\n";
+
+// Prints one line per token: name, then start and end offsets.
+const char *printTokenSource =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "void print(const std::string &line, const Token &t) {\n"
+  "  std::cout << t.tkn << ' ' << t.start - line.c_str() << ' ' << t.curr - line.c_str() << '\\n';\n"
+  "}\n";
+
+const char *tokensDriver =
+  "int main(int argc, char **argv) {\n"
+  "  for (auto &line : readLines(argv[1])) {\n"
+  "    Tokenizer t(line.c_str());\n"
+  "    for (;;) {\n"
+  "      Token tkn = t.getNextToken();\n"
+  "      print(line, tkn);\n"
+  "      if (tkn.tkn == TokenType::END_OF_FILE) break;\n"
+  "    }\n"
+  "  }\n"
+  "}\n";
+
+// What tokensDriver prints, from a runtime lexer with getNextToken(str),
+// getName(type) and getEndOfFileType().
+template<typename L>
+std::string expectedTokens(const L &l, const std::vector<std::string> &lines) {
+  std::stringstream res;
+  for (auto &line : lines) {
+    const char *str = line.c_str();
+    for (;;) {
+      auto tkn = l.getNextToken(str);
+      res << l.getName(tkn.tkn) << ' ' << tkn.start - line.c_str() << ' ' << tkn.curr - line.c_str() << '\n';
+      if (tkn.tkn == l.getEndOfFileType()) break;
+    }
+  }
+  return res.str();
+}
+
+std::vector<std::string> randomLines(const std::string &alphabet, size_t count, size_t maxLength) {
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < count; ++i) {
+    std::string line;
+    for (size_t n = rand() % (maxLength + 1); n > 0; --n) {
+      line += alphabet[rand() % alphabet.size()];
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+std::string joinLines(const std::vector<std::string> &lines) {
+  std::string res;
+  for (auto &l : lines) {
+    res += l + "\n";
+  }
+  return res;
+}
+
+// The scan of both rules enters the initial state again after "ab", and
+// stops there on x or at the end of the input. Matcher, JitMatcher and
+// the constexpr lexer return the tokens of the emitted Tokenizer.
+constexpr char reentry_rules[] = "A := (ab)*c\nB := (ab)*d\n";
+constexpr ct::static_lexer<2, 32, 16> reentry_lang(reentry_rules);
+
+void testInitialStateEnteredAgain() {
+  std::vector<tkn_rule> tkn_rules = parseRules(reentry_rules);
+  DFA d = ruleDFA(tkn_rules);
+  std::string dir = outputDirectory("reentry");
+  cpp_emitter::emit_dfa(d, tkn_rules, dir);
+
+  srand(42);
+  std::vector<std::string> lines = {"abx", "ab", "abab", "ababc", "xab", "", "abdabx"};
+  std::vector<std::string> random = randomLines("abcdx", 500, 12);
+  lines.insert(std::end(lines), std::begin(random), std::end(random));
+  std::string emitted = run(dir, std::string(readLinesSource) + printTokenSource + tokensDriver, joinLines(lines));
+
+  std::vector<std::string> names = {"A", "B"};
+  Matcher m(d, names);
+  JitMatcher j(d, names);
+  bool ok = !emitted.empty() &&
+    expectedTokens(m, lines) == emitted &&
+    expectedTokens(j, lines) == emitted &&
+    expectedTokens(reentry_lang, lines) == emitted;
+  std::cout << "testInitialStateEnteredAgain: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// Length of the longest prefix of s[p..] that d accepts, 0 if none, and
+// the type it is accepted with.
+size_t longestMatch(const DFA &d, const std::string &s, size_t p, acceptType &type) {
+  size_t length = 0;
+  type = REJECT;
+  state q = d.getInitialState();
+  for (size_t i = p; i < s.size(); ++i) {
+    auto x = d.getDelta().find({q, symbol(s[i])});
+    if (x == std::end(d.getDelta())) break;
+    q = x->second;
+    acceptType a = d.getAcceptTypeForState(q, REJECT);
+    if (a != REJECT) {
+      length = i + 1 - p;
+      type = a;
+    }
+  }
+  return length;
+}
+
+const char *searchDriver =
+  "#include \"searcher.hh\"\n"
+  "int main(int argc, char **argv) {\n"
+  "  for (auto &line : readLines(argv[1])) {\n"
+  "    lexer::Searcher s(line.data(), line.data() + line.size());\n"
+  "    lexer::Match m;\n"
+  "    while (s.next(m)) {\n"
+  "      std::cout << int(m.rule) << ' ' << m.start - line.data() << ' ' << m.end - line.data() << '\\n';\n"
+  "    }\n"
+  "    std::cout << \"--\\n\";\n"
+  "  }\n"
+  "}\n";
+
+// The matches of the emitted Searcher are the longest match at the first
+// offset with one, then the same again behind it.
+void testSearch(const std::string &rules, const std::string &alphabet, const std::string &label) {
+  std::vector<tkn_rule> tkn_rules = parseRules(rules);
+  DFA d = ruleDFA(tkn_rules);
+  NFA f(1, std::unordered_map<state, acceptType>(), 0, {});
+  for (size_t i = 0; i < tkn_rules.size(); ++i) {
+    f = NFA::join(f, tkn_rules[i].regexp->getNFA(i+1));
+  }
+  DFA u = NFA::unanchored(f).determinize();
+  u.minimize();
+  std::string dir = outputDirectory(label);
+  search_emitter::emit_dfa(d, u, tkn_rules, dir);
+
+  srand(42);
+  std::vector<std::string> lines = randomLines(alphabet, 500, 40);
+  std::stringstream expected;
+  for (auto &line : lines) {
+    for (size_t p = 0; p < line.size(); ) {
+      acceptType type;
+      size_t length = longestMatch(d, line, p, type);
+      if (length == 0) {
+	++p;
+	continue;
+      }
+      expected << type - 1 << ' ' << p << ' ' << p + length << '\n';
+      p += length;
+    }
+    expected << "--\n";
+  }
+  std::string emitted = run(dir, std::string(readLinesSource) + searchDriver, joinLines(lines), "searcher.cc");
+  std::cout << label << ": " << (!emitted.empty() && emitted == expected.str() ? "passed" : "failed") << std::endl;
+}
+
+// What tokensDriver prints for a lexer with --bulk-invalid: the tokens of
+// the Matcher, where an INVALID token that stopped in the initial state
+// also takes the bytes behind it that cannot start a token.
+std::string expectedBulkTokens(const DFA &d, const std::vector<std::string> &names,
+			       const std::vector<std::string> &lines) {
+  Matcher m(d, names);
+  std::vector<bool> live = d.getLiveStates();
+  bool stops[256] = { true };
+  for (int c = 1; c < 256; ++c) {
+    auto x = d.getDelta().find({d.getInitialState(), symbol(c)});
+    stops[c] = x != std::end(d.getDelta()) && live[x->second];
+  }
+  std::stringstream res;
+  for (auto &line : lines) {
+    const char *str = line.c_str();
+    for (;;) {
+      auto tkn = m.getNextToken(str);
+      if (tkn.tkn == m.getInvalidType() && !stops[static_cast<uint8_t>(tkn.curr[-1])]) {
+	state q = d.getInitialState();
+	for (const char *p = tkn.start; p + 1 < tkn.curr; ++p) {
+	  q = d.getDelta().find({q, symbol(*p)})->second;
+	}
+	if (q == d.getInitialState()) {
+	  while (!stops[static_cast<uint8_t>(*str)]) ++str;
+	  tkn.curr = str;
+	}
+      }
+      res << m.getName(tkn.tkn) << ' ' << tkn.start - line.c_str() << ' ' << tkn.curr - line.c_str() << '\n';
+      if (tkn.tkn == m.getEndOfFileType()) break;
+    }
+  }
+  return res.str();
+}
+
+// With --bulk-invalid a run of bytes that cannot start a token is one
+// INVALID token, with the SSSE3 skipInvalidRun and without it. The runs
+// are long enough to cross 16 byte blocks, and some end at the
+// terminating 0.
+void testBulkInvalid() {
+  std::vector<tkn_rule> tkn_rules = parseRules("LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\n"
+					       "IF := if\nARROW := ->\n_WHITESPACE := [ ]+\n");
+  DFA d = ruleDFA(tkn_rules);
+  std::string dir = outputDirectory("bulkInvalid");
+  emit_options options;
+  options.bulkInvalid = true;
+  cpp_emitter::emit_dfa(d, tkn_rules, dir, options);
+
+  srand(42);
+  std::vector<std::string> lines = randomLines("@#$%>\x80\xff\x0f@#$%>\x80\xff\x0f@#$%>\x80\xff\x0f ifx0-", 500, 80);
+  std::vector<std::string> names;
+  for (auto &r : tkn_rules) {
+    names.push_back(r.name);
+  }
+  std::string expected = expectedBulkTokens(d, names, lines);
+  std::string driver = std::string(readLinesSource) + printTokenSource + tokensDriver;
+#if defined(__x86_64__) || defined(__i386__)
+  bool ok = run(dir, driver, joinLines(lines), "tokenizer.cc", "-mno-ssse3") == expected &&
+    run(dir, driver, joinLines(lines), "tokenizer.cc", "-mssse3") == expected;
+#else
+  bool ok = run(dir, driver, joinLines(lines)) == expected;
+#endif
+  std::cout << "testBulkInvalid: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// Prints the tokens like tokensDriver, then writes the profile into the
+// file profile beside the input.
+const char *profileDriver =
+  "int main(int argc, char **argv) {\n"
+  "  for (auto &line : readLines(argv[1])) {\n"
+  "    Tokenizer t(line.c_str());\n"
+  "    for (;;) {\n"
+  "      Token tkn = t.getNextToken();\n"
+  "      print(line, tkn);\n"
+  "      if (tkn.tkn == TokenType::END_OF_FILE) break;\n"
+  "    }\n"
+  "  }\n"
+  "  std::ofstream profile(std::string(argv[1]).replace(std::string(argv[1]).rfind('/') + 1, std::string::npos, \"profile\"));\n"
+  "  writeProfile(profile);\n"
+  "}\n";
+
+// The message readProfile throws for the profile, or "" if it is taken.
+std::string profileError(const std::string &profile, const DFA &d) {
+  std::stringstream ps(profile);
+  try {
+    readProfile(ps, d);
+  } catch (std::runtime_error &e) {
+    return e.what();
+  }
+  return "";
+}
+
+// A lexer laid out by a profile recorded on the instrumented lexer gives
+// the same tokens, and has fast paths for dominant edges. The profile is refused for a DFA with the same number
+// of states from other rules, and with another version or fingerprint.
+void testProfile() {
+  std::string rules = "LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n_WHITESPACE := [ ]+\n";
+  std::vector<tkn_rule> tkn_rules = parseRules(rules);
+  DFA d = ruleDFA(tkn_rules);
+  std::string generateDir = outputDirectory("profileGenerate");
+  std::string useDir = outputDirectory("profileUse");
+  emit_options options;
+  options.instrument = true;
+  cpp_emitter::emit_dfa(d, tkn_rules, generateDir, options);
+
+  srand(42);
+  std::vector<std::string> lines = randomLines("ifx_019 @", 500, 30);
+  std::string driver = std::string(readLinesSource) + printTokenSource;
+  std::string recorded = run(generateDir, driver + profileDriver, joinLines(lines));
+  std::stringstream profile;
+  profile << std::ifstream(generateDir + "profile").rdbuf();
+
+  std::vector<std::string> names;
+  for (auto &r : tkn_rules) {
+    names.push_back(r.name);
+  }
+  std::string expected = expectedTokens(Matcher(d, names), lines);
+  std::stringstream ps(profile.str());
+  emit_options use;
+  use.profile = readProfile(ps, d);
+  cpp_emitter::emit_dfa(d, tkn_rules, useDir, use);
+  std::string laidOut = run(useDir, driver + tokensDriver, joinLines(lines));
+  std::stringstream source;
+  source << std::ifstream(useDir + "tokenizer.cc").rdbuf();
+  bool ok = recorded == expected && laidOut == expected && use.profile.getStateVisits(d.getInitialState()) > 0 &&
+    source.str().find("LEXER_LIKELY(") != std::string::npos;
+
+  // IF := fi has as many states, but other edges.
+  DFA other = ruleDFA(parseRules("LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := fi\n_WHITESPACE := [ ]+\n"));
+  std::string header = profile.str().substr(0, profile.str().find('\n'));
+  std::string otherVersion = "lexer-profile 1" + profile.str().substr(std::string("lexer-profile 2").size());
+  std::string otherFingerprint = header.substr(0, header.rfind(' ')) + " 12345" + profile.str().substr(header.size());
+  ok = ok && other.getNumberOfStates() == d.getNumberOfStates() &&
+    profileError(profile.str(), other).find("another DFA") != std::string::npos &&
+    profileError(otherVersion, d).find("unsupported version") != std::string::npos &&
+    profileError(otherFingerprint, d).find("another DFA") != std::string::npos;
+  std::cout << "testProfile: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// Prints the counters of a Tokenizer on the whole input, and then of two
+// merged.
+const char *statsDriver =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "void print(const TokenizerStats &s) {\n"
+  "  for (auto x : s.tokens) std::cout << x << ' ';\n"
+  "  std::cout << \"| \" << s.bytesConsumed << ' ' << s.bytesSkipped << ' ' << s.invalidTokens << ' ' << s.invalidBytes << \" |\";\n"
+  "  for (auto x : s.lengthHistogram) std::cout << ' ' << x;\n"
+  "  std::cout << '\\n';\n"
+  "}\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string buffer = ss.str();\n"
+  "  Tokenizer a(buffer.c_str()), b(buffer.c_str());\n"
+  "  while (a.getNextToken().tkn != TokenType::END_OF_FILE);\n"
+  "  while (b.getNextToken().tkn != TokenType::END_OF_FILE);\n"
+  "  print(a.stats);\n"
+  "  a.stats.merge(b.stats);\n"
+  "  print(a.stats);\n"
+  "}\n";
+
+// The counters of a lexer built with -DLEXER_ENABLE_STATS on a known
+// input, for one DFA and in lockstep. The tokens are abc, 12, @, @, x
+// and 7, with 5 bytes of whitespace between them. END_OF_FILE is not
+// counted.
+void testStats() {
+  std::string rules = "LITERAL := [a-z]+\nNUMBER := [0-9]+\n_WHITESPACE := [ \\n]+\n";
+  std::vector<tkn_rule> tkn_rules = parseRules(rules);
+  std::string single = outputDirectory("stats");
+  std::string lockstep = outputDirectory("statsLockstep");
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, single);
+  std::vector<rule_group> groups = partitionRules(tkn_rules, 3);
+  lockstep_emitter::emit_dfas(groups, tkn_rules, lockstep);
+
+  std::string input = "abc 12 @@ x 7\n";
+  std::string expected =
+    "2 2 0 0 2 | 14 5 2 2 | 0 4 2 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+    "4 4 0 0 4 | 28 10 4 4 | 0 8 4 0 0 0 0 0 0 0 0 0 0 0 0 0\n";
+  bool ok = groups.size() > 1 &&
+    run(single, std::string(readLinesSource) + statsDriver, input, "tokenizer.cc", "-DLEXER_ENABLE_STATS") == expected &&
+    run(lockstep, std::string(readLinesSource) + statsDriver, input, "tokenizer.cc", "-DLEXER_ENABLE_STATS") == expected;
+  std::cout << "testStats: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// Prints type, start and end offsets and value of every token of the
+// whole input.
+const char *valuesDriver =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string buffer = ss.str();\n"
+  "  Tokenizer t(buffer.c_str());\n"
+  "  for (Token tkn = t.getNextToken(); tkn.tkn != TokenType::END_OF_FILE; tkn = t.getNextToken()) {\n"
+  "    std::cout << tkn.tkn << ' ' << tkn.start - buffer.c_str() << ' ' << tkn.curr - buffer.c_str() << ' ' << tkn.value << '\\n';\n"
+  "  }\n"
+  "}\n";
+
+// The value of a token by the action of its rule, from its text.
+uint64_t actionValue(token_action action, const std::string &text) {
+  uint64_t value = 0;
+  switch (action) {
+  case token_action::DECIMAL:
+    for (auto c : text) {
+      if (c >= '0' && c <= '9') value = value * 10 + (c - '0');
+    }
+    return value;
+  case token_action::HASH:
+  case token_action::INTERN:
+    value = 0xcbf29ce484222325ull;
+    for (auto c : text) {
+      value = (value ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    }
+    return value;
+  case token_action::NEWLINES:
+    for (auto c : text) {
+      value += c == '\n';
+    }
+    return value;
+  case token_action::NONE:
+  default:
+    return 0;
+  }
+}
+
+// Token::value of the emitted lexer is the value of the action of the
+// rule computed from the token text. Decimals longer than 19 digits wrap
+// around like uint64_t arithmetic.
+void testActions() {
+  std::vector<tkn_rule> tkn_rules = parseRules(
+      "NUMBER {decimal} := [0-9]+\nFLOAT {decimal} := [0-9]+[.][0-9]*\nIDENT {hash} := [_a-z][_a-z0-9]*\n"
+      "STR {newlines} := [\"][^\"]*[\"]\nOP := [+=]\n_WHITESPACE := [ \\n]+\n");
+  DFA d = ruleDFA(tkn_rules);
+  std::string dir = outputDirectory("actions");
+  cpp_emitter::emit_dfa(d, tkn_rules, dir);
+
+  srand(42);
+  std::string input = "18446744073709551615 18446744073709551616 99999999999999999999999.5 0 \"\n\n\" ";
+  input += joinLines(randomLines("012345678901234567890123456789.ab_\"+- \n", 300, 40));
+
+  std::vector<std::string> names;
+  for (auto &r : tkn_rules) {
+    names.push_back(r.name);
+  }
+  Matcher m(d, names);
+  std::stringstream expected;
+  const char *str = input.c_str();
+  for (auto tkn = m.getNextToken(str); tkn.tkn != m.getEndOfFileType(); tkn = m.getNextToken(str)) {
+    token_action action = tkn.tkn < tkn_rules.size() ? tkn_rules[tkn.tkn].action : token_action::NONE;
+    expected << m.getName(tkn.tkn) << ' ' << tkn.start - input.c_str() << ' ' << tkn.curr - input.c_str() << ' '
+	     << actionValue(action, std::string(tkn.start, tkn.curr)) << '\n';
+  }
+  std::string emitted = run(dir, std::string(readLinesSource) + valuesDriver, input);
+  bool ok = emitted == expected.str() &&
+    emitted.find("NUMBER 0 20 18446744073709551615\n") == 0 &&
+    emitted.find("NUMBER 21 41 0\n") != std::string::npos;
+  std::cout << "testActions: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// Prints the id of every IDENT token and whether the table gives back its
+// text, then the size of the table. Then interns two texts with the same
+// hash, for which the lookup has to compare the bytes.
+const char *internDriver =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string buffer = ss.str();\n"
+  "  Tokenizer t(buffer.c_str());\n"
+  "  InternTable table;\n"
+  "  for (Token tkn = t.getNextToken(); tkn.tkn != TokenType::END_OF_FILE; tkn = t.getNextToken()) {\n"
+  "    if (tkn.tkn != TokenType::IDENT) continue;\n"
+  "    uint32_t id = table.intern(tkn);\n"
+  "    std::cout << id << ' ' << (table.lexeme(id) == std::string(tkn.start, tkn.curr)) << '\\n';\n"
+  "  }\n"
+  "  std::cout << table.size() << '\\n';\n"
+  "  const char *a = \"collide1\", *b = \"collide2\";\n"
+  "  uint32_t x = table.intern(Token{a, a + 8, TokenType::IDENT, 42});\n"
+  "  uint32_t y = table.intern(Token{b, b + 8, TokenType::IDENT, 42});\n"
+  "  std::cout << (x != y) << (table.intern(Token{a, a + 8, TokenType::IDENT, 42}) == x) << (table.lexeme(y) == b) << '\\n';\n"
+  "}\n";
+
+// InternTable gives equal texts equal ids and different texts different
+// ids, counting from 0 in order of first appearance, and gives back the
+// text of an id. There are enough distinct texts to grow the table.
+void testIntern() {
+  std::vector<tkn_rule> tkn_rules = parseRules("IDENT {intern} := [a-d]+\nNUMBER := [0-9]+\n_WHITESPACE := [ \\n]+\n");
+  std::string dir = outputDirectory("intern");
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, dir);
+
+  srand(42);
+  std::vector<std::string> words = randomLines("abcd", 3000, 6);
+  std::string input;
+  std::map<std::string, size_t> ids;
+  std::stringstream expected;
+  for (auto &w : words) {
+    input += w + (rand() % 3 ? " " : " 12\n");
+    if (w.empty()) continue;
+    auto x = ids.insert({w, ids.size()});
+    expected << x.first->second << " 1\n";
+  }
+  expected << ids.size() << "\n111\n";
+  std::string emitted = run(dir, std::string(readLinesSource) + internDriver, input);
+  bool ok = ids.size() > 1000 && emitted == expected.str();
+  std::cout << "testIntern: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// lex_files writes the tokens of every file in the order of the file
+// list, the same with any number of threads. It fails on the missing file
+// but still writes the others, and an empty file has no tokens. Without
+// an output it counts the same tokens.
+void testLexFiles() {
+  std::vector<tkn_rule> tkn_rules = parseRules("LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\n"
+					       "IF := if\n_WHITESPACE := [ \\n]+\n");
+  DFA d = ruleDFA(tkn_rules);
+  std::string dir = outputDirectory("lexFiles");
+  cpp_emitter::emit_dfa(d, tkn_rules, dir);
+  driver_emitter::emit_driver(dir);
+
+  std::vector<std::string> names;
+  for (auto &r : tkn_rules) {
+    names.push_back(r.name);
+  }
+  Matcher m(d, names);
+  srand(42);
+  std::vector<std::string> files;
+  std::stringstream expected;
+  for (size_t i = 0; i < 12; ++i) {
+    std::string file = dir + "file" + std::to_string(i);
+    std::string content;
+    if (i == 4) {
+      file = dir + "missing";
+      std::remove(file.c_str());
+    } else if (i != 7) {
+      content = joinLines(randomLines("ifx_019 @\n", 1 + rand() % 200, 40));
+      std::ofstream(file, std::ios::binary) << content;
+    } else {
+      std::ofstream(file, std::ios::binary);
+    }
+    files.push_back(file);
+    const char *str = content.c_str();
+    for (auto tkn = m.getNextToken(str); tkn.tkn != m.getEndOfFileType(); tkn = m.getNextToken(str)) {
+      expected << file << ' ' << tkn.start - content.c_str() << ' ' << tkn.curr - tkn.start << ' '
+	       << m.getName(tkn.tkn) << '\n';
+    }
+  }
+
+  bool ok = build(dir, "tokenizer.cc lex_files.cc", "", "lex_files");
+  for (auto threads : {"1", "2", "3", "8"}) {
+    std::string output = dir + "tokens" + threads;
+    std::string command = dir + "lex_files -j " + threads + " -o " + output;
+    for (auto &f : files) {
+      command += " " + f;
+    }
+    // The missing file makes it fail.
+    ok = ok && std::system((command + " 2> " + dir + "errors").c_str()) != 0;
+    std::stringstream written, errors;
+    written << std::ifstream(output).rdbuf();
+    errors << std::ifstream(dir + "errors").rdbuf();
+    ok = ok && written.str() == expected.str() && errors.str().find("Could not read: " + dir + "missing") == 0;
+  }
+
+  // Without -o the tokens are only counted.
+  std::string command = dir + "lex_files -j 3";
+  for (auto &f : files) {
+    command += " " + f;
+  }
+  std::system((command + " 2> " + dir + "errors").c_str());
+  std::stringstream errors;
+  errors << std::ifstream(dir + "errors").rdbuf();
+  size_t tokens = std::count(std::istreambuf_iterator<char>(expected), std::istreambuf_iterator<char>(), '\n');
+  ok = ok && errors.str().find(", " + std::to_string(tokens) + " tokens in") != std::string::npos;
+  std::cout << "testLexFiles: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+const char *tokenStreamDriver =
+  "#include \"token_stream.hh\"\n"
+  "#include <cstddef>\n"
+  "#include <fstream>\n"
+  "#include <iostream>\n"
+  "#include <sstream>\n"
+  "using namespace lexer;\n"
+  "std::vector<StreamToken> readAll(TokenStreamReader &r) {\n"
+  "  std::vector<StreamToken> tokens;\n"
+  "  StreamToken tkn;\n"
+  "  while (r.next(tkn)) tokens.push_back(tkn);\n"
+  "  return tokens;\n"
+  "}\n"
+  "// Whether a is b from token first on, up to n tokens of it.\n"
+  "bool same(const std::vector<StreamToken> &a, const std::vector<StreamToken> &b, size_t first, size_t n) {\n"
+  "  if (a.size() != n || first + n > b.size()) return false;\n"
+  "  for (size_t i = 0; i < n; ++i) {\n"
+  "    const StreamToken &x = a[i], &y = b[first + i];\n"
+  "    if (x.start != y.start || x.length != y.length || x.type != y.type) return false;\n"
+  "  }\n"
+  "  return true;\n"
+  "}\n"
+  "// Prints the tokens and blocks of the stream in argv[1] and the number\n"
+  "// of failed checks of seekBlock and of truncated and corrupt copies.\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string s = ss.str();\n"
+  "  // The reader needs the index 8 byte aligned.\n"
+  "  std::vector<uint64_t> copy(s.size() / 8 + 1), buffer(copy.size());\n"
+  "  std::memcpy(buffer.data(), s.data(), s.size());\n"
+  "  TokenStreamReader r(buffer.data(), s.size());\n"
+  "  std::vector<StreamToken> all = readAll(r);\n"
+  "  std::cout << \"tokens \" << all.size() << \" blocks \" << r.numberOfBlocks() << '\\n';\n"
+  "  // Every block, in any order, continues with the tokens from its first one.\n"
+  "  size_t seek = 0;\n"
+  "  for (size_t b = r.numberOfBlocks(); b-- > 0;) {\n"
+  "    size_t first = 0;\n"
+  "    while (r.blockOf(first) < b) ++first;\n"
+  "    r.seekBlock(b);\n"
+  "    seek += !same(readAll(r), all, first, all.size() - first);\n"
+  "  }\n"
+  "  // Every truncated copy is refused.\n"
+  "  size_t truncated = 0;\n"
+  "  for (size_t size = 0; size < s.size(); ++size) {\n"
+  "    truncated += TokenStreamReader(buffer.data(), size).valid();\n"
+  "  }\n"
+  "  // With less data, even ending within a varint, a prefix of the tokens is read.\n"
+  "  TokenStreamHeader h;\n"
+  "  std::memcpy(&h, s.data(), sizeof(h));\n"
+  "  size_t shortened = 0;\n"
+  "  for (uint64_t size = 0; size < h.dataSize; ++size) {\n"
+  "    copy = buffer;\n"
+  "    std::memcpy(reinterpret_cast<char*>(copy.data()) + offsetof(TokenStreamHeader, dataSize), &size, sizeof(size));\n"
+  "    TokenStreamReader t(copy.data(), s.size());\n"
+  "    std::vector<StreamToken> tokens = readAll(t);\n"
+  "    shortened += !t.valid() || tokens.size() == all.size() || !same(tokens, all, 0, tokens.size());\n"
+  "  }\n"
+  "  // A wrong magic, version or index offset, if there is an index, is\n"
+  "  // refused, and an index entry behind the data ends the stream.\n"
+  "  size_t corrupt = 0;\n"
+  "  size_t fields[] = {offsetof(TokenStreamHeader, magic), offsetof(TokenStreamHeader, version),\n"
+  "                     offsetof(TokenStreamHeader, indexOffset)};\n"
+  "  for (size_t field : fields) {\n"
+  "    if (field == fields[2] && !h.blockSize) break;\n"
+  "    copy = buffer;\n"
+  "    reinterpret_cast<char*>(copy.data())[field] ^= 1;\n"
+  "    corrupt += TokenStreamReader(copy.data(), s.size()).valid();\n"
+  "  }\n"
+  "  // The second offset would wrap around to the header.\n"
+  "  uint64_t behind[] = {h.dataSize + 1, uint64_t(0) - sizeof(uint64_t)};\n"
+  "  for (size_t i = 0; i < 2 && r.numberOfBlocks(); ++i) {\n"
+  "    copy = buffer;\n"
+  "    std::memcpy(reinterpret_cast<char*>(copy.data()) + h.indexOffset, &behind[i], sizeof(behind[i]));\n"
+  "    TokenStreamReader t(copy.data(), s.size());\n"
+  "    t.seekBlock(0);\n"
+  "    corrupt += !readAll(t).empty();\n"
+  "  }\n"
+  "  std::cout << \"seek \" << seek << \" truncated \" << truncated << \" shortened \" << shortened\n"
+  "            << \" corrupt \" << corrupt << '\\n';\n"
+  "}\n";
+
+// tokenize writes the tokens of the Tokenizer as a token stream, with and
+// without a block index, and tokenize -d prints them back. TokenStreamReader
+// continues at any block and refuses or stops early in damaged streams.
+void testTokenStream() {
+  std::vector<tkn_rule> tkn_rules = parseRules("LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\n"
+					       "IF := if\n_WHITESPACE := [ \\n]+\n");
+  DFA d = ruleDFA(tkn_rules);
+  std::string dir = outputDirectory("tokenStream");
+  cpp_emitter::emit_dfa(d, tkn_rules, dir);
+  driver_emitter::emit_token_stream(dir);
+
+  std::vector<std::string> names;
+  for (auto &r : tkn_rules) {
+    names.push_back(r.name);
+  }
+  Matcher m(d, names);
+  srand(42);
+  std::string input = joinLines(randomLines("ifx_019 @\n", 2000, 40));
+  std::ofstream(dir + "input", std::ios::binary) << input;
+  std::stringstream expected;
+  size_t tokens = 0;
+  const char *str = input.c_str();
+  for (auto tkn = m.getNextToken(str); tkn.tkn != m.getEndOfFileType(); tkn = m.getNextToken(str)) {
+    expected << tkn.start - input.c_str() << ' ' << tkn.curr - tkn.start << ' ' << m.getName(tkn.tkn) << '\n';
+    ++tokens;
+  }
+
+  std::ofstream(dir + "check.cc") << tokenStreamDriver;
+  bool ok = build(dir, "tokenizer.cc tokenize.cc", "", "tokenize") && build(dir, "check.cc", "", "check");
+  for (std::string blockSize : {"0", "1", "7", "64"}) {
+    std::string stream = dir + "stream" + blockSize;
+    ok = ok && std::system((dir + "tokenize -b " + blockSize + " " + dir + "input " + stream).c_str()) == 0 &&
+      std::system((dir + "tokenize -d " + stream + " > " + dir + "dumped").c_str()) == 0;
+    std::stringstream dumped, checked;
+    dumped << std::ifstream(dir + "dumped").rdbuf();
+    ok = ok && dumped.str() == expected.str() && std::system((dir + "check " + stream + " > " + dir + "checked").c_str()) == 0;
+    checked << std::ifstream(dir + "checked").rdbuf();
+    size_t blocks = blockSize == "0" ? 0 : (tokens + std::stoul(blockSize) - 1) / std::stoul(blockSize);
+    ok = ok && checked.str() == "tokens " + std::to_string(tokens) + " blocks " + std::to_string(blocks) +
+      "\nseek 0 truncated 0 shortened 0 corrupt 0\n";
+  }
+  // tokenize -d refuses a truncated stream.
+  std::stringstream ss;
+  ss << std::ifstream(dir + "stream7", std::ios::binary).rdbuf();
+  std::ofstream(dir + "truncated", std::ios::binary) << ss.str().substr(0, ss.str().size() - 1);
+  ok = ok && std::system((dir + "tokenize -d " + dir + "truncated > /dev/null 2>&1").c_str()) != 0;
+  std::cout << "testTokenStream: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+const char *tableDriver =
+  "#include \"table.hh\"\n"
+  "#include <fstream>\n"
+  "#include <string>\n"
+  "// Prints where the table stops on every line, the terminating 0\n"
+  "// included, and the token type it stops with.\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::ifstream in(argv[1], std::ios::binary);\n"
+  "  const int invalid = static_cast<int>(lexer::TableTokenType::INVALID);\n"
+  "  for (std::string line; std::getline(in, line); ) {\n"
+  "    int s = lexer::initialState;\n"
+  "    size_t i = 0;\n"
+  "    while (s < invalid) {\n"
+  "      s = lexer::table[s][static_cast<uint8_t>(line.c_str()[i++])];\n"
+  "    }\n"
+  "    std::cout << i << ' ' << s << '\\n';\n"
+  "  }\n"
+  "}\n";
+
+// The table of --table-blob, assembled from table.S and table.bin, looks
+// up the same as table.cc, which still declares a mutable table.
+void testTableBlob() {
+  std::string rules = "LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n"
+    "FLOAT := [0-9]+\\.[0-9]+\n_WHITESPACE := [ ]+\n";
+  std::string plain = outputDirectory("table");
+  std::string blob = outputDirectory("tableBlob");
+  std::ofstream(plain + "rules") << rules;
+  std::ofstream(blob + "rules") << rules;
+  bool ok = !generate(plain, "--emit-table rules ./").empty() &&
+    !generate(blob, "--emit-table --table-blob rules ./").empty();
+  std::stringstream plainHeader, blobHeader;
+  plainHeader << std::ifstream(plain + "table.hh").rdbuf();
+  blobHeader << std::ifstream(blob + "table.hh").rdbuf();
+  ok = ok && plainHeader.str().find("extern int table[][256];") != std::string::npos &&
+    blobHeader.str().find("extern const int table[][256];") != std::string::npos &&
+    !std::ifstream(blob + "table.cc");
+
+  srand(42);
+  std::string input = joinLines(randomLines("if_x019. @", 500, 20));
+  std::string expected = run(plain, tableDriver, input, "table.cc");
+  std::string emitted = run(blob, tableDriver, input, "table.S", "-Wa,-I" + blob);
+  ok = ok && !expected.empty() && emitted == expected;
+  std::cout << "testTableBlob: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// A match starts at most maxLead bytes before its first required byte,
+// and there is no bound if it can start with a loop.
+void testMaxLead() {
+  std::vector<std::pair<std::string, long> > cases = {{"MAIL := [a-c]+@[a-c]+\nAT := @x\n", -1},
+							{"MAIL := [a-c]@[a-c]+\nAT := @x\n", 1},
+							{"AT := @x|ab@\n", 2},
+							{"AT := @[a-c]*\n", 0}};
+  for (auto &c : cases) {
+    if (search_emitter::maxLead(ruleDFA(parseRules(c.first)), '@') != c.second) {
+      std::cout << "testMaxLead: failed on " << c.first << std::endl;
+      return;
+    }
+  }
+  std::cout << "testMaxLead: passed" << std::endl;
+}
+
+// The lockstep Tokenizer over the DFAs of rule groups of at most
+// stateBudget states returns the tokens of the Tokenizer of one DFA.
+void testLockstep(const std::string &rules, const std::string &alphabet, const std::string &label,
+		  size_t stateBudget) {
+  std::vector<tkn_rule> tkn_rules = parseRules(rules);
+  std::vector<rule_group> groups = partitionRules(tkn_rules, stateBudget);
+  std::string single = outputDirectory(label + "Single");
+  std::string lockstep = outputDirectory(label);
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, single);
+  lockstep_emitter::emit_dfas(groups, tkn_rules, lockstep);
+
+  srand(42);
+  std::string input = joinLines(randomLines(alphabet, 500, 30));
+  std::string driver = std::string(readLinesSource) + printTokenSource + tokensDriver;
+  std::string expected = run(single, driver, input);
+  std::string emitted = run(lockstep, driver, input);
+  bool ok = groups.size() > 1 && !emitted.empty() && emitted == expected;
+  std::cout << label << ": " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// partitionRules makes the same groups with the same DFAs from Glushkov
+// NFAs and from derivatives as from Thompson NFAs.
+void testPartitionConstructions() {
+  std::vector<tkn_rule> tkn_rules = parseRules("LITERAL := [_a-zA-Z][_a-zA-Z0-9]*\nNUMBER := 0|[1-9][0-9]*\n"
+					       "IF := if\nELSE := else\nFLOAT := [0-9]+[.][0-9]*\n"
+					       "STR := [\"][^\"]*[\"]\n_WHITESPACE := [ ]+\n");
+  std::vector<rule_group> thompson = partitionRules(tkn_rules, 8);
+  bool ok = thompson.size() > 1;
+  for (auto construction : {rule_construction::GLUSHKOV, rule_construction::DERIVATIVES}) {
+    std::vector<rule_group> groups = partitionRules(tkn_rules, 8, construction);
+    ok = ok && groups.size() == thompson.size();
+    for (size_t i = 0; ok && i < groups.size(); ++i) {
+      ok = groups[i].rules == thompson[i].rules && DFA::equivalent(groups[i].dfa, thompson[i].dfa);
+    }
+  }
+  std::cout << "testPartitionConstructions: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+// Rules of different groups that match a common string are found, and
+// generate_lexer warns about them.
+void testOverlappingRules() {
+  // A and B both match abq. Split up, the lockstep Tokenizer returns
+  // INVALID ab and INVALID x on abx, a single DFA INVALID abx.
+  std::string overlapping = "A := (ab)*c|abq\nB := (ab)*q\n";
+  std::string disjoint = "A := (ab)*c\nB := (ab)*q\n";
+  std::vector<rule_group> groups = partitionRules(parseRules(overlapping), 1);
+  std::vector<std::pair<size_t, size_t> > expected = {{0, 1}};
+  bool ok = groups.size() == 2 && overlappingRules(groups) == expected &&
+    overlappingRules(partitionRules(parseRules(disjoint), 1)).empty();
+
+  std::string dir = outputDirectory("overlappingRules");
+  std::ofstream(dir + "overlapping") << overlapping;
+  std::ofstream(dir + "disjoint") << disjoint;
+  std::string warned = generate(dir, "--emit-cpp --max-states=1 overlapping ./");
+  std::string quiet = generate(dir, "--emit-cpp --max-states=1 --derivatives disjoint ./");
+  ok = ok && warned.find("Warning: A and B are in different groups") != std::string::npos &&
+    !quiet.empty() && quiet.find("Warning") == std::string::npos;
+  std::cout << "testOverlappingRules: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+const char *relexDriver =
+  "#include \"tokenizer.hh\"\n"
+  "#include <cstdlib>\n"
+  "using namespace lexer;\n"
+  "bool same(const std::vector<TokenSpan> &a, const std::vector<TokenSpan> &b) {\n"
+  "  if (a.size() != b.size()) return false;\n"
+  "  for (size_t i = 0; i < a.size(); ++i) {\n"
+  "    if (a[i].start != b[i].start || a[i].end != b[i].end || a[i].tkn != b[i].tkn) return false;\n"
+  "  }\n"
+  "  return true;\n"
+  "}\n"
+  "// Edits each line 20 times with bytes of the line and counts the\n"
+  "// relexed tokens that differ from the tokens of the edited line.\n"
+  "int main(int argc, char **argv) {\n"
+  "  srand(42);\n"
+  "  size_t edits = 0, differ = 0;\n"
+  "  for (auto &line : readLines(argv[1])) {\n"
+  "    std::string buffer = line;\n"
+  "    std::vector<TokenSpan> tokens = tokenizeSpans(buffer.c_str());\n"
+  "    for (int i = 0; i < 20; ++i, ++edits) {\n"
+  "      size_t offset = rand() % (buffer.size() + 1);\n"
+  "      size_t removed = rand() % (buffer.size() - offset + 1) % 4;\n"
+  "      std::string inserted;\n"
+  "      for (int n = rand() % 4; n > 0 && !line.empty(); --n) inserted += line[rand() % line.size()];\n"
+  "      buffer.replace(offset, removed, inserted);\n"
+  "      relex(tokens, buffer.c_str(), offset, removed, inserted.size());\n"
+  "      if (!same(tokens, tokenizeSpans(buffer.c_str()))) {\n"
+  "        ++differ;\n"
+  "        tokens = tokenizeSpans(buffer.c_str());\n"
+  "      }\n"
+  "    }\n"
+  "  }\n"
+  "  std::cout << edits << ' ' << differ << '\\n';\n"
+  "}\n";
+
+// After every edit relex gives the tokens of lexing the whole buffer.
+void testRelex() {
+  std::vector<tkn_rule> tkn_rules = parseRules(
+      "LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n"
+      "STR := '[^']*'\n_COMMENT := #[^#]*#\n_WHITESPACE := [ ]+\n");
+  std::string dir = outputDirectory("relex");
+  emit_options options;
+  options.incremental = true;
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, dir, options);
+
+  srand(42);
+  std::vector<std::string> lines = randomLines("ifx_019 '#@", 200, 60);
+  std::string emitted = run(dir, std::string(readLinesSource) + relexDriver, joinLines(lines));
+  std::cout << "testRelex: " << (emitted == std::to_string(lines.size() * 20) + " 0\n" ? "passed" : "failed") << std::endl;
+}
+
+const char *checkpointsDriver =
+  "#include <algorithm>\n"
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "// Prints, per interval, the offsets whose checkpoint gives other tokens\n"
+  "// than scanning from byte 0, or is not the last start of a call of\n"
+  "// getNextToken at or before the offset with interval 1.\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string buffer = ss.str();\n"
+  "  const char *str = buffer.c_str();\n"
+  "  std::vector<size_t> calls;\n"
+  "  std::vector<Token> tokens;\n"
+  "  Tokenizer t(str);\n"
+  "  do {\n"
+  "    calls.push_back(t.str - str);\n"
+  "    tokens.push_back(t.getNextToken());\n"
+  "  } while (tokens.back().tkn != TokenType::END_OF_FILE);\n"
+  "  for (uint32_t interval : {0, 1, 7, 64}) {\n"
+  "    std::stringstream os;\n"
+  "    writeCheckpoints(os, str, interval);\n"
+  "    std::string index = os.str();\n"
+  "    size_t bad = 0;\n"
+  "    for (size_t offset = 0; offset <= buffer.size(); ++offset) {\n"
+  "      uint64_t c = findCheckpoint(index.data(), index.size(), offset);\n"
+  "      size_t call = *(std::upper_bound(calls.begin(), calls.end(), offset) - 1);\n"
+  "      size_t k = std::lower_bound(calls.begin(), calls.end(), c) - calls.begin();\n"
+  "      bool ok = c <= offset && k < calls.size() && calls[k] == c && (interval > 1 || c == call);\n"
+  "      Tokenizer u(str + c);\n"
+  "      for (; ok && k < tokens.size(); ++k) {\n"
+  "        Token tkn = u.getNextToken();\n"
+  "        ok = tkn.start == tokens[k].start && tkn.curr == tokens[k].curr && tkn.tkn == tokens[k].tkn;\n"
+  "      }\n"
+  "      if (!ok) ++bad;\n"
+  "    }\n"
+  "    std::cout << interval << ' ' << bad << '\\n';\n"
+  "  }\n"
+  "  std::cout << findCheckpoint(\"garbage\", 7, 100) << '\\n';\n"
+  "}\n";
+
+// Scanning from the checkpoint of any offset gives the tokens of scanning
+// from byte 0, for every interval including 0, which is taken as 1.
+void testCheckpoints() {
+  std::vector<tkn_rule> tkn_rules = parseRules(
+      "LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n"
+      "STR := '[^']*'\n_COMMENT := #[^\\n]*\n_WHITESPACE := [ \\n]+\n");
+  std::string dir = outputDirectory("checkpoints");
+  emit_options options;
+  options.checkpoints = true;
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, dir, options);
+
+  srand(42);
+  std::string input = joinLines(randomLines("ifx_019 '#@", 100, 40));
+  std::string emitted = run(dir, std::string(readLinesSource) + checkpointsDriver, input);
+  std::cout << "testCheckpoints: " << (emitted == "0 0\n1 0\n7 0\n64 0\n0\n" ? "passed" : "failed") << std::endl;
+}
+
+const char *lineIndexDriver =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "// Prints the line and column of every offset of the buffer.\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string buffer = ss.str();\n"
+  "  LineIndex index(buffer.c_str());\n"
+  "  for (size_t offset = 0; offset <= buffer.size(); ++offset) {\n"
+  "    LineColumn lc = offset % 2 ? index.lookup(offset) : index.lookup(buffer.c_str() + offset);\n"
+  "    std::cout << lc.line << ' ' << lc.column << '\\n';\n"
+  "  }\n"
+  "}\n";
+
+// LineIndex gives the lines and columns of counting the newlines in front
+// of every offset, with lines both shorter and longer than the 16 bytes
+// the SSE2 build looks at at once.
+void testLineIndex() {
+  std::vector<tkn_rule> tkn_rules = parseRules("LITERAL := [a-z]+\n_WHITESPACE := [ \\n]+\n");
+  std::string dir = outputDirectory("lineIndex");
+  emit_options options;
+  options.lineIndex = true;
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, dir, options);
+
+  srand(42);
+  std::string input = "\n\n" + joinLines(randomLines("ab ", 100, 40)) + "no newline at the end";
+  std::stringstream expected;
+  size_t line = 1, column = 1;
+  for (size_t offset = 0; offset <= input.size(); ++offset) {
+    expected << line << ' ' << column << '\n';
+    if (offset < input.size() && input[offset] == '\n') {
+      ++line;
+      column = 1;
+    } else {
+      ++column;
+    }
+  }
+  std::string emitted = run(dir, std::string(readLinesSource) + lineIndexDriver, input);
+  std::cout << "testLineIndex: " << (!emitted.empty() && emitted == expected.str() ? "passed" : "failed") << std::endl;
+}
+
+const char *filePipelineDriver =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "// Prints, per chunk size and number of slots, whether FileTokenizer\n"
+  "// gives the types and texts of the tokens of a Tokenizer on the file.\n"
+  "int main(int argc, char **argv) {\n"
+  "  std::stringstream ss;\n"
+  "  ss << std::ifstream(argv[1], std::ios::binary).rdbuf();\n"
+  "  std::string buffer = ss.str();\n"
+  "  for (size_t chunkSize : {0, 1, 7, 100, 5000, 1 << 20}) {\n"
+  "    for (size_t slots : {0, 3}) {\n"
+  "      Tokenizer t(buffer.c_str());\n"
+  "      FileTokenizer f(argv[1], chunkSize, slots);\n"
+  "      bool same = true;\n"
+  "      for (;;) {\n"
+  "        Token a = t.getNextToken(), b = f.getNextToken();\n"
+  "        if (a.tkn != b.tkn || std::string(a.start, a.curr) != std::string(b.start, b.curr)) {\n"
+  "          same = false;\n"
+  "          break;\n"
+  "        }\n"
+  "        if (a.tkn == TokenType::END_OF_FILE) break;\n"
+  "      }\n"
+  "      std::cout << chunkSize << ' ' << slots << ' ' << (same && !f.fail()) << '\\n';\n"
+  "    }\n"
+  "  }\n"
+  "  FileTokenizer missing(std::string(argv[1]) + \".missing\");\n"
+  "  std::cout << missing.fail() << ' ' << (missing.getNextToken().tkn == TokenType::END_OF_FILE) << '\\n';\n"
+  "}\n";
+
+// FileTokenizer gives the tokens of a Tokenizer on the whole file for
+// chunks of every size, down to 0, which is taken as 1. The file has a
+// token longer than the room for carried tokens in front of a chunk.
+void testFilePipeline() {
+  std::vector<tkn_rule> tkn_rules = parseRules(
+      "LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n"
+      "STR := '[^']*'\n_COMMENT := #[^\\n]*\n_WHITESPACE := [ \\n]+\n");
+  std::string dir = outputDirectory("filePipeline");
+  emit_options options;
+  options.filePipeline = true;
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, dir, options);
+
+  srand(42);
+  std::string input = joinLines(randomLines("ifx_019 '#@", 100, 40)) + "'" + std::string(6000, 'x') + "' if";
+  std::string expected;
+  for (const char *chunkSize : {"0", "1", "7", "100", "5000", "1048576"}) {
+    for (const char *slots : {"0", "3"}) {
+      expected += std::string(chunkSize) + " " + slots + " 1\n";
+    }
+  }
+  std::string emitted = run(dir, std::string(readLinesSource) + filePipelineDriver, input);
+  std::cout << "testFilePipeline: " << (emitted == expected + "1 1\n" ? "passed" : "failed") << std::endl;
+}
+
+const char *pushApiDriver =
+  "#include \"tokenizer.hh\"\n"
+  "using namespace lexer;\n"
+  "bool same(const Token &a, const Token &b) {\n"
+  "  return a.tkn == b.tkn && a.start == b.start && a.curr == b.curr;\n"
+  "}\n"
+  "// Prints the number of lines where tokenize does not hand over the\n"
+  "// tokens of the Tokenizer, or does not return where it stopped.\n"
+  "int main(int argc, char **argv) {\n"
+  "  size_t differences = 0;\n"
+  "  for (auto &line : readLines(argv[1])) {\n"
+  "    const char *str = line.c_str();\n"
+  "    std::vector<Token> expected;\n"
+  "    Tokenizer t(str);\n"
+  "    for (Token tkn = t.getNextToken(); tkn.tkn != TokenType::END_OF_FILE; tkn = t.getNextToken()) {\n"
+  "      expected.push_back(tkn);\n"
+  "    }\n"
+  "    std::vector<Token> pushed;\n"
+  "    const char *end = tokenize(str, [&](const Token &tkn) { pushed.push_back(tkn); return true; });\n"
+  "    bool ok = end == str + line.size() && pushed.size() == expected.size();\n"
+  "    for (size_t i = 0; ok && i < pushed.size(); ++i) {\n"
+  "      ok = same(pushed[i], expected[i]);\n"
+  "    }\n"
+  "    // Stopping at each token returns its end.\n"
+  "    for (size_t n = 0; ok && n < expected.size(); ++n) {\n"
+  "      size_t handled = 0;\n"
+  "      end = tokenize(str, [&](const Token &) { return ++handled <= n; });\n"
+  "      ok = handled == n + 1 && end == expected[n].curr;\n"
+  "    }\n"
+  "    differences += !ok;\n"
+  "  }\n"
+  "  std::cout << differences << '\\n';\n"
+  "}\n";
+
+// The tokenize template of the push API hands the handler the tokens of
+// the Tokenizer and returns where it stopped.
+void testPushApi(const std::string &rules, const std::string &alphabet, const std::string &label) {
+  std::vector<tkn_rule> tkn_rules = parseRules(rules);
+  std::string dir = outputDirectory(label);
+  emit_options options;
+  options.pushApi = true;
+  cpp_emitter::emit_dfa(ruleDFA(tkn_rules), tkn_rules, dir, options);
+
+  srand(42);
+  std::string input = joinLines(randomLines(alphabet, 500, 30));
+  std::string emitted = run(dir, std::string(readLinesSource) + pushApiDriver, input);
+  std::cout << label << ": " << (emitted == "0\n" ? "passed" : "failed") << std::endl;
+}
+
+// --derivatives alone builds the DFA without the NFA of the rules, and
+// --check-derivatives builds both.
+void testDerivativesWithoutNFA() {
+  std::string dir = outputDirectory("derivatives");
+  std::ofstream(dir + "rules") << "LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n";
+  std::string derived = generate(dir, "--emit-cpp --derivatives rules ./");
+  std::string checked = generate(dir, "--emit-cpp --check-derivatives rules ./");
+  bool ok = derived.find("Taking derivatives") != std::string::npos &&
+    derived.find("Building NFA") == std::string::npos &&
+    checked.find("Building NFA") != std::string::npos;
+  std::cout << "testDerivativesWithoutNFA: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+int main() {
+
+  testInitialStateEnteredAgain();
+
+  testSearch("AB := ab\nABC := abc+\nB := b[a-c]*\nCA := ca\n", "abcx", "testSearch");
+
+  // Every match contains @, so the Searcher stops at the last @, but a
+  // match can start any number of bytes before it.
+  testSearch("MAIL := [a-c]+@[a-c]+\nAT := @x\n", "abc@x ", "testSearchRequiredByte");
+
+  testMaxLead();
+
+  // Here a match starts at most one byte before its @, so the Searcher
+  // starts one byte before the next @. The @ are few, and far apart.
+  testSearch("MAIL := [a-c]@[a-c]+\nAT := @x|ab@\n", "abcabcabcabcabc x@", "testSearchSkip");
+
+  testLockstep("LITERAL := [_a-zA-Z][_a-zA-Z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\nELSE := else\n"
+	       "FLOAT := [0-9]+[.][0-9]*\nSTR := [\"][^\"]*[\"]\n_WHITESPACE := [ ]+\n",
+	       "ifelsx_0129. \"", "testLockstep", 8);
+
+  // Every group is back in its initial state after "ab".
+  testLockstep(reentry_rules, "abcdx", "testLockstepInitialStateEnteredAgain", 1);
+
+  testPartitionConstructions();
+
+  testOverlappingRules();
+
+  testRelex();
+
+  testCheckpoints();
+
+  testLineIndex();
+
+  testFilePipeline();
+
+  testPushApi("LITERAL := [_a-z][_a-z0-9]*\nNUMBER := 0|[1-9][0-9]*\nIF := if\n_WHITESPACE := [ ]+\n",
+	      "ifx_019 @", "testPushApi");
+
+  testPushApi(reentry_rules, "abcdx", "testPushApiInitialStateEnteredAgain");
+
+  testDerivativesWithoutNFA();
+
+  testBulkInvalid();
+
+  testProfile();
+
+  testStats();
+
+  testActions();
+
+  testIntern();
+
+  testLexFiles();
+  testTokenStream();
+  testTableBlob();
+
+}
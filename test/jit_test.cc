@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../src/jit.hh"
+#include "../src/partition.hh"
+
+using namespace lexer;
+
+const char *small_rules =
+  "LITERAL := [_a-zA-Z][_a-zA-Z0-9]*\n"
+  "NUMBER := 0|[1-9][0-9]*\n"
+  "IF := if\n"
+  "ELSE := else\n"
+  "WHILE := while\n"
+  "OPERATOR := [\\-+*/%<>=!&|^~]\n"
+  "_COMMENT := (//|#)[^\\n]*\n"
+  "_WHITESPACE := [\\t ]+\n"
+  "_NEWLINE := ([\\n]+)|(([\\r][\\n])+)\n";
+
+// Tokens of random inputs are the same as Matcher's, whichever engine the
+// JitMatcher uses.
+bool sameTokens(const Matcher &m, const JitMatcher &j, const std::string &input) {
+  Matcher::Tokenizer mt = m.tokenize(input.c_str());
+  JitMatcher::Tokenizer jt = j.tokenize(input.c_str());
+  for (;;) {
+    Matcher::Token a = mt.getNextToken();
+    JitMatcher::Token b = jt.getNextToken();
+    if (a.start != b.start || a.curr != b.curr || a.tkn != b.tkn) {
+      std::cout << "Differs on '" << input << "' at " << a.start - input.c_str() << ": "
+		<< m.getName(a.tkn) << " '" << std::string(a.start, a.curr) << "' but "
+		<< j.getName(b.tkn) << " '" << std::string(b.start, b.curr) << "'" << std::endl;
+      return false;
+    }
+    if (a.tkn == m.getEndOfFileType()) return true;
+  }
+}
+
+void testRandom(const std::string &rules, const std::string &alphabet, const std::string &label) {
+  std::stringstream rs(rules);
+  std::vector<tkn_rule> tkn_rules = parseFile(rs);
+  std::vector<size_t> all;
+  std::vector<std::string> names;
+  for (size_t i = 0; i < tkn_rules.size(); ++i) {
+    all.push_back(i);
+    names.push_back(tkn_rules[i].name);
+  }
+  DFA d = buildRuleDFA(tkn_rules, all);
+  Matcher m(d, names);
+  JitMatcher j(d, names);
+  srand(42);
+  bool ok = true;
+  for (int round = 0; round < 2000 && ok; ++round) {
+    std::string input;
+    for (int i = rand() % 200; i > 0; --i) {
+      input += alphabet[rand() % alphabet.size()];
+    }
+    ok = sameTokens(m, j, input);
+  }
+  std::cout << label << ": " << (ok ? "passed" : "failed")
+	    << (j.isNative() ? " (native)" : " (table engine)") << std::endl;
+}
+
+int main() {
+
+  testRandom(small_rules, "ifelsewhx_09 \t\r\n#/@+-", "testSmallLang");
+
+  // Dispatch through jump tables, and long self loops for the SSE2 loop.
+  std::string bytes;
+  for (int c = 1; c < 256; ++c) bytes += static_cast<char>(c);
+  testRandom(std::string(small_rules) + "WORD := [^ \\n]+[.]\n", bytes + "                      ", "testAllBytes");
+
+  // A rejecting initial state that is entered again.
+  testRandom("A := (ab)*c\n", "abcx", "testPrefixInvalid");
+
+}
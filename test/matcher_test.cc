@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/matcher.hh"
+
+using namespace lexer;
+
+std::stringstream small_lang(
+    "LITERAL := [_a-zA-Z][_a-zA-Z0-9]*\n"
+    "NUMBER := 0|[1-9][0-9]*\n"
+    "IF := if\n"
+    "ELSE := else\n"
+    "WHILE := while\n"
+    "_COMMENT := (//|#)[^\\n]*\n"
+    "_WHITESPACE := [\\t ]+\n"
+    "_NEWLINE := ([\\n]+)|(([\\r][\\n])+)\n"
+			     );
+
+bool expectTokens(const Matcher &m, const std::string &input,
+		  const std::vector<std::pair<std::string, std::string> > &expected) {
+  Matcher::Tokenizer t = m.tokenize(input.c_str());
+  for (auto &e : expected) {
+    Matcher::Token tkn = t.getNextToken();
+    std::string name = m.getName(tkn.tkn);
+    std::string text(tkn.start, tkn.curr);
+    if (name != e.first || text != e.second) {
+      std::cout << "Expected " << e.first << " '" << e.second << "' but got "
+		<< name << " '" << text << "'" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+void testTokens(const Matcher &m) {
+  bool ok = expectTokens(m, "if x12 else 42 while # comment\nfoo 007 @@ bar",
+			 {{"IF", "if"}, {"LITERAL", "x12"}, {"ELSE", "else"},
+			  {"NUMBER", "42"}, {"WHILE", "while"}, {"LITERAL", "foo"},
+			  {"NUMBER", "0"}, {"NUMBER", "0"}, {"NUMBER", "7"},
+			  {"INVALID", "@"}, {"INVALID", "@"}, {"LITERAL", "bar"},
+			  {"END_OF_FILE", ""}, {"END_OF_FILE", ""}});
+  std::cout << "testTokens: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+void testPrefixInvalid() {
+  // The scan stops in a non-accepting state without backing up, like
+  // the emitted lexer.
+  std::stringstream rules("A := ab\nB := abcd\n");
+  Matcher m = Matcher::fromStream(rules);
+  bool ok = expectTokens(m, "ababcabcd",
+			 {{"A", "ab"}, {"INVALID", "abc"}, {"B", "abcd"},
+			  {"END_OF_FILE", ""}});
+  std::cout << "testPrefixInvalid: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+void testSaveLoad(const Matcher &m) {
+  std::string filename = "matcher_test.dfa";
+  {
+    std::ofstream fs(filename, std::ios::binary);
+    m.save(fs);
+  }
+  Matcher loaded = Matcher::load(filename);
+  std::remove(filename.c_str());
+  std::cout << "testSaveLoad: ";
+  testTokens(loaded);
+
+  bool rejected = false;
+  {
+    std::ofstream fs(filename, std::ios::binary);
+    fs << "not a lexer";
+  }
+  try {
+    Matcher::load(filename);
+  } catch (std::runtime_error &e) {
+    rejected = true;
+  }
+  std::remove(filename.c_str());
+  std::cout << "testLoadGarbage: " << (rejected ? "passed" : "failed") << std::endl;
+}
+
+// Offsets of image_header fields in matcher.cc.
+const size_t numberOfStatesField = 16, numberOfClassesField = 20, numberOfNamesField = 32,
+  classOfField = 40, deltaField = 48, onStopField = 56, acceptField = 64;
+
+template<typename T>
+T field(const std::string &image, size_t offset) {
+  T x;
+  image.copy(reinterpret_cast<char*>(&x), sizeof(x), offset);
+  return x;
+}
+
+template<typename T>
+void setField(std::string &image, size_t offset, T x) {
+  image.replace(offset, sizeof(x), reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+// Images with a table entry out of range are refused by load.
+void testLoadCorrupt(const Matcher &m) {
+  std::stringstream ss;
+  m.save(ss);
+  const std::string image = ss.str();
+  uint32_t states = field<uint32_t>(image, numberOfStatesField);
+  uint32_t classes = field<uint32_t>(image, numberOfClassesField);
+  uint64_t classOf = field<uint64_t>(image, classOfField);
+  uint64_t delta = field<uint64_t>(image, deltaField);
+  uint64_t onStop = field<uint64_t>(image, onStopField);
+  uint64_t accept = field<uint64_t>(image, acceptField);
+  uint32_t token = 0;
+  while (token < states && image[onStop + token] != 2) {
+    ++token;
+  }
+
+  std::vector<std::string> corrupt(5, image);
+  // A byte class, a next state, a token type out of range, an unknown
+  // action and a 0 that does not end the scan.
+  setField<uint8_t>(corrupt[0], classOf + 'a', classes);
+  setField<uint32_t>(corrupt[1], delta + 4 * (classes + 1), states);
+  setField<uint32_t>(corrupt[2], accept + 4 * token, field<uint32_t>(image, numberOfNamesField));
+  setField<uint8_t>(corrupt[3], onStop, 3);
+  setField<uint32_t>(corrupt[4], delta + 4 * uint8_t(image[classOf]), 0);
+
+  std::string filename = "matcher_test.dfa";
+  bool ok = token < states;
+  for (auto &c : corrupt) {
+    std::ofstream(filename, std::ios::binary) << c;
+    try {
+      Matcher::load(filename);
+      ok = false;
+    } catch (std::runtime_error &e) {
+    }
+  }
+  std::ofstream(filename, std::ios::binary) << image;
+  ok = ok && Matcher::load(filename).getNumberOfStates() == m.getNumberOfStates();
+  std::remove(filename.c_str());
+  std::cout << "testLoadCorrupt: " << (ok ? "passed" : "failed") << std::endl;
+}
+
+int main() {
+
+  Matcher m = Matcher::fromStream(small_lang);
+
+  std::cout << "Compiled " << m.getNumberOfStates() << " states, "
+	    << m.getNumberOfClasses() << " byte classes" << std::endl;
+
+  testTokens(m);
+
+  testPrefixInvalid();
+
+  testSaveLoad(m);
+
+  testLoadCorrupt(m);
+
+}
@@ -90,8 +90,21 @@ void test_precedence2() {
     parsed.regexp->printType(ss);
 }
 
+void test_action() {
+  std::string line = "NUM {decimal} := [0-9]+";
+
+  tkn_rule parsed(lexer::parseLine(line, 0));
+
+  if (parsed.name != "NUM" || parsed.action != token_action::DECIMAL) {
+    std::cout << "Error in parser test: action not parsed" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
 int main() {
 
+  test_action();
+
   ss << "{\"test_concat\":" << std::endl;
   test_concat();
 